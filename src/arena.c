@@ -0,0 +1,202 @@
+/**
+ * @file src/arena.c
+ *
+ * @brief Slab arena allocator
+ *
+ * An allocator carving power-of-two sized blocks out of large chunks.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <arena.h>
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <likely.h>
+
+/// The size of the smallest block served by the arena
+#define ARENA_MIN_BLOCK ((size_t)16)
+/// The size of the largest block carved from a chunk
+#define ARENA_MAX_BLOCK (ARENA_MIN_BLOCK << (ARENA_CLASSES - 1))
+/// The size of a chunk, including its header
+#define ARENA_CHUNK_SIZE ((size_t)1 << 20)
+
+/// A chunk blocks are carved from
+struct arena_chunk {
+	struct arena_chunk *next; /**< The next chunk in the arena */
+	max_align_t payload[];    /**< The memory blocks are carved from */
+};
+
+/// A block too large to be carved from a chunk, allocated on its own
+struct arena_large {
+	struct arena_large *next; /**< The next large block in the arena */
+	struct arena_large *prev; /**< The previous large block in the arena */
+	max_align_t payload[];    /**< The memory handed out to the user */
+};
+
+/// A released block, waiting in a free list
+struct arena_free_block {
+	struct arena_free_block *next; /**< The next block in the same free list */
+};
+
+
+/**
+ * @brief Get the size class serving a block
+ * @param size the requested size
+ * @return the index of the size class, ARENA_CLASSES if the block is too large
+ */
+static unsigned size_class(size_t size)
+{
+	unsigned c = 0;
+
+	while(c < ARENA_CLASSES && (ARENA_MIN_BLOCK << c) < size)
+		c++;
+	return c;
+}
+
+
+/**
+ * @brief Allocate a block from an arena
+ *
+ * Blocks are rounded up to the next power of two. Small blocks are carved
+ * from the current chunk or recycled from the free lists, while large blocks
+ * are allocated on their own and linked to the arena.
+ *
+ * @param arena the arena to allocate from
+ * @param size the size of the block
+ * @return a pointer to the new block, NULL if memory could not be allocated
+ */
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	unsigned c = size_class(size);
+
+	if(unlikely(c == ARENA_CLASSES)) {
+		struct arena_large *large = malloc(sizeof(*large) + size);
+		if(large == NULL)
+			return NULL;
+		large->prev = NULL;
+		large->next = arena->large;
+		if(arena->large != NULL)
+			arena->large->prev = large;
+		arena->large = large;
+		return large->payload;
+	}
+
+	struct arena_free_block *block = arena->free_lists[c];
+	if(block != NULL) {
+		arena->free_lists[c] = block->next;
+		return block;
+	}
+
+	size = ARENA_MIN_BLOCK << c;
+	if(unlikely(arena->available < size)) {
+		// The tail of the current chunk is too small for this block: recycle it in the free lists
+		while(arena->available >= ARENA_MIN_BLOCK) {
+			unsigned t = size_class(arena->available + 1) - 1;
+			arena_free(arena, arena->cursor, ARENA_MIN_BLOCK << t);
+			arena->cursor += ARENA_MIN_BLOCK << t;
+			arena->available -= ARENA_MIN_BLOCK << t;
+		}
+
+		struct arena_chunk *chunk = malloc(ARENA_CHUNK_SIZE);
+		if(chunk == NULL)
+			return NULL;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+		arena->cursor = (char *)chunk->payload;
+		arena->available = ARENA_CHUNK_SIZE - sizeof(*chunk);
+	}
+
+	void *ret = arena->cursor;
+	arena->cursor += size;
+	arena->available -= size;
+	return ret;
+}
+
+
+/**
+ * @brief Release a block to its arena
+ * @param arena the arena the block was allocated from
+ * @param ptr the block to release, can be NULL
+ * @param size the size the block was allocated with
+ */
+void arena_free(struct arena *arena, void *ptr, size_t size)
+{
+	unsigned c = size_class(size);
+
+	if(ptr == NULL)
+		return;
+
+	if(unlikely(c == ARENA_CLASSES)) {
+		struct arena_large *large = (struct arena_large *)((char *)ptr - offsetof(struct arena_large, payload));
+		if(large->prev != NULL)
+			large->prev->next = large->next;
+		else
+			arena->large = large->next;
+		if(large->next != NULL)
+			large->next->prev = large->prev;
+		free(large);
+		return;
+	}
+
+	struct arena_free_block *block = ptr;
+	block->next = arena->free_lists[c];
+	arena->free_lists[c] = block;
+}
+
+
+/**
+ * @brief Resize a block of an arena
+ *
+ * The content of the block is preserved up to the smallest of the two sizes.
+ *
+ * @param arena the arena the block was allocated from
+ * @param ptr the block to resize, can be NULL
+ * @param old_size the size the block was allocated with
+ * @param new_size the new size of the block
+ * @return a pointer to the resized block, NULL if memory could not be
+ * allocated. In the latter case the original block is left untouched.
+ */
+void *arena_realloc(struct arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+	if(ptr != NULL && size_class(old_size) == size_class(new_size) && size_class(new_size) < ARENA_CLASSES)
+		return ptr;
+
+	void *ret = arena_alloc(arena, new_size);
+	if(ret == NULL)
+		return NULL;
+
+	if(ptr != NULL) {
+		memcpy(ret, ptr, old_size < new_size ? old_size : new_size);
+		arena_free(arena, ptr, old_size);
+	}
+	return ret;
+}
+
+
+/**
+ * @brief Release all the memory held by an arena
+ *
+ * This costs time proportional to the number of chunks and large blocks,
+ * regardless of how many blocks have been allocated.
+ *
+ * @param arena the arena to release, which can be reused afterwards
+ */
+void arena_release(struct arena *arena)
+{
+	while(arena->chunks != NULL) {
+		struct arena_chunk *next = arena->chunks->next;
+		free(arena->chunks);
+		arena->chunks = next;
+	}
+
+	while(arena->large != NULL) {
+		struct arena_large *next = arena->large->next;
+		free(arena->large);
+		arena->large = next;
+	}
+
+	memset(arena, 0, sizeof(*arena));
+}
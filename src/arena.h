@@ -0,0 +1,32 @@
+/**
+ * @file src/arena.h
+ *
+ * @brief Slab arena allocator
+ *
+ * An allocator carving power-of-two sized blocks out of large chunks. Freed
+ * blocks are kept in per-size free lists for later reuse, and the whole arena
+ * is released at once in time proportional to the number of chunks.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <stddef.h>
+
+/// The number of size classes served from the arena chunks
+#define ARENA_CLASSES 13
+
+/// An arena of memory blocks
+struct arena {
+	struct arena_chunk *chunks;         /**< The chunks the blocks are carved from */
+	struct arena_large *large;          /**< The blocks too large to be carved from a chunk */
+	char *cursor;                       /**< The first free byte in the current chunk */
+	size_t available;                   /**< The number of free bytes in the current chunk */
+	void *free_lists[ARENA_CLASSES];    /**< The released blocks of each size class */
+};
+
+extern void *arena_alloc(struct arena *arena, size_t size);
+extern void *arena_realloc(struct arena *arena, void *ptr, size_t old_size, size_t new_size);
+extern void arena_free(struct arena *arena, void *ptr, size_t size);
+extern void arena_release(struct arena *arena);
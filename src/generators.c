@@ -0,0 +1,640 @@
+/**
+ * @file src/generators.c
+ *
+ * @brief Random graph generators
+ *
+ * Generators of synthetic graphs which produce the links directly in the
+ * packed form graph_build() takes, so that no per-link allocation happens.
+ * The random numbers of every node, or of every block of links, come from
+ * their own stream, so the generated graph only depends on the seed and
+ * not on the number of threads. Links are packed as
+ * (from << bits_needed(regions - 1)) | to.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <generators.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <parallel.h>
+#include <random.h>
+#include <sort.h>
+
+/// The number of R-MAT links drawn from the same random streams
+#define RMAT_BLOCK 4096
+/// The number of random numbers R-MAT draws at once, a multiple of RANDOM_LANES
+#define RMAT_BATCH 512
+
+
+/**
+ * @brief Drop the self-loops from an array of packed links
+ * @param keys the packed links
+ * @param n the number of links
+ * @param bits the number of bits of the destination of a packed link
+ * @return the number of links left, which are moved to the front of @p keys
+ */
+static size_t drop_self_loops(uint64_t *keys, size_t n, unsigned bits)
+{
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	size_t ret = 0;
+
+	for(size_t i = 0; i < n; i++)
+		if(keys[i] >> bits != (keys[i] & mask))
+			keys[ret++] = keys[i];
+	return ret;
+}
+
+
+/**
+ * @brief Draw the links of a node of a G(n, p) graph towards the nodes with higher IDs
+ *
+ * Rather than flipping a coin for every candidate, the number of candidates
+ * skipped before the next link is drawn from a geometric distribution, so
+ * that the cost is proportional to the number of links.
+ *
+ * @param from the node whose links are drawn
+ * @param regions the number of nodes of the graph
+ * @param log_miss the logarithm of the probability that a candidate is not linked
+ * @param seed the seed of the graph
+ * @param keys where to store the links, in both directions, NULL to only count them
+ * @param bits the number of bits of the destination of a packed link
+ * @return the number of links drawn
+ */
+static uint64_t erdos_renyi_row(lp_id_t from, lp_id_t regions, double log_miss, uint64_t seed, uint64_t *keys,
+    unsigned bits)
+{
+	struct topology_rng stream;
+	uint64_t ret = 0;
+	lp_id_t to = from;
+
+	random_stream_init(&stream, seed, from);
+	while(true) {
+		double skip = floor(log1p(-random_stream_double(&stream)) / log_miss);
+		if(!(skip < (double)(regions - 1 - to)))
+			break;
+		to += (lp_id_t)skip + 1;
+		if(keys != NULL) {
+			keys[2 * ret] = (from << bits) | to;
+			keys[2 * ret + 1] = (to << bits) | from;
+		}
+		ret++;
+	}
+	return ret;
+}
+
+
+/**
+ * @brief Generate an undirected Erdős-Rényi G(n, p) graph
+ *
+ * Every node draws its links towards the nodes with higher IDs, once to
+ * count them and once to store them where the prefix sum of the counts
+ * places them, so that rows are generated in parallel with no locking.
+ *
+ * @param regions the number of nodes
+ * @param probability the probability that any two distinct nodes are linked
+ * @param seed the seed of the graph
+ * @param keys where to store the newly allocated array of packed links, in both directions
+ * @param n where to store the number of links
+ * @return true on success, false if memory could not be allocated
+ */
+bool generate_erdos_renyi(lp_id_t regions, double probability, uint64_t seed, uint64_t **keys, size_t *n)
+{
+	unsigned bits = bits_needed(regions - 1);
+	double log_miss = log1p(-probability);
+	uint64_t *offsets = calloc(regions + 1, sizeof(*offsets));
+
+	if(offsets == NULL)
+		return false;
+
+	if(probability > 0) {
+		parallel_for_dynamic(regions > PARALLEL_MIN_WORK)
+		for(lp_id_t i = 0; i < regions; i++)
+			offsets[i] = erdos_renyi_row(i, regions, log_miss, seed, NULL, bits);
+	}
+	uint64_t total = prefix_sum(offsets, regions + 1);
+
+	*keys = malloc((2 * total + 1) * sizeof(**keys));
+	if(*keys == NULL) {
+		free(offsets);
+		return false;
+	}
+
+	if(total != 0) {
+		parallel_for_dynamic(regions > PARALLEL_MIN_WORK)
+		for(lp_id_t i = 0; i < regions; i++)
+			erdos_renyi_row(i, regions, log_miss, seed, *keys + 2 * offsets[i], bits);
+	}
+
+	free(offsets);
+	*n = 2 * total;
+	return true;
+}
+
+
+/**
+ * @brief Find the destination of a link of a Barabási-Albert graph
+ *
+ * Following Batagelj and Brandes, links are laid out as a sequence of
+ * endpoints, and the destination of every link is copied from a uniformly
+ * random earlier position, which picks nodes proportionally to their degree.
+ * Following Sanders and Schulz, that position is drawn from a hash of the
+ * current one rather than from a sequential stream, so every link can be
+ * resolved independently: the chain of copies ends on the source of a link,
+ * which is known in closed form, after two steps on average.
+ *
+ * @param position the position of the destination in the sequence of endpoints, an odd number
+ * @param links the number of links every node adds
+ * @param key the scrambled seed of the graph
+ * @return the destination of the link
+ */
+static lp_id_t barabasi_albert_target(uint64_t position, unsigned links, uint64_t key)
+{
+	while(position & 1)
+		position = random_range(random_mix(key ^ position), position);
+	return position / 2 / links;
+}
+
+
+/**
+ * @brief Generate an undirected Barabási-Albert preferential attachment graph
+ *
+ * Every node adds @p links links towards the nodes before it, picked
+ * proportionally to their degree. Self-loops are dropped, and so are
+ * duplicate links when the graph is built, so nodes may end up with fewer
+ * links.
+ *
+ * @param regions the number of nodes
+ * @param links the number of links every node adds
+ * @param seed the seed of the graph
+ * @param keys where to store the newly allocated array of packed links, in both directions
+ * @param n where to store the number of links
+ * @return true on success, false if memory could not be allocated
+ */
+bool generate_barabasi_albert(lp_id_t regions, unsigned links, uint64_t seed, uint64_t **keys, size_t *n)
+{
+	unsigned bits = bits_needed(regions - 1);
+	uint64_t edges = regions * links, key = random_mix(seed);
+
+	*keys = malloc((2 * edges + 1) * sizeof(**keys));
+	if(*keys == NULL)
+		return false;
+
+	parallel_for(edges > PARALLEL_MIN_WORK)
+	for(uint64_t e = 0; e < edges; e++) {
+		lp_id_t from = e / links, to = barabasi_albert_target(2 * e + 1, links, key);
+		(*keys)[2 * e] = (from << bits) | to;
+		(*keys)[2 * e + 1] = (to << bits) | from;
+	}
+
+	*n = drop_self_loops(*keys, 2 * edges, bits);
+	return true;
+}
+
+
+/**
+ * @brief Generate an undirected Watts-Strogatz small-world graph
+ *
+ * Every node starts linked to the @p neighbors nodes which follow it on a
+ * ring, and every such link is rewired to a uniformly random node other
+ * than its source with probability @p rewiring. Duplicate links are dropped
+ * when the graph is built.
+ *
+ * @param regions the number of nodes
+ * @param neighbors the number of nodes every node is linked to on either side, less than half of @p regions
+ * @param rewiring the probability that a link is rewired
+ * @param seed the seed of the graph
+ * @param keys where to store the newly allocated array of packed links, in both directions
+ * @param n where to store the number of links
+ * @return true on success, false if memory could not be allocated
+ */
+bool generate_watts_strogatz(lp_id_t regions, unsigned neighbors, double rewiring, uint64_t seed,
+    uint64_t **keys, size_t *n)
+{
+	unsigned bits = bits_needed(regions - 1);
+
+	*keys = malloc((2 * regions * neighbors + 1) * sizeof(**keys));
+	if(*keys == NULL)
+		return false;
+
+	parallel_for(regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < regions; i++) {
+		struct topology_rng stream;
+		uint64_t *row = *keys + 2 * i * neighbors;
+
+		random_stream_init(&stream, seed, i);
+		for(unsigned j = 0; j < neighbors; j++) {
+			lp_id_t to = (i + j + 1) % regions;
+			if(random_stream_double(&stream) < rewiring) {
+				to = random_range(random_stream_u64(&stream), regions - 1);
+				to += to >= i;
+			}
+			row[2 * j] = (i << bits) | to;
+			row[2 * j + 1] = (to << bits) | i;
+		}
+	}
+
+	*n = 2 * regions * neighbors;
+	return true;
+}
+
+
+/**
+ * @brief Generate a directed R-MAT graph
+ *
+ * Every link is placed by descending @p scale times into one of the four
+ * quadrants of the adjacency matrix, picked with probabilities @p a, @p b,
+ * @p c and 1 - @p a - @p b - @p c, which is equivalent to sampling a
+ * stochastic Kronecker graph. Self-loops are dropped, and so are duplicate
+ * links when the graph is built. Every block of links draws its random
+ * numbers in batches from interleaved streams, which are generated with
+ * vector instructions.
+ *
+ * @param scale the base 2 logarithm of the number of nodes
+ * @param links the number of links to draw
+ * @param a the probability of the top-left quadrant, linking low IDs to low IDs
+ * @param b the probability of the top-right quadrant, linking low IDs to high IDs
+ * @param c the probability of the bottom-left quadrant, linking high IDs to low IDs
+ * @param seed the seed of the graph
+ * @param keys where to store the newly allocated array of packed links
+ * @param n where to store the number of links
+ * @return true on success, false if memory could not be allocated
+ */
+bool generate_rmat(unsigned scale, uint64_t links, double a, double b, double c, uint64_t seed, uint64_t **keys,
+    size_t *n)
+{
+	unsigned bits = bits_needed(((lp_id_t)1 << scale) - 1);
+	uint64_t blocks = (links + RMAT_BLOCK - 1) / RMAT_BLOCK;
+	double ab = a + b, abc = a + b + c;
+
+	*keys = malloc((links + 1) * sizeof(**keys));
+	if(*keys == NULL)
+		return false;
+
+	parallel_for(blocks > 1)
+	for(uint64_t block = 0; block < blocks; block++) {
+		struct random_lanes lanes;
+		double batch[RMAT_BATCH];
+		unsigned next = RMAT_BATCH;
+		uint64_t end = (block + 1) * RMAT_BLOCK < links ? (block + 1) * RMAT_BLOCK : links;
+
+		random_lanes_init(&lanes, seed, block);
+		for(uint64_t e = block * RMAT_BLOCK; e < end; e++) {
+			lp_id_t from = 0, to = 0;
+			for(unsigned level = 0; level < scale; level++) {
+				if(next == RMAT_BATCH) {
+					random_lanes_double(&lanes, batch, RMAT_BATCH);
+					next = 0;
+				}
+				double r = batch[next++];
+				// Bitwise operators rather than logical ones, since the outcomes are unpredictable branches
+				from = (from << 1) | (r >= ab);
+				to = (to << 1) | (((r >= a) & (r < ab)) | (r >= abc));
+			}
+			(*keys)[e] = (from << bits) | to;
+		}
+	}
+
+	*n = drop_self_loops(*keys, links, bits);
+	return true;
+}
+
+
+/// The uniform grid of cells random geometric graph nodes are binned into
+struct geometric_grid {
+	const double *positions; ///< the coordinates of the nodes sorted by cell, x and y interleaved
+	const lp_id_t *nodes;    ///< the nodes sorted by cell, by increasing ID within every cell
+	const uint64_t *offsets; ///< the position in nodes of the first node of every cell
+	unsigned cells;          ///< the number of cells along either side of the unit square
+	double radius;           ///< the distance below which nodes are linked
+	bool torus;              ///< whether the unit square wraps around
+};
+
+
+/**
+ * @brief Get the cell holding a coordinate
+ * @param coordinate the coordinate, in [0, 1)
+ * @param cells the number of cells along either side of the unit square
+ * @return the index of the cell along the side
+ */
+static inline unsigned geometric_cell(double coordinate, unsigned cells)
+{
+	unsigned ret = (unsigned)(coordinate * cells);
+	return ret < cells ? ret : cells - 1;
+}
+
+
+/**
+ * @brief List the cells along one side which may hold nodes close enough to a cell
+ *
+ * Cells are at least as wide as the radius, so only adjacent cells need to
+ * be visited. When the square wraps around and has fewer than three cells
+ * along a side, adjacent cells coincide, and every cell is listed once.
+ *
+ * @param cell the index of the cell along the side
+ * @param grid the grid of cells
+ * @param span where to store the indices of the cells to visit
+ * @return the number of cells to visit
+ */
+static unsigned geometric_span(unsigned cell, const struct geometric_grid *grid, unsigned span[3])
+{
+	unsigned ret = 0;
+
+	if(grid->torus && grid->cells < 3) {
+		for(unsigned i = 0; i < grid->cells; i++)
+			span[ret++] = i;
+		return ret;
+	}
+
+	for(int d = -1; d <= 1; d++) {
+		long other = (long)cell + d;
+		if(grid->torus)
+			span[ret++] = (unsigned)((other + grid->cells) % grid->cells);
+		else if(other >= 0 && other < (long)grid->cells)
+			span[ret++] = (unsigned)other;
+	}
+	return ret;
+}
+
+
+/**
+ * @brief Find the links of a node of a random geometric graph
+ * @param sorted the position of the node whose links are found among the nodes sorted by cell
+ * @param grid the grid the nodes are binned into
+ * @param keys where to store the links, NULL to only count them
+ * @param probabilities where to store the bit patterns of the weights of the links
+ * @param bits the number of bits of the destination of a packed link
+ * @return the number of links found
+ */
+static uint64_t geometric_row(uint64_t sorted, const struct geometric_grid *grid, uint64_t *keys,
+    uint64_t *probabilities, unsigned bits)
+{
+	double x = grid->positions[2 * sorted], y = grid->positions[2 * sorted + 1];
+	double squared_radius = grid->radius * grid->radius;
+	lp_id_t from = grid->nodes[sorted];
+	unsigned columns[3], rows[3], n_columns, n_rows;
+	uint64_t ret = 0;
+
+	n_columns = geometric_span(geometric_cell(x, grid->cells), grid, columns);
+	n_rows = geometric_span(geometric_cell(y, grid->cells), grid, rows);
+
+	for(unsigned r = 0; r < n_rows; r++) {
+		for(unsigned c = 0; c < n_columns; c++) {
+			unsigned cell = rows[r] * grid->cells + columns[c];
+			for(uint64_t k = grid->offsets[cell]; k < grid->offsets[cell + 1]; k++) {
+				double dx = fabs(x - grid->positions[2 * k]), dy = fabs(y - grid->positions[2 * k + 1]);
+				if(grid->torus) {
+					dx = fmin(dx, 1 - dx);
+					dy = fmin(dy, 1 - dy);
+				}
+				if(k == sorted || !(dx * dx + dy * dy < squared_radius))
+					continue;
+
+				if(keys != NULL) {
+					double weight = 1 - sqrt(dx * dx + dy * dy) / grid->radius;
+					keys[ret] = (from << bits) | grid->nodes[k];
+					memcpy(&probabilities[ret], &weight, sizeof(weight));
+				}
+				ret++;
+			}
+		}
+	}
+	return ret;
+}
+
+
+/**
+ * @brief Generate a random geometric graph
+ *
+ * Nodes are scattered uniformly on the unit square, and every two nodes
+ * closer than @p radius are linked, with a weight decreasing linearly from
+ * 1 to 0 as their distance grows to @p radius. Nodes are binned into a grid
+ * of cells at least @p radius wide, so that every node is only compared to
+ * the nodes in its own and in the adjacent cells, whose coordinates are
+ * copied next to each other. The grid never has more cells than nodes, so
+ * that the expected cost is proportional to the number of nodes plus the
+ * number of links.
+ *
+ * @param regions the number of nodes
+ * @param radius the distance below which nodes are linked
+ * @param torus whether the unit square wraps around, so that nodes near opposite sides are close
+ * @param seed the seed of the graph
+ * @param positions where to store the coordinates of every node, x and y interleaved
+ * @param keys where to store the newly allocated array of packed links, in both directions
+ * @param probabilities where to store the newly allocated array of bit patterns of the weights of the links
+ * @param n where to store the number of links
+ * @return true on success, false if memory could not be allocated
+ */
+bool generate_geometric(lp_id_t regions, double radius, bool torus, uint64_t seed, double *positions,
+    uint64_t **keys, uint64_t **probabilities, size_t *n)
+{
+	unsigned bits = bits_needed(regions - 1);
+	double cells = fmin(floor(1 / radius), ceil(sqrt((double)regions)));
+	struct geometric_grid grid = {
+		.cells = cells < 1 ? 1 : (unsigned)cells,
+		.radius = radius,
+		.torus = torus
+	};
+	size_t n_cells = (size_t)grid.cells * grid.cells;
+	lp_id_t *nodes = malloc(regions * sizeof(*nodes));
+	double *sorted = malloc(2 * regions * sizeof(*sorted));
+	uint64_t *offsets = calloc(n_cells + 1, sizeof(*offsets));
+	uint64_t *rows = calloc(regions + 1, sizeof(*rows));
+	bool ret = false;
+
+	*keys = NULL;
+	*probabilities = NULL;
+	if(nodes == NULL || sorted == NULL || offsets == NULL || rows == NULL)
+		goto out;
+
+	parallel_for(regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < regions; i++) {
+		struct topology_rng stream;
+		random_stream_init(&stream, seed, i);
+		positions[2 * i] = random_stream_double(&stream);
+		positions[2 * i + 1] = random_stream_double(&stream);
+	}
+
+	// Counting sort of the nodes by cell, which keeps them by increasing ID within every cell
+	for(lp_id_t i = 0; i < regions; i++)
+		offsets[geometric_cell(positions[2 * i + 1], grid.cells) * grid.cells +
+		    geometric_cell(positions[2 * i], grid.cells)]++;
+	prefix_sum(offsets, n_cells + 1);
+	for(lp_id_t i = 0; i < regions; i++)
+		nodes[offsets[geometric_cell(positions[2 * i + 1], grid.cells) * grid.cells +
+		    geometric_cell(positions[2 * i], grid.cells)]++] = i;
+	for(size_t c = n_cells; c > 0; c--)
+		offsets[c] = offsets[c - 1];
+	offsets[0] = 0;
+
+	parallel_for(regions > PARALLEL_MIN_WORK)
+	for(lp_id_t k = 0; k < regions; k++) {
+		sorted[2 * k] = positions[2 * nodes[k]];
+		sorted[2 * k + 1] = positions[2 * nodes[k] + 1];
+	}
+	grid.positions = sorted;
+	grid.nodes = nodes;
+	grid.offsets = offsets;
+
+	// Nodes are visited by cell, so that the cells around consecutive nodes are likely cached
+	parallel_for_dynamic(regions > PARALLEL_MIN_WORK)
+	for(lp_id_t k = 0; k < regions; k++)
+		rows[nodes[k]] = geometric_row(k, &grid, NULL, NULL, bits);
+	uint64_t total = prefix_sum(rows, regions + 1);
+
+	*keys = malloc((total + 1) * sizeof(**keys));
+	*probabilities = malloc((total + 1) * sizeof(**probabilities));
+	if(*keys == NULL || *probabilities == NULL) {
+		free(*keys);
+		free(*probabilities);
+		*keys = NULL;
+		*probabilities = NULL;
+		goto out;
+	}
+
+	parallel_for_dynamic(regions > PARALLEL_MIN_WORK)
+	for(lp_id_t k = 0; k < regions; k++)
+		geometric_row(k, &grid, *keys + rows[nodes[k]], *probabilities + rows[nodes[k]], bits);
+
+	*n = total;
+	ret = true;
+out:
+	free(nodes);
+	free(sorted);
+	free(offsets);
+	free(rows);
+	return ret;
+}
+
+
+/**
+ * @brief Draw the links of a node of a stochastic block model towards the nodes with higher IDs
+ * @param from the node whose links are drawn, in block order
+ * @param blocks the number of blocks
+ * @param starts the first node of every block, in block order, followed by the number of nodes
+ * @param log_miss the logarithm of the probability that two nodes are not linked, for every pair of blocks
+ * @param labels the ID of every node, indexed by its position in block order
+ * @param seed the seed of the graph
+ * @param keys where to store the links, in both directions, NULL to only count them
+ * @param bits the number of bits of the destination of a packed link
+ * @return the number of links drawn
+ */
+static uint64_t block_model_row(lp_id_t from, unsigned blocks, const lp_id_t *starts, const double *log_miss,
+    const lp_id_t *labels, uint64_t seed, uint64_t *keys, unsigned bits)
+{
+	struct topology_rng stream;
+	unsigned block = 0;
+	uint64_t ret = 0;
+
+	while(starts[block + 1] <= from)
+		block++;
+
+	random_stream_init(&stream, seed, from);
+	for(unsigned other = block; other < blocks; other++) {
+		lp_id_t to = other == block ? from : starts[other] - 1;
+		double miss = log_miss[block * blocks + other];
+		if(miss == 0)
+			continue;
+
+		while(true) {
+			double skip = floor(log1p(-random_stream_double(&stream)) / miss);
+			if(!(skip < (double)(starts[other + 1] - 1 - to)))
+				break;
+			to += (lp_id_t)skip + 1;
+			if(keys != NULL) {
+				keys[2 * ret] = (labels[from] << bits) | labels[to];
+				keys[2 * ret + 1] = (labels[to] << bits) | labels[from];
+			}
+			ret++;
+		}
+	}
+	return ret;
+}
+
+
+/**
+ * @brief Generate an undirected stochastic block model graph
+ *
+ * Nodes are split in blocks, and every two distinct nodes are linked with
+ * the probability given for their pair of blocks. Links are drawn as in
+ * generate_erdos_renyi(), one pair of blocks at a time, so that the cost is
+ * proportional to the number of nodes times the number of blocks plus the
+ * number of links. The nodes are then shuffled, so that IDs do not reveal
+ * the blocks.
+ *
+ * @param blocks the number of blocks
+ * @param sizes the number of nodes of every block
+ * @param probabilities the probability of a link for every pair of blocks, a symmetric row-major matrix
+ * @param seed the seed of the graph
+ * @param block where to store the block of every node, can be NULL
+ * @param keys where to store the newly allocated array of packed links, in both directions
+ * @param n where to store the number of links
+ * @return true on success, false if memory could not be allocated
+ */
+bool generate_block_model(unsigned blocks, const lp_id_t *sizes, const double *probabilities, uint64_t seed,
+    unsigned *block, uint64_t **keys, size_t *n)
+{
+	lp_id_t *starts = malloc((blocks + 1) * sizeof(*starts)), regions = 0;
+	double *log_miss = malloc((size_t)blocks * blocks * sizeof(*log_miss));
+	lp_id_t *labels = NULL;
+	uint64_t *offsets = NULL;
+	bool ret = false;
+
+	*keys = NULL;
+	if(starts == NULL || log_miss == NULL)
+		goto out;
+
+	for(unsigned b = 0; b < blocks; b++) {
+		starts[b] = regions;
+		regions += sizes[b];
+	}
+	starts[blocks] = regions;
+	for(size_t i = 0; i < (size_t)blocks * blocks; i++)
+		log_miss[i] = log1p(-probabilities[i]);
+
+	unsigned bits = bits_needed(regions - 1);
+	labels = malloc(regions * sizeof(*labels));
+	offsets = calloc(regions + 1, sizeof(*offsets));
+	if(labels == NULL || offsets == NULL)
+		goto out;
+
+	// Fisher-Yates shuffle, drawn from a stream no row uses
+	struct topology_rng stream;
+	random_stream_init(&stream, seed, regions);
+	for(lp_id_t i = 0; i < regions; i++)
+		labels[i] = i;
+	for(lp_id_t i = regions - 1; i > 0; i--) {
+		lp_id_t j = random_range(random_stream_u64(&stream), i + 1), swap = labels[i];
+		labels[i] = labels[j];
+		labels[j] = swap;
+	}
+	if(block != NULL) {
+		for(unsigned b = 0; b < blocks; b++)
+			for(lp_id_t i = starts[b]; i < starts[b + 1]; i++)
+				block[labels[i]] = b;
+	}
+
+	parallel_for_dynamic(regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < regions; i++)
+		offsets[i] = block_model_row(i, blocks, starts, log_miss, labels, seed, NULL, bits);
+	uint64_t total = prefix_sum(offsets, regions + 1);
+
+	*keys = malloc((2 * total + 1) * sizeof(**keys));
+	if(*keys == NULL)
+		goto out;
+
+	parallel_for_dynamic(regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < regions; i++)
+		block_model_row(i, blocks, starts, log_miss, labels, seed, *keys + 2 * offsets[i], bits);
+
+	*n = 2 * total;
+	ret = true;
+out:
+	free(starts);
+	free(log_miss);
+	free(labels);
+	free(offsets);
+	return ret;
+}
@@ -0,0 +1,30 @@
+/**
+ * @file src/generators.h
+ *
+ * @brief Random graph generators
+ *
+ * Generators of synthetic graphs which produce the links directly in the
+ * packed form graph_build() takes. Every generator is deterministic given
+ * its seed, regardless of the number of threads it runs on.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ROOT-Sim/topology.h>
+
+extern bool generate_erdos_renyi(lp_id_t regions, double probability, uint64_t seed, uint64_t **keys, size_t *n);
+extern bool generate_barabasi_albert(lp_id_t regions, unsigned links, uint64_t seed, uint64_t **keys, size_t *n);
+extern bool generate_watts_strogatz(lp_id_t regions, unsigned neighbors, double rewiring, uint64_t seed,
+    uint64_t **keys, size_t *n);
+extern bool generate_rmat(unsigned scale, uint64_t links, double a, double b, double c, uint64_t seed, uint64_t **keys,
+    size_t *n);
+extern bool generate_geometric(lp_id_t regions, double radius, bool torus, uint64_t seed, double *positions,
+    uint64_t **keys, uint64_t **probabilities, size_t *n);
+extern bool generate_block_model(unsigned blocks, const lp_id_t *sizes, const double *probabilities, uint64_t seed,
+    unsigned *block, uint64_t **keys, size_t *n);
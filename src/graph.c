@@ -0,0 +1,2335 @@
+/**
+ * @file src/graph.c
+ *
+ * @brief Graph storage
+ *
+ * The storage backing TOPOLOGY_GRAPH topologies.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arena.h>
+#include <graph.h>
+#include <likely.h>
+#include <parallel.h>
+#include <sort.h>
+#include <storage.h>
+
+/// The number of edges a staging row can keep when it is first allocated
+#define ROW_INITIAL_CAPACITY 4
+/// Marks the end of the work lists used to build alias tables
+#define ALIAS_NONE UINT32_MAX
+/// The minimum number of out-edges for a node to have its edges indexed by neighbor
+#define INDEX_MIN_DEGREE 32
+/// Marks an empty slot in an edge index
+#define INDEX_EMPTY UINT32_MAX
+/// The fixed-point value of the whole cumulative share of the out-edges of a node
+#define THRESHOLD_ONE 65535
+/// Dead slots are reclaimed once they are more than one in this many slots of the CSR arrays
+#define REMOVED_MAX_SHARE 4
+/// Spread transposed CSR ranges get one free slot, plus one for every this many in-edges
+#define IN_SLACK_SHARE 8
+/// The farthest node a free slot of the transposed CSR is borrowed from
+#define IN_BORROW_NODES 32
+/// The most in-edges moved to borrow a free slot of the transposed CSR from another node
+#define IN_BORROW_EDGES 1024
+
+
+/**
+ * @brief Compute the home slot of a neighbor in an edge index
+ * @param to the neighbor to look up
+ * @param mask the number of slots in the index minus one
+ * @return the first slot to probe
+ */
+static inline uint64_t index_hash(lp_id_t to, uint64_t mask)
+{
+	uint64_t h = to * UINT64_C(0x9e3779b97f4a7c15);
+	return (h ^ (h >> 32)) & mask;
+}
+
+
+/**
+ * @brief Look up an edge in an edge index
+ *
+ * An edge index is an open-addressing hash set with linear probing, which
+ * keeps the positions of the edges in the neighbors array.
+ *
+ * @param slots the slots of the index
+ * @param mask the number of slots in the index minus one
+ * @param edges the view over the edges the index refers to
+ * @param to the neighbor to look up
+ * @return the position of the edge towards @p to, INVALID_EDGE if there is none
+ */
+static size_t index_find(const uint32_t *slots, uint64_t mask, const struct graph_edges *edges, lp_id_t to)
+{
+	for(uint64_t h = index_hash(to, mask);; h = (h + 1) & mask) {
+		uint32_t edge = slots[h];
+		if(edge == INDEX_EMPTY)
+			return INVALID_EDGE;
+		if(graph_neighbor(edges, edge) == to)
+			return edge;
+	}
+}
+
+
+/**
+ * @brief Insert an edge in an edge index
+ * @param slots the slots of the index
+ * @param mask the number of slots in the index minus one
+ * @param to the neighbor of the edge
+ * @param edge the position of the edge in the neighbors array
+ */
+static void index_insert(uint32_t *slots, uint64_t mask, lp_id_t to, uint32_t edge)
+{
+	uint64_t h = index_hash(to, mask);
+	while(slots[h] != INDEX_EMPTY)
+		h = (h + 1) & mask;
+	slots[h] = edge;
+}
+
+
+/**
+ * @brief Fill an edge index
+ * @param slots the slots of the index
+ * @param size the number of slots in the index, a power of two
+ * @param edges the view over the edges to index
+ */
+static void index_build(uint32_t *slots, uint64_t size, const struct graph_edges *edges)
+{
+	memset(slots, 0xff, size * sizeof(*slots));
+	for(uint32_t i = 0; i < edges->size; i++)
+		index_insert(slots, size - 1, graph_neighbor(edges, i), i);
+}
+
+
+/**
+ * @brief Compute the number of slots of the edge index of a node
+ *
+ * Slots are at least twice the number of edges, so that probe sequences stay short.
+ *
+ * @param degree the number of out-edges of the node
+ * @return the number of slots, 0 if the node is not worth indexing
+ */
+static uint64_t index_size(uint64_t degree)
+{
+	uint64_t size = 1;
+
+	if(degree < INDEX_MIN_DEGREE)
+		return 0;
+	while(size < 2 * degree)
+		size <<= 1;
+	return size;
+}
+
+
+/**
+ * @brief Allocate an empty graph
+ *
+ * The headers of the staging rows are allocated as a single zeroed array, so
+ * that the memory of the rows which never get an edge is never touched. The
+ * arrays of the rows are carved out of the graph arena as edges are added.
+ *
+ * @param regions the number of nodes in the graph
+ * @return a pointer to the new graph, NULL if memory could not be allocated
+ */
+struct graph *graph_new(lp_id_t regions)
+{
+	struct graph *graph = calloc(1, sizeof(*graph));
+	if(graph == NULL)
+		return NULL;
+
+	graph->regions = regions;
+	graph->sampling = SAMPLING_ALIAS;
+	graph->rows = calloc(regions, sizeof(*graph->rows));
+	if(graph->rows == NULL) {
+		free(graph);
+		return NULL;
+	}
+	return graph;
+}
+
+
+/**
+ * @brief Release the memory held by the staging rows of a graph
+ * @param graph the graph whose rows should be released
+ */
+static void release_rows(struct graph *graph)
+{
+	arena_release(&graph->arena);
+	free(graph->rows);
+	graph->rows = NULL;
+}
+
+
+/**
+ * @brief Release a graph and all the memory used to represent it
+ * @param graph the graph to release
+ */
+void graph_release(struct graph *graph)
+{
+	if(graph->rows != NULL)
+		release_rows(graph);
+
+	if(graph_is_mapped(graph)) {
+		storage_unmap(graph->mapping, graph->mapping_size);
+		free(graph);
+		return;
+	}
+
+	free(graph->offsets);
+	free(graph->neighbors);
+	free(graph->neighbors_compact);
+	free(graph->probabilities);
+	free(graph->probabilities_float);
+	free(graph->thresholds);
+	free(graph->totals);
+	free(graph->data);
+	free(graph->alias_probabilities);
+	free(graph->alias_indices);
+	free(graph->cumulative);
+	free(graph->in_offsets);
+	free(graph->in_sources);
+	free(graph->in_sources_compact);
+	free(graph->index_offsets);
+	free(graph->index_slots);
+	free(graph->removed);
+	free(graph->in_removed);
+	for(unsigned a = 0; a < graph->attributes; a++)
+		free(graph->attribute_columns[a]);
+	free(graph->attribute_columns);
+	free(graph->attribute_sizes);
+	free(graph);
+}
+
+
+/**
+ * @brief Build the edge indexes of the high-degree nodes of a finalized graph
+ *
+ * Low-degree nodes are scanned linearly, so no index is built for them. If
+ * memory cannot be allocated, all nodes are scanned linearly.
+ *
+ * @param graph the graph whose edges should be indexed
+ */
+static void build_edge_indexes(struct graph *graph)
+{
+	graph->index_offsets = malloc((graph->regions + 1) * sizeof(*graph->index_offsets));
+	if(graph->index_offsets == NULL)
+		return;
+
+	parallel_for(graph->regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < graph->regions; i++)
+		graph->index_offsets[i] = index_size(graph_out_degree(graph, i));
+	graph->index_offsets[graph->regions] = 0;
+
+	uint64_t slots = prefix_sum(graph->index_offsets, graph->regions + 1);
+	if(slots != 0)
+		graph->index_slots = malloc(slots * sizeof(*graph->index_slots));
+	if(graph->index_slots == NULL) {
+		free(graph->index_offsets);
+		graph->index_offsets = NULL;
+		return;
+	}
+
+	parallel_for_dynamic(graph->regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < graph->regions; i++) {
+		uint64_t size = graph->index_offsets[i + 1] - graph->index_offsets[i];
+		if(size) {
+			struct graph_edges edges = graph_out_edges(graph, i);
+			index_build(graph->index_slots + graph->index_offsets[i], size, &edges);
+		}
+	}
+}
+
+
+/**
+ * @brief Release the CSR arrays of a graph
+ * @param graph the graph whose CSR arrays should be released
+ */
+static void free_csr(struct graph *graph)
+{
+	free(graph->offsets);
+	free(graph->neighbors);
+	free(graph->neighbors_compact);
+	free(graph->probabilities);
+	free(graph->data);
+	free(graph->in_offsets);
+	free(graph->in_sources);
+	free(graph->in_sources_compact);
+	for(unsigned a = 0; a < graph->attributes; a++) {
+		free(graph->attribute_columns[a]);
+		graph->attribute_columns[a] = NULL;
+	}
+	graph->offsets = NULL;
+	graph->neighbors = NULL;
+	graph->neighbors_compact = NULL;
+	graph->probabilities = NULL;
+	graph->data = NULL;
+	graph->in_offsets = NULL;
+	graph->in_sources = NULL;
+	graph->in_sources_compact = NULL;
+}
+
+
+/**
+ * @brief Allocate the CSR arrays of a graph
+ *
+ * The attribute columns are allocated too, and zero-filled. Node IDs get
+ * either the compact or the full-width arrays, see graph_has_compact_ids().
+ *
+ * @param graph the graph whose CSR arrays should be allocated
+ * @param edges the number of edges in the graph
+ * @param has_data true if the per-edge data array is needed
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case no array is allocated.
+ */
+static bool alloc_csr(struct graph *graph, uint64_t edges, bool has_data)
+{
+	bool compact = graph_has_compact_ids(graph);
+	size_t id_size = compact ? sizeof(uint32_t) : sizeof(lp_id_t);
+	void *neighbors = malloc(edges * id_size);
+	void *in_sources = malloc(edges * id_size);
+
+	if(compact) {
+		graph->neighbors_compact = neighbors;
+		graph->in_sources_compact = in_sources;
+	} else {
+		graph->neighbors = neighbors;
+		graph->in_sources = in_sources;
+	}
+	graph->offsets = malloc((graph->regions + 1) * sizeof(*graph->offsets));
+	graph->probabilities = malloc(edges * sizeof(*graph->probabilities));
+	graph->data = has_data ? calloc(edges, sizeof(*graph->data)) : NULL;
+	graph->in_offsets = malloc((graph->regions + 1) * sizeof(*graph->in_offsets));
+	if(graph->offsets == NULL || graph->in_offsets == NULL ||
+	    (edges && (neighbors == NULL || graph->probabilities == NULL || in_sources == NULL)) ||
+	    (has_data && edges && graph->data == NULL)) {
+		free_csr(graph);
+		return false;
+	}
+
+	for(unsigned a = 0; a < graph->attributes; a++) {
+		graph->attribute_columns[a] = calloc(edges, graph->attribute_sizes[a]);
+		if(edges && graph->attribute_columns[a] == NULL) {
+			free_csr(graph);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/**
+ * @brief Compute the CSR offsets of a sorted array of packed edges
+ *
+ * Every position where the row changes fills in the offsets of the rows
+ * starting there, so positions can be processed in parallel.
+ *
+ * @param offsets the offsets to fill, with room for one more element than there are rows
+ * @param rows the number of rows
+ * @param keys the edges, packed as (row << bits) | column and sorted
+ * @param n the number of edges
+ * @param bits the number of bits of the column in the packed edges
+ */
+static void offsets_from_sorted(uint64_t *offsets, lp_id_t rows, const uint64_t *keys, size_t n, unsigned bits)
+{
+	parallel_for(n > PARALLEL_MIN_WORK)
+	for(size_t i = 0; i <= n; i++) {
+		uint64_t first = i == 0 ? 0 : (keys[i - 1] >> bits) + 1;
+		uint64_t last = i == n ? rows : keys[i] >> bits;
+		for(uint64_t r = first; r <= last; r++)
+			offsets[r] = i;
+	}
+}
+
+
+/**
+ * @brief Compute the fixed-point cumulative thresholds of the out-edges of a node
+ *
+ * The threshold of the last edge is always THRESHOLD_ONE, so that a random
+ * draw in [0, THRESHOLD_ONE) always selects an edge. If all probabilities
+ * are zero, the thresholds are evenly spaced.
+ *
+ * @param thresholds the thresholds to fill
+ * @param probabilities the probabilities of the out-edges
+ * @param size the number of out-edges
+ * @return the sum of the probabilities
+ */
+static double encode_thresholds(uint16_t *thresholds, const double *probabilities, uint64_t size)
+{
+	double total = 0.0, cumulative = 0.0;
+
+	for(uint64_t i = 0; i < size; i++)
+		total += probabilities[i];
+
+	for(uint64_t i = 0; i < size; i++) {
+		cumulative += probabilities[i];
+		double share = total > 0.0 ? cumulative / total : (double)(i + 1) / (double)size;
+		thresholds[i] = (uint16_t)(share >= 1.0 ? THRESHOLD_ONE : share * THRESHOLD_ONE + 0.5);
+	}
+	if(size)
+		thresholds[size - 1] = THRESHOLD_ONE;
+	return total;
+}
+
+
+/**
+ * @brief Convert the probabilities of a finalized graph to the storage format of its precision
+ *
+ * The probabilities must be stored as doubles when this function is called.
+ *
+ * @param graph the graph to convert
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the probabilities are kept as doubles, and the precision of the
+ * graph is reset to PRECISION_DOUBLE.
+ */
+static bool compact_probabilities(struct graph *graph)
+{
+	uint64_t edges = graph->offsets[graph->regions];
+
+	switch(graph->precision) {
+		case PRECISION_FLOAT:
+			graph->probabilities_float = malloc(edges * sizeof(*graph->probabilities_float));
+			if(edges && graph->probabilities_float == NULL)
+				break;
+			parallel_for(edges > PARALLEL_MIN_WORK)
+			for(uint64_t i = 0; i < edges; i++)
+				graph->probabilities_float[i] = (float)graph->probabilities[i];
+			free(graph->probabilities);
+			graph->probabilities = NULL;
+			return true;
+
+		case PRECISION_FIXED16:
+			graph->thresholds = malloc(edges * sizeof(*graph->thresholds));
+			graph->totals = malloc(graph->regions * sizeof(*graph->totals));
+			if((edges && graph->thresholds == NULL) || graph->totals == NULL) {
+				free(graph->thresholds);
+				free(graph->totals);
+				graph->thresholds = NULL;
+				graph->totals = NULL;
+				break;
+			}
+			parallel_for_dynamic(graph->regions > PARALLEL_MIN_WORK)
+			for(lp_id_t i = 0; i < graph->regions; i++) {
+				uint64_t first = graph->offsets[i];
+				graph->totals[i] = (float)encode_thresholds(graph->thresholds + first,
+				    graph->probabilities + first, graph_out_degree(graph, i));
+			}
+			free(graph->probabilities);
+			graph->probabilities = NULL;
+			return true;
+
+		default:
+			return true;
+	}
+
+	graph->precision = PRECISION_DOUBLE;
+	return false;
+}
+
+
+/**
+ * @brief Convert the probabilities of a finalized graph back to doubles
+ * @param graph the graph to convert
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the graph is left untouched.
+ */
+static bool expand_probabilities(struct graph *graph)
+{
+	uint64_t edges = graph->offsets[graph->regions];
+
+	if(graph->precision == PRECISION_DOUBLE)
+		return true;
+
+	double *probabilities = malloc(edges * sizeof(*probabilities));
+	if(edges && probabilities == NULL)
+		return false;
+
+	parallel_for_dynamic(graph->regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < graph->regions; i++) {
+		uint64_t first = graph->offsets[i];
+		for(uint64_t j = 0; j < graph_out_degree(graph, i); j++)
+			probabilities[first + j] = graph_get_probability(graph, i, j);
+	}
+
+	free(graph->probabilities_float);
+	free(graph->thresholds);
+	free(graph->totals);
+	graph->probabilities_float = NULL;
+	graph->thresholds = NULL;
+	graph->totals = NULL;
+	graph->probabilities = probabilities;
+	graph->precision = PRECISION_DOUBLE;
+	return true;
+}
+
+
+/**
+ * @brief Build the structures derived from the CSR arrays of a graph
+ *
+ * The probabilities, which are packed as doubles, are first converted to the
+ * precision of the graph. Then the edge indexes of high-degree nodes and, if
+ * the graph samples through them, the alias tables or the cumulative
+ * distributions are built. These only speed up queries: if they cannot be
+ * allocated, queries fall back to linear scans.
+ *
+ * @param graph the finalized graph to index
+ */
+static void index_csr(struct graph *graph)
+{
+	compact_probabilities(graph);
+	build_edge_indexes(graph);
+	if(graph->sampling != SAMPLING_LINEAR)
+		graph_build_sampling(graph);
+}
+
+
+/**
+ * @brief Move a range of elements within an array
+ * @param array the array, may be NULL in which case nothing is done
+ * @param size the size of the elements of the array
+ * @param dst the position the range is moved to
+ * @param src the position of the first element of the range
+ * @param n the number of elements in the range
+ */
+static void move_range(void *array, size_t size, uint64_t dst, uint64_t src, uint64_t n)
+{
+	if(array != NULL && n != 0)
+		memmove((unsigned char *)array + dst * size, (unsigned char *)array + src * size, n * size);
+}
+
+
+/**
+ * @brief Move a range of edges within the CSR arrays of a graph
+ * @param graph the finalized graph whose edges are moved
+ * @param dst the CSR position the edges are moved to
+ * @param src the CSR position of the first edge to move
+ * @param n the number of edges to move
+ */
+static void move_edges(struct graph *graph, uint64_t dst, uint64_t src, uint64_t n)
+{
+	move_range(graph->neighbors, sizeof(*graph->neighbors), dst, src, n);
+	move_range(graph->neighbors_compact, sizeof(*graph->neighbors_compact), dst, src, n);
+	move_range(graph->probabilities, sizeof(*graph->probabilities), dst, src, n);
+	move_range(graph->probabilities_float, sizeof(*graph->probabilities_float), dst, src, n);
+	move_range(graph->thresholds, sizeof(*graph->thresholds), dst, src, n);
+	move_range(graph->data, sizeof(*graph->data), dst, src, n);
+	move_range(graph->alias_probabilities, sizeof(*graph->alias_probabilities), dst, src, n);
+	move_range(graph->alias_indices, sizeof(*graph->alias_indices), dst, src, n);
+	move_range(graph->cumulative, sizeof(*graph->cumulative), dst, src, n);
+	for(unsigned a = 0; a < graph->attributes; a++)
+		move_range(graph->attribute_columns[a], graph->attribute_sizes[a], dst, src, n);
+}
+
+
+/**
+ * @brief Shrink an array, keeping it as it is if it cannot be reallocated
+ * @param array the array to shrink, may be NULL
+ * @param size the new size of the array in bytes
+ * @return the shrunk array
+ */
+static void *shrink(void *array, size_t size)
+{
+	if(array == NULL || size == 0)
+		return array;
+	void *ret = realloc(array, size);
+	return ret != NULL ? ret : array;
+}
+
+
+/**
+ * @brief Rebuild the transposed CSR of a finalized graph from its out-edges
+ *
+ * The sources of every node are laid out in increasing order, because the
+ * out-edges are scanned in node order. Without slack the ranges are dense,
+ * and this needs no memory, since there are never more in-edges than the
+ * transposed CSR has room for. With slack, every range ends with free slots,
+ * see spread_in_edges().
+ *
+ * @param graph the graph whose transposed CSR should be rebuilt
+ * @param slack true to leave free slots at the end of every range, in which
+ * case the in_removed array must be allocated
+ */
+static void rebuild_in_edges(struct graph *graph, bool slack)
+{
+	lp_id_t regions = graph->regions;
+	uint32_t *free_slots = graph->in_removed;
+
+	assert(graph_is_finalized(graph));
+	assert(!slack || free_slots != NULL);
+
+	memset(graph->in_offsets, 0, (regions + 1) * sizeof(*graph->in_offsets));
+	for(lp_id_t i = 0; i < regions; i++) {
+		struct graph_edges edges = graph_out_edges(graph, i);
+		for(size_t j = 0; j < edges.size; j++)
+			graph->in_offsets[graph_neighbor(&edges, j)]++;
+	}
+	if(slack)
+		for(lp_id_t i = 0; i < regions; i++) {
+			free_slots[i] = 1 + (uint32_t)(graph->in_offsets[i] / IN_SLACK_SHARE);
+			graph->in_offsets[i] += free_slots[i];
+		}
+	prefix_sum(graph->in_offsets, regions + 1);
+
+	// Each offset is used as the cursor of its node, and ends up past the last in-edge of the node
+	for(lp_id_t i = 0; i < regions; i++) {
+		struct graph_edges edges = graph_out_edges(graph, i);
+		for(size_t j = 0; j < edges.size; j++) {
+			uint64_t position = graph->in_offsets[graph_neighbor(&edges, j)]++;
+			if(graph->in_sources_compact != NULL)
+				graph->in_sources_compact[position] = (uint32_t)i;
+			else
+				graph->in_sources[position] = i;
+		}
+	}
+	for(lp_id_t i = regions; i > 0; i--)
+		graph->in_offsets[i] = graph->in_offsets[i - 1] + (slack ? free_slots[i - 1] : 0);
+	graph->in_offsets[0] = 0;
+	if(!slack) {
+		free(graph->in_removed);
+		graph->in_removed = NULL;
+	}
+}
+
+
+/**
+ * @brief Rebuild the transposed CSR of a finalized graph leaving free slots in every range
+ *
+ * Every node gets a share of free slots proportional to its in-degree, so
+ * that adding in-edges seldom needs to borrow slots from other nodes, and
+ * the transposed CSR grows by a constant share of its live in-edges.
+ *
+ * @param graph the graph to update
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the graph is left untouched.
+ */
+static bool spread_in_edges(struct graph *graph)
+{
+	uint64_t edges = graph->offsets[graph->regions] - graph->removed_edges;
+	uint64_t size = edges + graph->regions + edges / IN_SLACK_SHARE;
+
+	if(graph->in_removed == NULL) {
+		graph->in_removed = calloc(graph->regions, sizeof(*graph->in_removed));
+		if(graph->in_removed == NULL)
+			return false;
+	}
+	if(graph_has_compact_ids(graph)) {
+		uint32_t *in_sources = realloc(graph->in_sources_compact, size * sizeof(*in_sources));
+		if(in_sources == NULL)
+			return false;
+		graph->in_sources_compact = in_sources;
+	} else {
+		lp_id_t *in_sources = realloc(graph->in_sources, size * sizeof(*in_sources));
+		if(in_sources == NULL)
+			return false;
+		graph->in_sources = in_sources;
+	}
+	rebuild_in_edges(graph, true);
+	return true;
+}
+
+
+/**
+ * @brief Get the source of an in-edge of a finalized graph
+ * @param graph the graph to inspect
+ * @param position the position of the in-edge in the transposed CSR
+ * @return the source of the in-edge
+ */
+static lp_id_t in_source(const struct graph *graph, uint64_t position)
+{
+	return graph->in_sources_compact != NULL ? graph->in_sources_compact[position] : graph->in_sources[position];
+}
+
+
+/**
+ * @brief Move a range of in-edges within the transposed CSR of a graph
+ * @param graph the finalized graph whose in-edges are moved
+ * @param dst the position the in-edges are moved to
+ * @param src the position of the first in-edge to move
+ * @param n the number of in-edges to move
+ */
+static void move_in_edges(struct graph *graph, uint64_t dst, uint64_t src, uint64_t n)
+{
+	move_range(graph->in_sources, sizeof(*graph->in_sources), dst, src, n);
+	move_range(graph->in_sources_compact, sizeof(*graph->in_sources_compact), dst, src, n);
+}
+
+
+/**
+ * @brief Find where a source belongs among the sorted in-edges of a node of a finalized graph
+ * @param graph the graph to inspect
+ * @param to the node whose in-edges are searched
+ * @param from the source to look for
+ * @return the index of the first in-edge of @p to whose source is not smaller than @p from
+ */
+static size_t find_in_edge(const struct graph *graph, lp_id_t to, lp_id_t from)
+{
+	uint64_t first = graph->in_offsets[to];
+	size_t low = 0, high = graph_in_degree(graph, to);
+
+	while(low < high) {
+		size_t mid = low + (high - low) / 2;
+		if(in_source(graph, first + mid) < from)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return low;
+}
+
+
+/**
+ * @brief Give a node of a finalized graph a free slot in the transposed CSR
+ *
+ * The free slot closest to the node is taken from another node, by moving
+ * the in-edges in between by one position. Only nearby nodes are looked at,
+ * so that the cost is bounded by IN_BORROW_NODES and IN_BORROW_EDGES.
+ *
+ * @param graph the graph to update
+ * @param to the node which needs a free slot, and has none
+ * @return true on success, false if no nearby node has a free slot. In the
+ * latter case the graph is left untouched.
+ */
+static bool borrow_in_slot(struct graph *graph, lp_id_t to)
+{
+	uint64_t *offsets = graph->in_offsets;
+	uint32_t *free_slots = graph->in_removed;
+	bool up = true, down = true;
+
+	for(lp_id_t d = 1; d <= IN_BORROW_NODES && (up || down); d++) {
+		up = up && to + d < graph->regions;
+		if(up) {
+			// The slot at the end of to + d is moved to the end of to
+			lp_id_t j = to + d;
+			uint64_t start = offsets[to + 1], moved = offsets[j + 1] - free_slots[j] - start;
+			up = moved <= IN_BORROW_EDGES;
+			if(up && free_slots[j] != 0) {
+				move_in_edges(graph, start + 1, start, moved);
+				for(lp_id_t k = to + 1; k <= j; k++)
+					offsets[k]++;
+				free_slots[j]--;
+				free_slots[to]++;
+				return true;
+			}
+		}
+		down = down && to >= d;
+		if(down) {
+			// The slot at the end of to - d is moved to the end of to
+			lp_id_t i = to - d;
+			uint64_t start = offsets[i + 1], moved = offsets[to + 1] - start;
+			down = moved <= IN_BORROW_EDGES;
+			if(down && free_slots[i] != 0) {
+				move_in_edges(graph, start - 1, start, moved);
+				for(lp_id_t k = i + 1; k <= to; k++)
+					offsets[k]--;
+				free_slots[i]--;
+				free_slots[to]++;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+/**
+ * @brief Remove an in-edge from the transposed CSR of a finalized graph
+ *
+ * The following sources are moved down by one, so their order is preserved,
+ * and a free slot is left at the end of the range of the node.
+ *
+ * @param graph the graph to update, whose in_removed array must be allocated
+ * @param to the destination of the edge
+ * @param from the source of the edge
+ */
+static void remove_csr_in_edge(struct graph *graph, lp_id_t to, lp_id_t from)
+{
+	uint64_t first = graph->in_offsets[to];
+	size_t size = graph_in_degree(graph, to), i = find_in_edge(graph, to, from);
+
+	assert(i < size && in_source(graph, first + i) == from);
+	move_in_edges(graph, first + i, first + i + 1, size - i - 1);
+	graph->in_removed[to]++;
+}
+
+
+/**
+ * @brief Add an in-edge to the transposed CSR of a finalized graph, keeping the sources sorted
+ *
+ * If neither the node nor the nodes close to it have a free slot left, the
+ * whole transposed CSR is spread out again, see spread_in_edges(). The free
+ * slots it leaves are a constant share of the in-edges, so this happens
+ * seldom enough to be paid for by the insertions in between.
+ *
+ * @param graph the graph to update, whose in_removed array must be allocated
+ * @param to the destination of the edge
+ * @param from the source of the edge
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the graph is left untouched.
+ */
+static bool insert_csr_in_edge(struct graph *graph, lp_id_t to, lp_id_t from)
+{
+	if(graph->in_removed[to] == 0 && !borrow_in_slot(graph, to) && unlikely(!spread_in_edges(graph)))
+		return false;
+
+	uint64_t first = graph->in_offsets[to];
+	size_t size = graph_in_degree(graph, to), i = find_in_edge(graph, to, from);
+
+	move_in_edges(graph, first + i + 1, first + i, size - i);
+	if(graph->in_sources_compact != NULL)
+		graph->in_sources_compact[first + i] = (uint32_t)from;
+	else
+		graph->in_sources[first + i] = from;
+	graph->in_removed[to]--;
+	return true;
+}
+
+
+/**
+ * @brief Reclaim the dead slots left in the CSR arrays by removed edges
+ *
+ * The live edges of every node are moved down, keeping their order, and the
+ * arrays are then shrunk. Edge indexes and sampling tables refer to the edges
+ * of a node by their position within the node, so they are moved along with
+ * the edges and stay valid. The transposed CSR is rebuilt densely, dropping
+ * its free slots too.
+ *
+ * @param graph the finalized graph to compact
+ */
+static void compact_csr(struct graph *graph)
+{
+	uint64_t position = 0;
+
+	for(lp_id_t i = 0; i < graph->regions; i++) {
+		uint64_t first = graph->offsets[i];
+		uint64_t size = graph_out_degree(graph, i);
+
+		graph->offsets[i] = position;
+		if(first != position)
+			move_edges(graph, position, first, size);
+		position += size;
+	}
+	graph->offsets[graph->regions] = position;
+	free(graph->removed);
+	graph->removed = NULL;
+	graph->removed_edges = 0;
+
+	graph->neighbors = shrink(graph->neighbors, position * sizeof(*graph->neighbors));
+	graph->neighbors_compact = shrink(graph->neighbors_compact, position * sizeof(*graph->neighbors_compact));
+	graph->probabilities = shrink(graph->probabilities, position * sizeof(*graph->probabilities));
+	graph->probabilities_float = shrink(graph->probabilities_float, position * sizeof(*graph->probabilities_float));
+	graph->thresholds = shrink(graph->thresholds, position * sizeof(*graph->thresholds));
+	graph->data = shrink(graph->data, position * sizeof(*graph->data));
+	graph->alias_probabilities = shrink(graph->alias_probabilities, position * sizeof(*graph->alias_probabilities));
+	graph->alias_indices = shrink(graph->alias_indices, position * sizeof(*graph->alias_indices));
+	graph->cumulative = shrink(graph->cumulative, position * sizeof(*graph->cumulative));
+	for(unsigned a = 0; a < graph->attributes; a++)
+		graph->attribute_columns[a] = shrink(graph->attribute_columns[a], position * graph->attribute_sizes[a]);
+
+	// There are never more in-edges than live out-edges
+	graph->in_sources = shrink(graph->in_sources, position * sizeof(*graph->in_sources));
+	graph->in_sources_compact = shrink(graph->in_sources_compact, position * sizeof(*graph->in_sources_compact));
+	rebuild_in_edges(graph, false);
+}
+
+
+/**
+ * @brief Compare two node IDs, for qsort()
+ */
+static int compare_ids(const void *a, const void *b)
+{
+	lp_id_t x = *(const lp_id_t *)a, y = *(const lp_id_t *)b;
+	return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Pack the staging rows of a graph into its CSR representation
+ *
+ * After this function returns successfully, the staging rows are released and
+ * every query is served by the contiguous CSR arrays. The per-edge data array
+ * is allocated only if some edge has user data attached. The offsets of the
+ * rows are computed with a prefix sum over their sizes, so that every row can
+ * then be copied independently.
+ *
+ * Finalizing a graph again reclaims the slots left by removed edges and the
+ * free slots of its transposed CSR, if any.
+ *
+ * @param graph the graph to finalize
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the graph is left untouched.
+ */
+bool graph_finalize(struct graph *graph)
+{
+	uint64_t edges = 0;
+	bool has_data = false;
+
+	if(graph_is_finalized(graph)) {
+		if(graph->removed_edges != 0 || graph->in_removed != NULL)
+			compact_csr(graph);
+		return true;
+	}
+
+	for(lp_id_t i = 0; i < graph->regions; i++) {
+		edges += graph->rows[i].size;
+		has_data |= graph->rows[i].data != NULL;
+	}
+
+	if(!alloc_csr(graph, edges, has_data))
+		return false;
+
+	parallel_for(graph->regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < graph->regions; i++) {
+		graph->offsets[i] = graph->rows[i].size;
+		graph->in_offsets[i] = graph->rows[i].sources_size;
+	}
+	graph->offsets[graph->regions] = 0;
+	graph->in_offsets[graph->regions] = 0;
+	prefix_sum(graph->offsets, graph->regions + 1);
+	prefix_sum(graph->in_offsets, graph->regions + 1);
+
+	parallel_for_dynamic(graph->regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < graph->regions; i++) {
+		const struct graph_row *row = &graph->rows[i];
+		uint64_t pos = graph->offsets[i];
+
+		if(row->size != 0) {
+			if(graph->neighbors_compact != NULL)
+				for(uint32_t j = 0; j < row->size; j++)
+					graph->neighbors_compact[pos + j] = (uint32_t)row->neighbors[j];
+			else
+				memcpy(graph->neighbors + pos, row->neighbors, row->size * sizeof(*row->neighbors));
+			memcpy(graph->probabilities + pos, row->probabilities, row->size * sizeof(*row->probabilities));
+			if(row->data != NULL)
+				memcpy(graph->data + pos, row->data, row->size * sizeof(*row->data));
+			for(uint32_t a = 0; a < row->attributes_size; a++)
+				if(row->attributes[a] != NULL)
+					memcpy(graph->attribute_columns[a] + pos * graph->attribute_sizes[a], row->attributes[a],
+					    row->size * graph->attribute_sizes[a]);
+		}
+		if(row->sources_size != 0) {
+			uint64_t in_pos = graph->in_offsets[i];
+			if(graph->in_sources_compact != NULL)
+				for(uint32_t j = 0; j < row->sources_size; j++)
+					graph->in_sources_compact[in_pos + j] = (uint32_t)row->sources[j];
+			else
+				memcpy(graph->in_sources + in_pos, row->sources, row->sources_size * sizeof(*row->sources));
+		}
+	}
+
+	release_rows(graph);
+	index_csr(graph);
+	return true;
+}
+
+
+/**
+ * @brief Build the CSR representation of an empty graph from a batch of edges
+ *
+ * This produces the same graph as adding the batch with graph_add_edges() and
+ * then calling graph_finalize(), but builds the CSR arrays directly from the
+ * sorted batch: every phase is either a parallel radix sort, a prefix sum,
+ * or an independent per-edge or per-node loop.
+ *
+ * @param graph the graph to build, which must have no edges and not be finalized
+ * @param n the number of edges in the batch
+ * @param keys the edges, packed as (from << bits_needed(regions - 1)) | to. The array
+ * is clobbered.
+ * @param probabilities the bit patterns of the probabilities of the edges.
+ * The array is clobbered.
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the graph is left untouched.
+ */
+bool graph_build(struct graph *graph, size_t n, uint64_t *keys, uint64_t *probabilities)
+{
+	unsigned bits = bits_needed(graph->regions - 1);
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	size_t unique = 0;
+
+	assert(!graph_is_finalized(graph));
+
+	if(!radix_sort(keys, probabilities, n, 2 * bits))
+		return false;
+
+	// Only keep the last occurrence of each edge, which the stable sort has placed last
+	for(size_t i = 0; i < n; i++) {
+		if(i + 1 < n && keys[i + 1] == keys[i])
+			continue;
+		keys[unique] = keys[i];
+		probabilities[unique] = probabilities[i];
+		unique++;
+	}
+
+	if(!alloc_csr(graph, unique, false))
+		return false;
+	offsets_from_sorted(graph->offsets, graph->regions, keys, unique, bits);
+
+	parallel_for(unique > PARALLEL_MIN_WORK)
+	for(size_t i = 0; i < unique; i++) {
+		if(graph->neighbors_compact != NULL)
+			graph->neighbors_compact[i] = (uint32_t)(keys[i] & mask);
+		else
+			graph->neighbors[i] = keys[i] & mask;
+		memcpy(&graph->probabilities[i], &probabilities[i], sizeof(*graph->probabilities));
+		keys[i] = ((keys[i] & mask) << bits) | (keys[i] >> bits);
+	}
+
+	// The transposed edges are sorted by destination to lay out the in-edges
+	if(!radix_sort(keys, NULL, unique, 2 * bits)) {
+		free_csr(graph);
+		return false;
+	}
+
+	parallel_for(unique > PARALLEL_MIN_WORK)
+	for(size_t i = 0; i < unique; i++) {
+		if(graph->in_sources_compact != NULL)
+			graph->in_sources_compact[i] = (uint32_t)(keys[i] & mask);
+		else
+			graph->in_sources[i] = keys[i] & mask;
+	}
+	offsets_from_sorted(graph->in_offsets, graph->regions, keys, unique, bits);
+
+	release_rows(graph);
+	index_csr(graph);
+	return true;
+}
+
+
+/**
+ * @brief Find the position of an edge among the out-edges of its source
+ * @param graph the graph to inspect
+ * @param from the source of the edge
+ * @param to the destination of the edge
+ * @return the index of the edge in the view returned by graph_out_edges(),
+ * INVALID_EDGE if there is no such edge
+ */
+size_t graph_find_edge(const struct graph *graph, lp_id_t from, lp_id_t to)
+{
+	struct graph_edges edges = graph_out_edges(graph, from);
+
+	if(graph_is_finalized(graph)) {
+		if(graph->index_offsets != NULL) {
+			uint64_t first = graph->index_offsets[from];
+			uint64_t size = graph->index_offsets[from + 1] - first;
+			if(size)
+				return index_find(graph->index_slots + first, size - 1, &edges, to);
+		}
+	} else if(graph->rows[from].index != NULL) {
+		return index_find(graph->rows[from].index, 2 * graph->rows[from].capacity - 1, &edges, to);
+	}
+
+	if(edges.neighbors_compact != NULL) {
+		if(to > UINT32_MAX)
+			return INVALID_EDGE;
+		for(size_t i = 0; i < edges.size; i++)
+			if(edges.neighbors_compact[i] == to)
+				return i;
+		return INVALID_EDGE;
+	}
+	for(size_t i = 0; i < edges.size; i++)
+		if(edges.neighbors[i] == to)
+			return i;
+	return INVALID_EDGE;
+}
+
+
+/**
+ * @brief Make room for the in-edges of a node in its staging row
+ * @param graph the graph to extend, which must not be finalized
+ * @param to the node whose in-edges are being added
+ * @param needed the number of in-edges the row must be able to keep
+ * @return true on success, false if memory could not be allocated
+ */
+static bool reserve_sources(struct graph *graph, lp_id_t to, uint64_t needed)
+{
+	struct graph_row *row = &graph->rows[to];
+	uint32_t capacity = row->sources_capacity ? row->sources_capacity : ROW_INITIAL_CAPACITY;
+
+	if(likely(needed <= row->sources_capacity))
+		return true;
+	if(unlikely(needed > UINT32_MAX / 2 + 1))
+		return false;
+
+	while(capacity < needed)
+		capacity *= 2;
+
+	lp_id_t *sources = arena_realloc(&graph->arena, row->sources, row->sources_capacity * sizeof(*sources),
+	    capacity * sizeof(*sources));
+	if(sources == NULL)
+		return false;
+	row->sources = sources;
+	row->sources_capacity = capacity;
+	return true;
+}
+
+
+/**
+ * @brief Make room for the out-edges of a node in its staging row
+ *
+ * Capacities are kept to powers of two, so that the edge index of a
+ * high-degree row can keep exactly twice as many slots as the row can keep
+ * edges.
+ *
+ * @param graph the graph to extend, which must not be finalized
+ * @param from the node whose out-edges are being added
+ * @param needed the number of out-edges the row must be able to keep
+ * @return true on success, false if memory could not be allocated
+ */
+static bool reserve_edges(struct graph *graph, lp_id_t from, uint64_t needed)
+{
+	struct graph_row *row = &graph->rows[from];
+	uint32_t capacity = row->capacity ? row->capacity : ROW_INITIAL_CAPACITY;
+
+	if(likely(needed <= row->capacity))
+		return true;
+	if(unlikely(needed > UINT32_MAX / 2 + 1))
+		return false;
+
+	while(capacity < needed)
+		capacity *= 2;
+
+	lp_id_t *neighbors = arena_realloc(&graph->arena, row->neighbors, row->capacity * sizeof(*neighbors),
+	    capacity * sizeof(*neighbors));
+	if(neighbors == NULL)
+		return false;
+	row->neighbors = neighbors;
+
+	double *probabilities = arena_realloc(&graph->arena, row->probabilities, row->capacity * sizeof(*probabilities),
+	    capacity * sizeof(*probabilities));
+	if(probabilities == NULL)
+		return false;
+	row->probabilities = probabilities;
+
+	if(row->data != NULL) {
+		void **data = arena_realloc(&graph->arena, row->data, row->capacity * sizeof(*data),
+		    capacity * sizeof(*data));
+		if(data == NULL)
+			return false;
+		row->data = data;
+	}
+
+	for(uint32_t a = 0; a < row->attributes_size; a++) {
+		if(row->attributes[a] == NULL)
+			continue;
+		size_t size = graph->attribute_sizes[a];
+		unsigned char *values = arena_realloc(&graph->arena, row->attributes[a], row->capacity * size,
+		    capacity * size);
+		if(values == NULL)
+			return false;
+		row->attributes[a] = values;
+	}
+
+	if(capacity >= INDEX_MIN_DEGREE) {
+		arena_free(&graph->arena, row->index, 2 * row->capacity * sizeof(*row->index));
+		row->index = arena_alloc(&graph->arena, 2 * capacity * sizeof(*row->index));
+		struct graph_edges edges = {.neighbors = row->neighbors, .size = row->size};
+		if(row->index != NULL)
+			index_build(row->index, 2 * capacity, &edges);
+	}
+	row->capacity = capacity;
+	return true;
+}
+
+
+/**
+ * @brief Append an edge to the staging row of its source
+ *
+ * The caller must have reserved room for the edge in the row.
+ *
+ * @param graph the graph to extend, which must not be finalized
+ * @param from the source of the edge
+ * @param to the destination of the edge
+ * @return the index of the new edge in the view returned by graph_out_edges()
+ */
+static size_t append_out_edge(struct graph *graph, lp_id_t from, lp_id_t to)
+{
+	struct graph_row *row = &graph->rows[from];
+
+	assert(row->size < row->capacity);
+
+	if(row->data != NULL)
+		row->data[row->size] = NULL;
+	for(uint32_t a = 0; a < row->attributes_size; a++)
+		if(row->attributes[a] != NULL)
+			memset(row->attributes[a] + row->size * graph->attribute_sizes[a], 0, graph->attribute_sizes[a]);
+	row->neighbors[row->size] = to;
+	if(row->index != NULL)
+		index_insert(row->index, 2 * row->capacity - 1, to, row->size);
+	return row->size++;
+}
+
+
+/**
+ * @brief Insert an edge in the staging row of its destination, keeping the sources in increasing order
+ *
+ * The caller must have reserved room for the edge in the row. Edges added in
+ * increasing order of source, as models typically do, are appended in
+ * constant time.
+ *
+ * @param graph the graph to extend, which must not be finalized
+ * @param from the source of the edge
+ * @param to the destination of the edge
+ */
+static void insert_in_edge(struct graph *graph, lp_id_t from, lp_id_t to)
+{
+	struct graph_row *row = &graph->rows[to];
+	uint32_t low = 0, high = row->sources_size;
+
+	assert(row->sources_size < row->sources_capacity);
+
+	if(high != 0 && row->sources[high - 1] > from) {
+		while(low < high) {
+			uint32_t mid = low + (high - low) / 2;
+			if(row->sources[mid] < from)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+	}
+	move_range(row->sources, sizeof(*row->sources), high + 1, high, row->sources_size - high);
+	row->sources[high] = from;
+	row->sources_size++;
+}
+
+
+/**
+ * @brief Append a new edge to the staging row of its source
+ *
+ * The caller must make sure that the edge does not already exist. The
+ * probability of the new edge is left uninitialized.
+ *
+ * @param graph the graph to extend, which must not be finalized
+ * @param from the source of the edge
+ * @param to the destination of the edge
+ * @return the index of the new edge in the view returned by graph_out_edges(),
+ * INVALID_EDGE if memory could not be allocated
+ */
+size_t graph_add_edge(struct graph *graph, lp_id_t from, lp_id_t to)
+{
+	assert(!graph_is_finalized(graph));
+	assert(graph_find_edge(graph, from, to) == INVALID_EDGE);
+
+	// Register the in-edge first: if we run out of memory, nothing has changed
+	if(unlikely(!reserve_sources(graph, to, (uint64_t)graph->rows[to].sources_size + 1)))
+		return INVALID_EDGE;
+	if(unlikely(!reserve_edges(graph, from, (uint64_t)graph->rows[from].size + 1)))
+		return INVALID_EDGE;
+
+	insert_in_edge(graph, from, to);
+	return append_out_edge(graph, from, to);
+}
+
+
+/**
+ * @brief Rebuild the edge index of a node, if it has one
+ *
+ * Edge indexes keep the positions of the edges, so they must be rebuilt
+ * whenever edges are moved or their neighbor changes.
+ *
+ * @param graph the graph to update
+ * @param from the node whose edge index should be rebuilt
+ */
+static void reindex_node(struct graph *graph, lp_id_t from)
+{
+	struct graph_edges edges = graph_out_edges(graph, from);
+
+	if(!graph_is_finalized(graph)) {
+		if(graph->rows[from].index != NULL)
+			index_build(graph->rows[from].index, 2 * graph->rows[from].capacity, &edges);
+		return;
+	}
+
+	if(graph->index_offsets == NULL)
+		return;
+	uint64_t first = graph->index_offsets[from];
+	uint64_t size = graph->index_offsets[from + 1] - first;
+	if(size)
+		index_build(graph->index_slots + first, size, &edges);
+}
+
+
+/**
+ * @brief Remove an in-edge from the staging row of its destination
+ *
+ * The order of the remaining sources is preserved, so a sorted row stays sorted.
+ *
+ * @param graph the graph to update, which must not be finalized
+ * @param from the source of the edge
+ * @param to the destination of the edge
+ */
+static void remove_in_edge(struct graph *graph, lp_id_t from, lp_id_t to)
+{
+	struct graph_row *row = &graph->rows[to];
+	uint32_t i = 0;
+
+	while(row->sources[i] != from)
+		i++;
+	move_range(row->sources, sizeof(*row->sources), i, i + 1, row->sources_size - i - 1);
+	row->sources_size--;
+}
+
+
+/**
+ * @brief Make sure the free slots of the transposed CSR of a finalized graph are counted
+ * @param graph the graph to update
+ * @return true on success, false if memory could not be allocated
+ */
+static bool reserve_in_removed(struct graph *graph)
+{
+	if(graph->in_removed == NULL)
+		graph->in_removed = calloc(graph->regions, sizeof(*graph->in_removed));
+	return graph->in_removed != NULL;
+}
+
+
+/**
+ * @brief Remove an edge from a finalized graph
+ *
+ * The following edges of the node are moved down by one, so their order is
+ * preserved, and a dead slot is left at the end of the CSR range of the
+ * node. With PRECISION_FIXED16, the probability of the edge is first set to
+ * zero, so that the remaining thresholds stay cumulative.
+ *
+ * @param graph the graph to update
+ * @param from the source of the edge
+ * @param edge the index of the edge in the view returned by graph_out_edges()
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the graph is left untouched.
+ */
+static bool remove_csr_edge(struct graph *graph, lp_id_t from, size_t edge)
+{
+	uint64_t first = graph->offsets[from];
+	size_t size = graph_out_degree(graph, from);
+
+	if(graph->removed == NULL) {
+		graph->removed = calloc(graph->regions, sizeof(*graph->removed));
+		if(graph->removed == NULL)
+			return false;
+	}
+	if(unlikely(!reserve_in_removed(graph)))
+		return false;
+
+	struct graph_edges edges = graph_out_edges(graph, from);
+	remove_csr_in_edge(graph, graph_neighbor(&edges, edge), from);
+	if(graph->precision == PRECISION_FIXED16)
+		graph_set_probability(graph, from, edge, 0.0);
+	move_edges(graph, first + edge, first + edge + 1, size - edge - 1);
+	graph->removed[from]++;
+	graph->removed_edges++;
+	size--;
+
+	if(graph->precision == PRECISION_FIXED16 && size != 0) {
+		uint16_t *thresholds = graph->thresholds + first;
+		if(graph->totals[from] > 0.0f)
+			thresholds[size - 1] = THRESHOLD_ONE;
+		else
+			for(size_t j = 0; j < size; j++)
+				thresholds[j] = (uint16_t)(((j + 1) * (uint64_t)THRESHOLD_ONE + size / 2) / size);
+	}
+	if(size == 0 && graph->totals != NULL)
+		graph->totals[from] = 0.0f;
+
+	graph_build_node_sampling(graph, from);
+	reindex_node(graph, from);
+
+	if(graph->removed_edges * REMOVED_MAX_SHARE > graph->offsets[graph->regions])
+		compact_csr(graph);
+	return true;
+}
+
+
+/**
+ * @brief Remove an edge from a graph
+ *
+ * The order of the other out-edges of the node is preserved. In a finalized
+ * graph, the memory of removed edges is reclaimed lazily, see compact_csr().
+ * The user data attached to the edge, if any, is not released.
+ *
+ * @param graph the graph to update
+ * @param from the source of the edge
+ * @param edge the index of the edge in the view returned by graph_out_edges()
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the graph is left untouched.
+ */
+bool graph_remove_edge(struct graph *graph, lp_id_t from, size_t edge)
+{
+	if(graph_is_finalized(graph))
+		return remove_csr_edge(graph, from, edge);
+
+	struct graph_row *row = &graph->rows[from];
+	uint32_t following = row->size - (uint32_t)edge - 1;
+
+	remove_in_edge(graph, from, row->neighbors[edge]);
+	move_range(row->neighbors, sizeof(*row->neighbors), edge, edge + 1, following);
+	move_range(row->probabilities, sizeof(*row->probabilities), edge, edge + 1, following);
+	move_range(row->data, sizeof(*row->data), edge, edge + 1, following);
+	for(uint32_t a = 0; a < row->attributes_size; a++)
+		move_range(row->attributes[a], graph->attribute_sizes[a], edge, edge + 1, following);
+	row->size--;
+	reindex_node(graph, from);
+	return true;
+}
+
+
+/**
+ * @brief Change the destination of an edge
+ *
+ * The edge keeps its position among the out-edges of its source, its
+ * probability, its data and its attributes. The caller must make sure that
+ * there is no edge from @p from to @p to already.
+ *
+ * @param graph the graph to update
+ * @param from the source of the edge
+ * @param edge the index of the edge in the view returned by graph_out_edges()
+ * @param to the new destination of the edge
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the graph is left untouched.
+ */
+bool graph_rewire_edge(struct graph *graph, lp_id_t from, size_t edge, lp_id_t to)
+{
+	assert(graph_find_edge(graph, from, to) == INVALID_EDGE);
+
+	if(graph_is_finalized(graph)) {
+		uint64_t position = graph->offsets[from] + edge;
+		struct graph_edges edges = graph_out_edges(graph, from);
+		lp_id_t old = graph_neighbor(&edges, edge);
+		if(unlikely(!reserve_in_removed(graph) || !insert_csr_in_edge(graph, to, from)))
+			return false;
+		remove_csr_in_edge(graph, old, from);
+		if(graph->neighbors_compact != NULL)
+			graph->neighbors_compact[position] = (uint32_t)to;
+		else
+			graph->neighbors[position] = to;
+		reindex_node(graph, from);
+		return true;
+	}
+
+	struct graph_row *row = &graph->rows[from];
+	if(unlikely(!reserve_sources(graph, to, (uint64_t)graph->rows[to].sources_size + 1)))
+		return false;
+	remove_in_edge(graph, from, row->neighbors[edge]);
+	insert_in_edge(graph, from, to);
+	row->neighbors[edge] = to;
+	reindex_node(graph, from);
+	return true;
+}
+
+
+/**
+ * @brief Make sure the array keeping the user data of the out-edges of a node is allocated
+ * @param graph the graph to update
+ * @param from the node whose out-edges will get user data
+ * @return true on success, false if memory could not be allocated
+ */
+static bool reserve_data(struct graph *graph, lp_id_t from)
+{
+	if(graph_is_finalized(graph)) {
+		if(graph->data == NULL)
+			graph->data = calloc(graph->offsets[graph->regions], sizeof(*graph->data));
+		return graph->data != NULL || graph->offsets[graph->regions] == 0;
+	}
+
+	struct graph_row *row = &graph->rows[from];
+	if(row->data == NULL) {
+		row->data = arena_alloc(&graph->arena, row->capacity * sizeof(*row->data));
+		if(row->data == NULL)
+			return false;
+		memset(row->data, 0, row->capacity * sizeof(*row->data));
+	}
+	return true;
+}
+
+
+/**
+ * @brief Add or update a batch of edges
+ *
+ * The batch is radix-sorted by (source, destination), so that duplicates
+ * within the batch end up next to each other and every staging row is grown
+ * at most once. New edges are then sorted by (destination, source) to
+ * register them in the rows of their destinations, so that the rows are
+ * visited sequentially in both passes. The outcome is the same as adding the
+ * edges one at a time in input order: if an edge appears more than once, the
+ * last occurrence wins. If the graph is finalized, every edge of the batch
+ * must already exist.
+ *
+ * @param graph the graph to update
+ * @param n the number of edges in the batch
+ * @param from the sources of the edges
+ * @param to the destinations of the edges
+ * @param probabilities the probabilities of the edges
+ * @param data the user data to attach to the edges, NULL to leave it untouched
+ * @return true on success. If some edge does not exist in a finalized graph,
+ * or if memory runs out, false is returned and no edge is added.
+ */
+bool graph_add_edges(struct graph *graph, size_t n, const lp_id_t from[], const lp_id_t to[],
+    const double probabilities[], void *const data[])
+{
+	unsigned bits = bits_needed(graph->regions - 1);
+	uint64_t mask = ((uint64_t)1 << bits) - 1;
+	uint64_t *in_keys = NULL;
+	uint8_t *is_new = NULL;
+	size_t unique = 0, added = 0;
+	bool ret = false;
+
+	uint64_t *keys = malloc(n * sizeof(*keys));
+	uint64_t *payload = malloc(n * sizeof(*payload));
+	if(n && (keys == NULL || payload == NULL))
+		goto out;
+
+	// Node IDs fit in 32 bits, so (source, destination) pairs fit in a single key. Unless we have to
+	// move user data along, the probabilities themselves are the payload, so that the sorted batch is
+	// then scanned sequentially.
+	for(size_t i = 0; i < n; i++) {
+		keys[i] = (from[i] << bits) | to[i];
+		if(data != NULL)
+			payload[i] = i;
+		else
+			memcpy(&payload[i], &probabilities[i], sizeof(payload[i]));
+	}
+	if(!radix_sort(keys, payload, n, 2 * bits))
+		goto out;
+
+	// Only keep the last occurrence of each edge, which the stable sort has placed last
+	for(size_t i = 0; i < n; i++) {
+		if(i + 1 < n && keys[i + 1] == keys[i])
+			continue;
+		keys[unique] = keys[i];
+		payload[unique] = payload[i];
+		unique++;
+	}
+
+	// Find out which edges are new, and make room for them in the rows of their sources
+	is_new = calloc((unique + 7) / 8, 1);
+	if(unique && is_new == NULL)
+		goto out;
+	for(size_t i = 0; i < unique;) {
+		lp_id_t src = keys[i] >> bits;
+		size_t group_added = 0;
+
+		// The batch has no duplicates left, so all the edges of an empty row are new
+		bool fresh = !graph_is_finalized(graph) && graph->rows[src].size == 0;
+
+		for(; i < unique && keys[i] >> bits == src; i++) {
+			if(fresh || graph_find_edge(graph, src, keys[i] & mask) == INVALID_EDGE) {
+				is_new[i / 8] |= 1U << (i % 8);
+				group_added++;
+			}
+		}
+
+		if(group_added && graph_is_finalized(graph))
+			goto out;
+		if(group_added && !reserve_edges(graph, src, (uint64_t)graph->rows[src].size + group_added))
+			goto out;
+		if(data != NULL && !reserve_data(graph, src))
+			goto out;
+		added += group_added;
+	}
+
+	// Make room for the new edges in the rows of their destinations
+	in_keys = malloc(added * sizeof(*in_keys));
+	if(added && in_keys == NULL)
+		goto out;
+	for(size_t i = 0, j = 0; i < unique; i++)
+		if(is_new[i / 8] & (1U << (i % 8)))
+			in_keys[j++] = ((keys[i] & mask) << bits) | (keys[i] >> bits);
+	if(!radix_sort(in_keys, NULL, added, 2 * bits))
+		goto out;
+	for(size_t i = 0; i < added;) {
+		lp_id_t dst = in_keys[i] >> bits;
+		size_t group_added = 0;
+
+		for(; i < added && in_keys[i] >> bits == dst; i++)
+			group_added++;
+		if(!reserve_sources(graph, dst, (uint64_t)graph->rows[dst].sources_size + group_added))
+			goto out;
+	}
+
+	// From now on nothing can fail. The new sources of every row are sorted, so they are appended and the
+	// row is sorted once, only if they do not all follow the sources it already has.
+	for(size_t i = 0; i < added;) {
+		struct graph_row *row = &graph->rows[in_keys[i] >> bits];
+		uint32_t previous = row->sources_size;
+
+		for(lp_id_t dst = in_keys[i] >> bits; i < added && in_keys[i] >> bits == dst; i++)
+			row->sources[row->sources_size++] = in_keys[i] & mask;
+		if(previous != 0 && row->sources[previous - 1] > row->sources[previous])
+			qsort(row->sources, row->sources_size, sizeof(*row->sources), compare_ids);
+	}
+
+	for(size_t i = 0; i < unique;) {
+		lp_id_t src = keys[i] >> bits;
+
+		for(; i < unique && keys[i] >> bits == src; i++) {
+			lp_id_t dst = keys[i] & mask;
+			size_t edge;
+			double probability;
+
+			if(is_new[i / 8] & (1U << (i % 8)))
+				edge = append_out_edge(graph, src, dst);
+			else
+				edge = graph_find_edge(graph, src, dst);
+
+			if(data != NULL) {
+				probability = probabilities[payload[i]];
+				graph_out_edges(graph, src).data[edge] = data[payload[i]];
+			} else {
+				memcpy(&probability, &payload[i], sizeof(probability));
+			}
+			graph_set_probability(graph, src, edge, probability);
+		}
+
+		if(graph_is_finalized(graph))
+			graph_build_node_sampling(graph, src);
+	}
+	ret = true;
+
+out:
+	free(keys);
+	free(payload);
+	free(in_keys);
+	free(is_new);
+	return ret;
+}
+
+
+/**
+ * @brief Attach user data to an edge
+ *
+ * The array keeping the per-edge data is allocated the first time some data
+ * is attached to an edge of the row (or of the whole graph, once finalized).
+ *
+ * @param graph the graph to update
+ * @param from the source of the edge
+ * @param edge the index of the edge, as returned by graph_find_edge()
+ * @param data the user data to attach
+ * @return true on success, false if memory could not be allocated
+ */
+bool graph_set_edge_data(struct graph *graph, lp_id_t from, size_t edge, void *data)
+{
+	if(graph_is_finalized(graph)) {
+		if(graph->data == NULL) {
+			if(data == NULL)
+				return true;
+			graph->data = calloc(graph->offsets[graph->regions], sizeof(*graph->data));
+			if(graph->data == NULL)
+				return false;
+		}
+		graph->data[graph->offsets[from] + edge] = data;
+		return true;
+	}
+
+	struct graph_row *row = &graph->rows[from];
+	if(row->data == NULL) {
+		if(data == NULL)
+			return true;
+		row->data = arena_alloc(&graph->arena, row->capacity * sizeof(*row->data));
+		if(row->data == NULL)
+			return false;
+		memset(row->data, 0, row->capacity * sizeof(*row->data));
+	}
+	row->data[edge] = data;
+	return true;
+}
+
+
+/**
+ * @brief Add an attribute column to the edges of a graph
+ *
+ * Every edge gets a zero-filled value of @p size bytes in the new column.
+ * The values of a column are stored contiguously, in the same order as the
+ * edges: in a finalized graph they are allocated right away, while for the
+ * staging rows they are allocated the first time a value of the row is
+ * accessed.
+ *
+ * @param graph the graph to update
+ * @param size the size of the values of the column
+ * @return the index of the new column, UINT_MAX if memory could not be allocated
+ */
+unsigned graph_add_attribute(struct graph *graph, size_t size)
+{
+	unsigned char *column = NULL;
+
+	if(graph_is_finalized(graph)) {
+		column = calloc(graph->offsets[graph->regions], size);
+		if(column == NULL && graph->offsets[graph->regions] != 0)
+			return UINT_MAX;
+	}
+
+	size_t *sizes = realloc(graph->attribute_sizes, (graph->attributes + 1) * sizeof(*sizes));
+	if(sizes != NULL)
+		graph->attribute_sizes = sizes;
+	unsigned char **columns = realloc(graph->attribute_columns, (graph->attributes + 1) * sizeof(*columns));
+	if(columns != NULL)
+		graph->attribute_columns = columns;
+	if(sizes == NULL || columns == NULL) {
+		free(column);
+		return UINT_MAX;
+	}
+
+	graph->attribute_sizes[graph->attributes] = size;
+	graph->attribute_columns[graph->attributes] = column;
+	return graph->attributes++;
+}
+
+
+/**
+ * @brief Get the values of an attribute column for the out-edges of a node
+ *
+ * The values are contiguous and follow the order of the edges in the view
+ * returned by graph_out_edges(). The returned pointer is invalidated when
+ * edges are added to the node or the graph is finalized.
+ *
+ * @param graph the graph to inspect
+ * @param attribute the index of the attribute column
+ * @param from the node whose values are requested
+ * @return a pointer to the values, NULL if memory could not be allocated
+ */
+void *graph_attribute(struct graph *graph, unsigned attribute, lp_id_t from)
+{
+	if(graph_is_finalized(graph))
+		return graph->attribute_columns[attribute] + graph->offsets[from] * graph->attribute_sizes[attribute];
+
+	struct graph_row *row = &graph->rows[from];
+	if(row->attributes_size <= attribute) {
+		unsigned char **attributes = arena_realloc(&graph->arena, row->attributes,
+		    row->attributes_size * sizeof(*attributes), graph->attributes * sizeof(*attributes));
+		if(attributes == NULL)
+			return NULL;
+		memset(attributes + row->attributes_size, 0,
+		    (graph->attributes - row->attributes_size) * sizeof(*attributes));
+		row->attributes = attributes;
+		row->attributes_size = graph->attributes;
+	}
+
+	if(row->attributes[attribute] == NULL) {
+		size_t size = row->capacity * graph->attribute_sizes[attribute];
+		row->attributes[attribute] = arena_alloc(&graph->arena, size);
+		if(row->attributes[attribute] == NULL)
+			return NULL;
+		memset(row->attributes[attribute], 0, size);
+	}
+	return row->attributes[attribute];
+}
+
+
+/**
+ * @brief Build the alias table for the out-edges of a single node
+ *
+ * This is Vose's variant of Walker's alias method. The small and large work
+ * lists are kept as intrusive stacks threaded through @p alias_indices: the
+ * entry of a column is only needed as a link while the column sits in a work
+ * list, and gets its final value when the column leaves it.
+ *
+ * If all the probabilities are zero, every edge is picked uniformly.
+ *
+ * @param graph the finalized graph the node belongs to
+ * @param from the node whose alias table is built
+ * @param alias_probabilities the alias table column probabilities to fill
+ * @param alias_indices the alias table column redirections to fill
+ * @param size the number of out-edges of the node
+ */
+static void build_alias_table(const struct graph *graph, lp_id_t from, double *alias_probabilities,
+    uint32_t *alias_indices, uint32_t size)
+{
+	uint32_t small = ALIAS_NONE, large = ALIAS_NONE;
+	double total = 0.0;
+
+	for(uint32_t i = 0; i < size; i++)
+		total += graph_get_probability(graph, from, i);
+
+	for(uint32_t i = size; i-- > 0;) {
+		alias_probabilities[i] = total > 0.0 ? graph_get_probability(graph, from, i) * size / total : 1.0;
+		if(alias_probabilities[i] < 1.0) {
+			alias_indices[i] = small;
+			small = i;
+		} else {
+			alias_indices[i] = large;
+			large = i;
+		}
+	}
+
+	while(small != ALIAS_NONE && large != ALIAS_NONE) {
+		uint32_t s = small, l = large;
+
+		small = alias_indices[s];
+		alias_indices[s] = l;
+		alias_probabilities[l] -= 1.0 - alias_probabilities[s];
+		if(alias_probabilities[l] < 1.0) {
+			large = alias_indices[l];
+			alias_indices[l] = small;
+			small = l;
+		}
+	}
+
+	// Whatever is left over is due to rounding errors: these columns are always kept
+	while(large != ALIAS_NONE) {
+		uint32_t l = large;
+		large = alias_indices[l];
+		alias_probabilities[l] = 1.0;
+		alias_indices[l] = l;
+	}
+	while(small != ALIAS_NONE) {
+		uint32_t s = small;
+		small = alias_indices[s];
+		alias_probabilities[s] = 1.0;
+		alias_indices[s] = s;
+	}
+}
+
+
+/**
+ * @brief Build the cumulative distribution of the out-edges of a single node
+ *
+ * The share of the probability of every edge is accumulated, and the last
+ * value is always 1, so that a random draw in [0, 1) always selects an edge.
+ * If all probabilities are zero, the edges are equally likely.
+ *
+ * @param graph the finalized graph the node belongs to
+ * @param from the node whose cumulative distribution is built
+ * @param cumulative the cumulative distribution to fill
+ * @param size the number of out-edges of the node
+ */
+static void build_cumulative(const struct graph *graph, lp_id_t from, double *cumulative, size_t size)
+{
+	double total = 0.0, sum = 0.0;
+
+	for(size_t i = 0; i < size; i++) {
+		total += graph_get_probability(graph, from, i);
+		cumulative[i] = total;
+	}
+	for(size_t i = 0; i < size; i++) {
+		sum = total > 0.0 ? cumulative[i] / total : (double)(i + 1) / (double)size;
+		cumulative[i] = sum < 1.0 ? sum : 1.0;
+	}
+	if(size)
+		cumulative[size - 1] = 1.0;
+}
+
+
+/**
+ * @brief Rebuild the sampling table of a single node of a finalized graph
+ *
+ * This must be called whenever the probability of an out-edge of @p from
+ * changes. Depending on the sampling algorithm, the alias table or the
+ * cumulative distribution of the node is rebuilt. If the graph has neither,
+ * this function does nothing.
+ *
+ * @param graph the graph to update
+ * @param from the node whose sampling table must be rebuilt
+ */
+void graph_build_node_sampling(struct graph *graph, lp_id_t from)
+{
+	assert(graph_is_finalized(graph));
+
+	uint64_t first = graph->offsets[from];
+	if(graph->alias_probabilities != NULL)
+		build_alias_table(graph, from, graph->alias_probabilities + first, graph->alias_indices + first,
+		    graph_out_degree(graph, from));
+	else if(graph->cumulative != NULL)
+		build_cumulative(graph, from, graph->cumulative + first, graph_out_degree(graph, from));
+}
+
+
+/**
+ * @brief Release the sampling tables of a finalized graph
+ * @param graph the graph to update
+ */
+static void release_sampling(struct graph *graph)
+{
+	free(graph->alias_probabilities);
+	free(graph->alias_indices);
+	free(graph->cumulative);
+	graph->alias_probabilities = NULL;
+	graph->alias_indices = NULL;
+	graph->cumulative = NULL;
+}
+
+
+/**
+ * @brief Build the sampling tables of all the nodes of a finalized graph
+ *
+ * These are the alias tables with SAMPLING_ALIAS and the cumulative
+ * distributions with SAMPLING_CUMULATIVE. Graphs with PRECISION_FIXED16
+ * sample through their cumulative thresholds, so no table is built for them.
+ * The nodes are processed in parallel on large graphs.
+ *
+ * @param graph the graph to update
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case random neighbors are picked with a linear scan.
+ */
+bool graph_build_sampling(struct graph *graph)
+{
+	uint64_t edges = graph->offsets[graph->regions];
+
+	assert(graph_is_finalized(graph));
+
+	if(graph->precision == PRECISION_FIXED16 || graph->sampling == SAMPLING_LINEAR)
+		return true;
+
+	if(graph->sampling == SAMPLING_ALIAS && graph->alias_probabilities == NULL) {
+		graph->alias_probabilities = malloc(edges * sizeof(*graph->alias_probabilities));
+		graph->alias_indices = malloc(edges * sizeof(*graph->alias_indices));
+		if(edges && (graph->alias_probabilities == NULL || graph->alias_indices == NULL)) {
+			release_sampling(graph);
+			return false;
+		}
+	} else if(graph->sampling == SAMPLING_CUMULATIVE && graph->cumulative == NULL) {
+		graph->cumulative = malloc(edges * sizeof(*graph->cumulative));
+		if(edges && graph->cumulative == NULL)
+			return false;
+	}
+
+	parallel_for_dynamic(graph->regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < graph->regions; i++)
+		graph_build_node_sampling(graph, i);
+	return true;
+}
+
+
+/**
+ * @brief Select the algorithm used to pick random neighbors
+ *
+ * Sampling tables are only kept for finalized graphs, so switching a
+ * finalized graph to another algorithm releases its tables and builds the
+ * ones of the new algorithm, if any.
+ *
+ * @param graph the graph to update
+ * @param sampling the sampling algorithm to use
+ * @return true on success, false if memory could not be allocated
+ */
+bool graph_set_sampling(struct graph *graph, enum topology_sampling sampling)
+{
+	if(graph_is_finalized(graph) && sampling != graph->sampling)
+		release_sampling(graph);
+
+	graph->sampling = sampling;
+	if(!graph_is_finalized(graph))
+		return true;
+	return graph_build_sampling(graph);
+}
+
+
+/**
+ * @brief Pick a random out-edge of a node
+ *
+ * Edges are picked with a likelihood proportional to their probability. If
+ * the node has an alias table, this costs a couple of array reads regardless
+ * of the degree of the node. If it has a cumulative distribution, the draw is
+ * looked up with a binary search. With PRECISION_FIXED16, an integer draw is
+ * compared against the cumulative thresholds, with a binary search unless
+ * SAMPLING_LINEAR is selected. Otherwise, the cumulative probabilities are
+ * scanned linearly. In all cases, a single random number is consumed.
+ *
+ * @param graph the graph to inspect
+ * @param from the node whose out-edge is requested, which must have at least
+ * an out-edge
+ * @param rand a random number uniformly distributed in [0, 1)
+ * @return the index of the selected edge in the view returned by graph_out_edges()
+ */
+size_t graph_sample(const struct graph *graph, lp_id_t from, double rand)
+{
+	struct graph_edges edges = graph_out_edges(graph, from);
+	double total = 0.0, cumulative = 0.0;
+	size_t i;
+
+	assert(edges.size > 0);
+
+	if(graph_is_finalized(graph) && graph->alias_probabilities != NULL) {
+		uint64_t first = graph->offsets[from];
+		double column = rand * (double)edges.size;
+
+		i = (size_t)column;
+		if(unlikely(i >= edges.size))
+			i = edges.size - 1;
+		return column - (double)i < graph->alias_probabilities[first + i] ? i : graph->alias_indices[first + i];
+	}
+
+	if(graph_is_finalized(graph) && graph->cumulative != NULL) {
+		const double *cdf = graph->cumulative + graph->offsets[from];
+		size_t low = 0, high = edges.size - 1;
+
+		while(low < high) {
+			size_t mid = low + (high - low) / 2;
+			if(cdf[mid] > rand)
+				high = mid;
+			else
+				low = mid + 1;
+		}
+		return low;
+	}
+
+	if(graph_is_finalized(graph) && graph->precision == PRECISION_FIXED16) {
+		const uint16_t *thresholds = graph->thresholds + graph->offsets[from];
+		uint32_t draw = (uint32_t)(rand * THRESHOLD_ONE);
+
+		if(graph->sampling == SAMPLING_LINEAR) {
+			for(i = 0; thresholds[i] <= draw; i++)
+				;
+			return i;
+		}
+
+		size_t low = 0, high = edges.size - 1;
+		while(low < high) {
+			size_t mid = low + (high - low) / 2;
+			if(thresholds[mid] > draw)
+				high = mid;
+			else
+				low = mid + 1;
+		}
+		return low;
+	}
+
+	for(i = 0; i < edges.size; i++)
+		total += graph_get_probability(graph, from, i);
+
+	if(unlikely(total <= 0.0)) {
+		i = (size_t)(rand * (double)edges.size);
+		return i < edges.size ? i : edges.size - 1;
+	}
+
+	rand *= total;
+	for(i = 0; i < edges.size - 1; i++) {
+		cumulative += graph_get_probability(graph, from, i);
+		if(rand < cumulative)
+			break;
+	}
+	return i;
+}
+
+
+/**
+ * @brief Get the probability of an edge
+ *
+ * With PRECISION_FIXED16, the probability is rebuilt from the share of the
+ * edge and the total probability of the node, so it is only accurate to
+ * about 1 / 65535 of the total.
+ *
+ * @param graph the graph to inspect
+ * @param from the source of the edge
+ * @param edge the index of the edge in the view returned by graph_out_edges()
+ * @return the probability of the edge
+ */
+double graph_get_probability(const struct graph *graph, lp_id_t from, size_t edge)
+{
+	if(!graph_is_finalized(graph))
+		return graph->rows[from].probabilities[edge];
+
+	uint64_t position = graph->offsets[from] + edge;
+	switch(graph->precision) {
+		case PRECISION_FLOAT:
+			return graph->probabilities_float[position];
+		case PRECISION_FIXED16: {
+			uint16_t previous = edge ? graph->thresholds[position - 1] : 0;
+			return (double)(graph->thresholds[position] - previous) / THRESHOLD_ONE * graph->totals[from];
+		}
+		default:
+			return graph->probabilities[position];
+	}
+}
+
+
+/**
+ * @brief Set the probability of an edge
+ *
+ * With PRECISION_FIXED16, the thresholds of all the out-edges of the node
+ * are recomputed in place, which costs time proportional to its degree. The
+ * sampling table of the node, if any, is not updated: graph_build_node_sampling()
+ * must be called after all the probabilities of the node have been set.
+ *
+ * @param graph the graph to update
+ * @param from the source of the edge
+ * @param edge the index of the edge in the view returned by graph_out_edges()
+ * @param probability the new probability of the edge
+ */
+void graph_set_probability(struct graph *graph, lp_id_t from, size_t edge, double probability)
+{
+	if(!graph_is_finalized(graph)) {
+		graph->rows[from].probabilities[edge] = probability;
+		return;
+	}
+
+	uint64_t first = graph->offsets[from];
+	switch(graph->precision) {
+		case PRECISION_FLOAT:
+			graph->probabilities_float[first + edge] = (float)probability;
+			return;
+		case PRECISION_DOUBLE:
+			graph->probabilities[first + edge] = probability;
+			return;
+		default:
+			break;
+	}
+
+	uint16_t *thresholds = graph->thresholds + first;
+	uint64_t size = graph_out_degree(graph, from);
+	double old_total = graph->totals[from];
+	double total = old_total - graph_get_probability(graph, from, edge) + probability;
+	double cumulative = 0.0;
+	uint16_t previous = 0;
+
+	if(total < 0.0)
+		total = 0.0;
+
+	// The old thresholds are read right before being overwritten, so no scratch memory is needed
+	for(uint64_t i = 0; i < size; i++) {
+		uint16_t current = thresholds[i];
+		cumulative += i == edge ? probability : (double)(current - previous) / THRESHOLD_ONE * old_total;
+		previous = current;
+		double share = total > 0.0 ? cumulative / total : (double)(i + 1) / (double)size;
+		thresholds[i] = (uint16_t)(share >= 1.0 ? THRESHOLD_ONE : share * THRESHOLD_ONE + 0.5);
+	}
+	thresholds[size - 1] = THRESHOLD_ONE;
+	graph->totals[from] = (float)total;
+}
+
+
+/**
+ * @brief Scale the probabilities of the out-edges of every node so that they sum to 1
+ *
+ * The probabilities keep their proportions, so they can be set as arbitrary
+ * non-negative weights in the first place. The out-edges of a node whose
+ * probabilities are all zero become equally likely, and nodes with no
+ * out-edges are left alone. The sampling tables, if any, are rebuilt.
+ * Nodes are processed in parallel on large graphs.
+ *
+ * @param graph the graph to update
+ */
+void graph_normalize(struct graph *graph)
+{
+	parallel_for_dynamic(graph->regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < graph->regions; i++) {
+		size_t size = graph_out_degree(graph, i);
+		double total = 0.0;
+
+		if(size == 0)
+			continue;
+
+		// Thresholds are shares of the total already, and are evenly spaced if the total is zero
+		if(graph_is_finalized(graph) && graph->precision == PRECISION_FIXED16) {
+			graph->totals[i] = 1.0f;
+			continue;
+		}
+
+		for(size_t j = 0; j < size; j++)
+			total += graph_get_probability(graph, i, j);
+		for(size_t j = 0; j < size; j++)
+			graph_set_probability(graph, i, j,
+			    total > 0.0 ? graph_get_probability(graph, i, j) / total : 1.0 / (double)size);
+		if(graph_is_finalized(graph))
+			graph_build_node_sampling(graph, i);
+	}
+}
+
+
+/**
+ * @brief Select the storage format of the probabilities of a graph
+ *
+ * Graphs keep double precision probabilities until they are finalized, and
+ * are then converted to @p precision. Finalized graphs are converted
+ * immediately, and their sampling tables are rebuilt.
+ *
+ * @param graph the graph to update
+ * @param precision the storage format to use
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case, the probabilities of a finalized graph are kept as doubles.
+ */
+bool graph_set_precision(struct graph *graph, enum topology_precision precision)
+{
+	if(!graph_is_finalized(graph)) {
+		graph->precision = precision;
+		return true;
+	}
+
+	if(precision == graph->precision)
+		return true;
+
+	if(!expand_probabilities(graph))
+		return false;
+
+	release_sampling(graph);
+
+	graph->precision = precision;
+	bool ret = compact_probabilities(graph);
+	return graph_build_sampling(graph) && ret;
+}
+
+
+/**
+ * @brief Copy an edge column of a finalized graph in the order of a permutation of its nodes
+ * @param graph the graph the column belongs to
+ * @param offsets the CSR offsets of the permuted graph
+ * @param order the old ID of every node, indexed by new ID
+ * @param column the column to permute, may be NULL
+ * @param size the size of the values of the column
+ * @param permuted where to store the permuted column, NULL if @p column is NULL
+ * @return true on success, false if memory could not be allocated
+ */
+static bool permute_column(const struct graph *graph, const uint64_t *offsets, const lp_id_t *order,
+    const void *column, size_t size, void **permuted)
+{
+	uint64_t edges = offsets[graph->regions];
+
+	*permuted = NULL;
+	if(column == NULL)
+		return true;
+
+	unsigned char *ret = malloc(edges * size);
+	if(ret == NULL)
+		return edges == 0;
+
+	parallel_for_dynamic(graph->regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < graph->regions; i++)
+		memcpy(ret + offsets[i] * size, (const unsigned char *)column + graph->offsets[order[i]] * size,
+		    (offsets[i + 1] - offsets[i]) * size);
+
+	*permuted = ret;
+	return true;
+}
+
+
+/**
+ * @brief Relabel the nodes of a finalized graph
+ *
+ * Node i of the relabeled graph is node order[i] of the original one, and
+ * keeps its out-edges in the same order, along with their probabilities,
+ * data and attributes. The new CSR arrays are built out of place, and then
+ * the transposed CSR, the edge indexes and the sampling tables are rebuilt.
+ *
+ * @param graph the graph to relabel, which must have no removed edges
+ * @param order the old ID of every node, indexed by new ID
+ * @param rank the new ID of every node, indexed by old ID
+ * @return true on success, false if memory could not be allocated. In the
+ * latter case the graph is left untouched.
+ */
+bool graph_permute(struct graph *graph, const lp_id_t *order, const lp_id_t *rank)
+{
+	lp_id_t regions = graph->regions;
+	bool compact = graph_has_compact_ids(graph);
+	void *neighbors, *probabilities, *probabilities_float, *thresholds, *data;
+	void **attributes = calloc(graph->attributes + 1, sizeof(*attributes));
+	uint64_t *offsets = malloc((regions + 1) * sizeof(*offsets));
+	float *totals = graph->totals != NULL ? malloc(regions * sizeof(*totals)) : NULL;
+
+	assert(graph_is_finalized(graph) && graph->removed_edges == 0);
+
+	if(attributes == NULL || offsets == NULL || (graph->totals != NULL && totals == NULL)) {
+		free(attributes);
+		free(offsets);
+		free(totals);
+		return false;
+	}
+
+	parallel_for(regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < regions; i++)
+		offsets[i] = graph_out_degree(graph, order[i]);
+	offsets[regions] = 0;
+	prefix_sum(offsets, regions + 1);
+
+	bool ok = permute_column(graph, offsets, order, compact ? (void *)graph->neighbors_compact : graph->neighbors,
+	    compact ? sizeof(uint32_t) : sizeof(lp_id_t), &neighbors);
+	ok &= permute_column(graph, offsets, order, graph->probabilities, sizeof(double), &probabilities);
+	ok &= permute_column(graph, offsets, order, graph->probabilities_float, sizeof(float), &probabilities_float);
+	ok &= permute_column(graph, offsets, order, graph->thresholds, sizeof(uint16_t), &thresholds);
+	ok &= permute_column(graph, offsets, order, graph->data, sizeof(void *), &data);
+	for(unsigned a = 0; a < graph->attributes; a++)
+		ok &= permute_column(graph, offsets, order, graph->attribute_columns[a], graph->attribute_sizes[a],
+		    &attributes[a]);
+
+	if(!ok) {
+		free(neighbors);
+		free(probabilities);
+		free(probabilities_float);
+		free(thresholds);
+		free(data);
+		for(unsigned a = 0; a < graph->attributes; a++)
+			free(attributes[a]);
+		free(attributes);
+		free(offsets);
+		free(totals);
+		return false;
+	}
+
+	uint64_t edges = offsets[regions];
+	parallel_for(edges > PARALLEL_MIN_WORK)
+	for(uint64_t e = 0; e < edges; e++) {
+		if(compact)
+			((uint32_t *)neighbors)[e] = (uint32_t)rank[((uint32_t *)neighbors)[e]];
+		else
+			((lp_id_t *)neighbors)[e] = rank[((lp_id_t *)neighbors)[e]];
+	}
+	if(totals != NULL) {
+		for(lp_id_t i = 0; i < regions; i++)
+			totals[i] = graph->totals[order[i]];
+		free(graph->totals);
+		graph->totals = totals;
+	}
+
+	free(graph->offsets);
+	free(graph->neighbors);
+	free(graph->neighbors_compact);
+	free(graph->probabilities);
+	free(graph->probabilities_float);
+	free(graph->thresholds);
+	free(graph->data);
+	graph->offsets = offsets;
+	graph->neighbors = compact ? NULL : neighbors;
+	graph->neighbors_compact = compact ? neighbors : NULL;
+	graph->probabilities = probabilities;
+	graph->probabilities_float = probabilities_float;
+	graph->thresholds = thresholds;
+	graph->data = data;
+	for(unsigned a = 0; a < graph->attributes; a++) {
+		free(graph->attribute_columns[a]);
+		graph->attribute_columns[a] = attributes[a];
+	}
+	free(attributes);
+
+	release_sampling(graph);
+	free(graph->index_offsets);
+	free(graph->index_slots);
+	graph->index_offsets = NULL;
+	graph->index_slots = NULL;
+
+	rebuild_in_edges(graph, false);
+	build_edge_indexes(graph);
+	graph_build_sampling(graph);
+	return true;
+}
+
+
+/**
+ * @brief Get a view over the sources of the in-edges of a node
+ *
+ * The sources of staging rows are kept sorted by the functions which add
+ * edges, so this never modifies the graph.
+ *
+ * @param graph the graph to inspect
+ * @param to the node whose in-edges are requested
+ * @return a view over the sources of the in-edges of @p to, in increasing order
+ */
+struct graph_sources graph_in_edges(const struct graph *graph, lp_id_t to)
+{
+	struct graph_sources ret;
+
+	if(graph_is_finalized(graph)) {
+		if(graph_has_compact_ids(graph)) {
+			ret.sources = NULL;
+			ret.sources_compact = graph->in_sources_compact + graph->in_offsets[to];
+		} else {
+			ret.sources = graph->in_sources + graph->in_offsets[to];
+			ret.sources_compact = NULL;
+		}
+		ret.size = graph_in_degree(graph, to);
+		return ret;
+	}
+
+	const struct graph_row *row = &graph->rows[to];
+	ret.sources = row->sources;
+	ret.sources_compact = NULL;
+	ret.size = row->sources_size;
+	return ret;
+}
@@ -0,0 +1,302 @@
+/**
+ * @file src/graph.h
+ *
+ * @brief Graph storage
+ *
+ * The storage backing TOPOLOGY_GRAPH topologies. While a graph is being
+ * built, the out-edges of every node are kept in a growable row. Once the
+ * graph is finalized, all rows are packed into a compressed sparse row (CSR)
+ * representation, so that queries scan contiguous memory. The CSR arrays of
+ * graphs with fewer than 2^32 nodes keep node IDs in 32 bits, which halves
+ * the memory traffic of adjacency scans.
+ *
+ * Edges removed from a finalized graph leave a dead slot at the end of the
+ * CSR range of their source, so that queries only ever see live edges. The
+ * dead slots are reclaimed all at once, when they make up a large enough
+ * share of the CSR arrays or when the graph is finalized again. The
+ * transposed CSR of the in-edges is kept up to date by every update, so that
+ * queries never modify the graph: its ranges end with free slots, which are
+ * handed out to new in-edges and borrowed by nearby nodes.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ROOT-Sim/topology.h>
+#include <arena.h>
+
+/// An invalid edge index, used as error value for the functions which look up an edge
+#define INVALID_EDGE SIZE_MAX
+
+/// The out-edges and the in-edges of a graph node, while the graph is still being built
+struct graph_row {
+	lp_id_t *neighbors;         /**< The IDs of the neighbors */
+	double *probabilities;      /**< The probability to traverse each edge */
+	void **data;                /**< Custom user data associated with each edge, allocated on first use */
+	uint32_t size;              /**< The number of edges in this row */
+	uint32_t capacity;          /**< The number of edges the arrays can keep */
+	uint32_t *index;            /**< Hash index of the edges by neighbor, only for high-degree rows */
+	lp_id_t *sources;           /**< The IDs of the nodes having an edge towards this one, in increasing order */
+	uint32_t sources_size;      /**< The number of in-edges */
+	uint32_t sources_capacity;  /**< The number of in-edges the sources array can keep */
+	unsigned char **attributes; /**< The attribute columns of this row, each allocated on first use */
+	uint32_t attributes_size;   /**< The number of entries in the attributes array */
+};
+
+/// The adjacency of a graph topology
+struct graph {
+	lp_id_t regions;                   /**< The number of nodes in the graph */
+	struct graph_row *rows;            /**< The staging rows, NULL once the graph is finalized */
+	struct arena arena;                /**< The arena the arrays of the staging rows are allocated from */
+	uint64_t *offsets;                 /**< CSR: the edges of node i are in [offsets[i], offsets[i + 1]) */
+	lp_id_t *neighbors;                /**< CSR: the IDs of the neighbors, without compact IDs */
+	uint32_t *neighbors_compact;       /**< CSR: the IDs of the neighbors, with compact IDs */
+	double *probabilities;             /**< CSR: the probability to traverse each edge, with PRECISION_DOUBLE */
+	float *probabilities_float;        /**< CSR: the probability to traverse each edge, with PRECISION_FLOAT */
+	uint16_t *thresholds;              /**< CSR: the cumulative share of each edge, with PRECISION_FIXED16 */
+	float *totals;                     /**< The total probability of the edges of each node, with PRECISION_FIXED16 */
+	void **data;                       /**< CSR: custom user data, NULL if no edge has data attached */
+	double *alias_probabilities;       /**< CSR: the probability to keep each alias table column */
+	uint32_t *alias_indices;           /**< CSR: the edge each alias table column redirects to */
+	double *cumulative;                /**< CSR: the cumulative share of each edge, with SAMPLING_CUMULATIVE */
+	uint64_t *in_offsets;              /**< Transposed CSR: the in-edges of node i are in [in_offsets[i], in_offsets[i + 1]) */
+	lp_id_t *in_sources;               /**< Transposed CSR: the sources of the in-edges, without compact IDs */
+	uint32_t *in_sources_compact;      /**< Transposed CSR: the sources of the in-edges, with compact IDs */
+	uint64_t *index_offsets;           /**< The hash index of node i is in [index_offsets[i], index_offsets[i + 1]) */
+	uint32_t *index_slots;             /**< Hash indexes of the edges by neighbor, only for high-degree nodes */
+	uint32_t *removed;                 /**< The dead slots at the end of the CSR range of each node, may be NULL */
+	uint64_t removed_edges;            /**< The total number of dead slots in the CSR arrays */
+	uint32_t *in_removed;              /**< The free slots at the end of each transposed CSR range, may be NULL */
+	enum topology_sampling sampling;   /**< The algorithm used to pick a random neighbor */
+	enum topology_precision precision; /**< The storage format of the probabilities, once finalized */
+	unsigned attributes;               /**< The number of edge attribute columns */
+	size_t *attribute_sizes;           /**< The size of the values of each edge attribute column */
+	unsigned char **attribute_columns; /**< CSR: the values of each edge attribute column */
+	void *mapping;                     /**< The file the CSR arrays are mapped from, NULL if they are allocated */
+	size_t mapping_size;               /**< The size of the file the CSR arrays are mapped from */
+};
+
+/**
+ * @brief A view over the sources of the in-edges of a graph node, in increasing order
+ *
+ * Exactly one of the two arrays is used, depending on whether the graph keeps
+ * compact IDs: graph_source() reads either.
+ */
+struct graph_sources {
+	const lp_id_t *sources;          /**< The IDs of the sources, NULL with compact IDs */
+	const uint32_t *sources_compact; /**< The 32-bit IDs of the sources, NULL without compact IDs */
+	size_t size;                     /**< The number of sources */
+};
+
+/**
+ * @brief A view over the out-edges of a graph node, independent of the graph representation
+ *
+ * Probabilities are not part of the view, since their storage format depends
+ * on the precision of the graph: they are accessed through
+ * graph_get_probability() and graph_set_probability(). Likewise, exactly one
+ * of the two neighbor arrays is used, and graph_neighbor() reads either.
+ */
+struct graph_edges {
+	const lp_id_t *neighbors;          /**< The IDs of the neighbors, NULL with compact IDs */
+	const uint32_t *neighbors_compact; /**< The 32-bit IDs of the neighbors, NULL without compact IDs */
+	void **data;                       /**< Custom user data associated with each edge, may be NULL */
+	size_t size;                       /**< The number of edges */
+};
+
+extern struct graph *graph_new(lp_id_t regions);
+extern void graph_release(struct graph *graph);
+extern bool graph_finalize(struct graph *graph);
+extern bool graph_build(struct graph *graph, size_t n, uint64_t *keys, uint64_t *probabilities);
+extern size_t graph_find_edge(const struct graph *graph, lp_id_t from, lp_id_t to);
+extern size_t graph_add_edge(struct graph *graph, lp_id_t from, lp_id_t to);
+extern bool graph_add_edges(struct graph *graph, size_t n, const lp_id_t from[], const lp_id_t to[],
+    const double probabilities[], void *const data[]);
+extern bool graph_set_edge_data(struct graph *graph, lp_id_t from, size_t edge, void *data);
+extern bool graph_remove_edge(struct graph *graph, lp_id_t from, size_t edge);
+extern bool graph_rewire_edge(struct graph *graph, lp_id_t from, size_t edge, lp_id_t to);
+extern unsigned graph_add_attribute(struct graph *graph, size_t size);
+extern void *graph_attribute(struct graph *graph, unsigned attribute, lp_id_t from);
+extern double graph_get_probability(const struct graph *graph, lp_id_t from, size_t edge);
+extern void graph_set_probability(struct graph *graph, lp_id_t from, size_t edge, double probability);
+extern void graph_normalize(struct graph *graph);
+extern bool graph_set_precision(struct graph *graph, enum topology_precision precision);
+extern bool graph_permute(struct graph *graph, const lp_id_t *order, const lp_id_t *rank);
+extern bool graph_set_sampling(struct graph *graph, enum topology_sampling sampling);
+extern bool graph_build_sampling(struct graph *graph);
+extern void graph_build_node_sampling(struct graph *graph, lp_id_t from);
+extern size_t graph_sample(const struct graph *graph, lp_id_t from, double rand);
+extern struct graph_sources graph_in_edges(const struct graph *graph, lp_id_t to);
+
+/**
+ * @brief Tell whether a graph has been packed in its CSR representation
+ * @param graph the graph to check
+ * @return true if the graph has been finalized, false otherwise
+ */
+static inline bool graph_is_finalized(const struct graph *graph)
+{
+	return graph->rows == NULL;
+}
+
+/**
+ * @brief Tell whether graph_sample() draws a neighbor without scanning the out-edges of the node
+ * @param graph the graph to check
+ * @return true if the graph is finalized with alias tables, cumulative distributions or binary-searched thresholds
+ */
+static inline bool graph_has_fast_sampling(const struct graph *graph)
+{
+	return graph_is_finalized(graph) &&
+	       (graph->alias_probabilities != NULL || graph->cumulative != NULL ||
+		   (graph->precision == PRECISION_FIXED16 && graph->sampling != SAMPLING_LINEAR));
+}
+
+/**
+ * @brief Tell whether a graph is mapped read-only from a topology file
+ * @param graph the graph to check
+ * @return true if the graph is mapped from a file, false otherwise
+ */
+static inline bool graph_is_mapped(const struct graph *graph)
+{
+	return graph->mapping != NULL;
+}
+
+/**
+ * @brief Tell whether the CSR arrays of a graph keep node IDs in 32 bits
+ *
+ * Staging rows always keep full-width IDs, so this only affects finalized graphs.
+ *
+ * @param graph the graph to check
+ * @return true if every node ID of the graph fits in 32 bits, false otherwise
+ */
+static inline bool graph_has_compact_ids(const struct graph *graph)
+{
+	return graph->regions - 1 <= UINT32_MAX;
+}
+
+/**
+ * @brief Count the in-edges of a node
+ * @param graph the graph to inspect
+ * @param to the node whose in-edges are counted
+ * @return the number of in-edges of @p to
+ */
+static inline size_t graph_in_degree(const struct graph *graph, lp_id_t to)
+{
+	if(graph_is_finalized(graph))
+		return graph->in_offsets[to + 1] - graph->in_offsets[to] -
+		       (graph->in_removed != NULL ? graph->in_removed[to] : 0);
+	return graph->rows[to].sources_size;
+}
+
+/**
+ * @brief Count the live out-edges of a node
+ * @param graph the graph to inspect
+ * @param from the node whose out-edges are counted
+ * @return the number of out-edges of @p from
+ */
+static inline size_t graph_out_degree(const struct graph *graph, lp_id_t from)
+{
+	if(graph_is_finalized(graph))
+		return graph->offsets[from + 1] - graph->offsets[from] - (graph->removed != NULL ? graph->removed[from] : 0);
+	return graph->rows[from].size;
+}
+
+/**
+ * @brief Get a view over the out-edges of a node
+ * @param graph the graph to inspect
+ * @param from the node whose out-edges are requested
+ * @return a view over the out-edges of @p from
+ */
+static inline struct graph_edges graph_out_edges(const struct graph *graph, lp_id_t from)
+{
+	struct graph_edges ret;
+
+	if(graph_is_finalized(graph)) {
+		uint64_t first = graph->offsets[from];
+		if(graph_has_compact_ids(graph)) {
+			ret.neighbors = NULL;
+			ret.neighbors_compact = graph->neighbors_compact + first;
+		} else {
+			ret.neighbors = graph->neighbors + first;
+			ret.neighbors_compact = NULL;
+		}
+		ret.data = graph->data != NULL ? graph->data + first : NULL;
+		ret.size = graph_out_degree(graph, from);
+	} else {
+		const struct graph_row *row = &graph->rows[from];
+		ret.neighbors = row->neighbors;
+		ret.neighbors_compact = NULL;
+		ret.data = row->data;
+		ret.size = row->size;
+	}
+	return ret;
+}
+
+/**
+ * @brief Prefetch the CSR offsets of a node of a finalized graph
+ * @param graph the graph to inspect
+ * @param from the node whose offsets are prefetched
+ */
+static inline void graph_prefetch_offsets(const struct graph *graph, lp_id_t from)
+{
+	__builtin_prefetch(graph->offsets + from);
+	if(graph->removed != NULL)
+		__builtin_prefetch(graph->removed + from);
+}
+
+/**
+ * @brief Prefetch the out-edges of a node of a finalized graph, and the tables to sample them
+ *
+ * This reads the CSR offsets of @p from, so it pays off once they have been
+ * prefetched with graph_prefetch_offsets().
+ *
+ * @param graph the graph to inspect
+ * @param from the node whose out-edges are prefetched
+ */
+static inline void graph_prefetch_edges(const struct graph *graph, lp_id_t from)
+{
+	uint64_t first = graph->offsets[from];
+
+	if(graph_has_compact_ids(graph))
+		__builtin_prefetch(graph->neighbors_compact + first);
+	else
+		__builtin_prefetch(graph->neighbors + first);
+
+	if(graph->alias_probabilities != NULL) {
+		__builtin_prefetch(graph->alias_probabilities + first);
+		__builtin_prefetch(graph->alias_indices + first);
+	} else if(graph->cumulative != NULL) {
+		__builtin_prefetch(graph->cumulative + first);
+	} else if(graph->thresholds != NULL) {
+		__builtin_prefetch(graph->thresholds + first);
+	} else if(graph->probabilities_float != NULL) {
+		__builtin_prefetch(graph->probabilities_float + first);
+	} else if(graph->probabilities != NULL) {
+		__builtin_prefetch(graph->probabilities + first);
+	}
+}
+
+/**
+ * @brief Get the neighbor of an out-edge of a node
+ * @param edges the view over the out-edges of the node
+ * @param edge the index of the edge in the view
+ * @return the ID of the destination of the edge
+ */
+static inline lp_id_t graph_neighbor(const struct graph_edges *edges, size_t edge)
+{
+	return edges->neighbors_compact != NULL ? edges->neighbors_compact[edge] : edges->neighbors[edge];
+}
+
+/**
+ * @brief Get the source of an in-edge of a node
+ * @param sources the view over the in-edges of the node
+ * @param edge the index of the in-edge in the view
+ * @return the ID of the source of the in-edge
+ */
+static inline lp_id_t graph_source(const struct graph_sources *sources, size_t edge)
+{
+	return sources->sources_compact != NULL ? sources->sources_compact[edge] : sources->sources[edge];
+}
@@ -12,12 +12,15 @@
  */
 #pragma once
 
+#include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 typedef uint64_t lp_id_t;
 
 struct topology;
+struct topology_builder;
 
 enum topology_geometry {
 	TOPOLOGY_HEXAGON = 1,	//!< hexagonal grid topology
@@ -43,23 +46,110 @@ enum topology_direction {
 	DIRECTION_RANDOM, //!< Get a random direction, depending on the topology
 };
 
+/// The algorithm used to pick a random neighbor in a TOPOLOGY_GRAPH
+enum topology_sampling {
+	SAMPLING_ALIAS,      //!< Constant-time sampling through per-node alias tables, built when the graph is finalized
+	SAMPLING_LINEAR,     //!< Linear scan of the cumulative link probabilities
+	SAMPLING_CUMULATIVE, //!< Binary search of per-node cumulative distributions, built when the graph is finalized
+};
+
+/// The node orderings ReorderTopology() can relabel a TOPOLOGY_GRAPH with
+enum topology_order {
+	ORDER_RCM,    //!< Reverse Cuthill-McKee, which keeps the IDs of adjacent nodes within a narrow band
+	ORDER_DEGREE, //!< Decreasing number of links, which packs the hubs together
+	ORDER_BFS,    //!< Breadth-first visit order, starting from the lowest ID of every connected component
+};
+
+/// The storage format of the link probabilities of a finalized TOPOLOGY_GRAPH
+enum topology_precision {
+	PRECISION_DOUBLE,  //!< Double precision probabilities, 8 bytes per link
+	PRECISION_FLOAT,   //!< Single precision probabilities, 4 bytes per link
+	PRECISION_FIXED16, //!< 16-bit fixed-point cumulative thresholds, 2 bytes per link plus 4 bytes per node
+};
+
+/// The text formats graph topologies can be loaded from
+enum topology_format {
+	FORMAT_EDGE_LIST,     //!< One "from to [weight]" line per link, with 0-based node IDs
+	FORMAT_DIMACS,        //!< DIMACS shortest path graph (.gr), with 1-based node IDs
+	FORMAT_MATRIX_MARKET, //!< Matrix Market coordinate matrix (.mtx), every entry being a link
+	FORMAT_METIS,         //!< METIS graph, listing the neighbors of every node on its own line
+};
+
+/// The quality of a partition computed by PartitionTopology()
+struct topology_partition_stats {
+	uint64_t cut_links;  //!< The number of links between regions assigned to different parts
+	double remote_share; //!< The expected share of messages crossing parts, if every region sends as many messages
+	double imbalance;    //!< The size of the largest part divided by the average size of a part
+};
+
+/// A random state owned by the caller, for reentrant random queries
+struct topology_rng {
+	uint64_t state[4]; //!< The state of the xoshiro256** generator, set by InitializeTopologyRng()
+};
+
 /// An invalid direction, used as error value for the functions which return a LP id
 #define INVALID_DIRECTION UINT64_MAX
+/// An invalid link attribute, used as error value by AddTopologyAttribute()
+#define INVALID_ATTRIBUTE UINT_MAX
 
 extern lp_id_t CountRegions(struct topology *topology);
 extern lp_id_t CountDirections(struct topology *topology, lp_id_t from);
 extern lp_id_t GetReceiver(struct topology *topology, lp_id_t from, enum topology_direction direction);
 extern void GetAllReceivers(struct topology *topology, lp_id_t from, lp_id_t *receivers);
+extern lp_id_t GetRandomReceivers(struct topology *topology, lp_id_t from, lp_id_t k, lp_id_t receivers[]);
+extern lp_id_t GetRandomReceiversWithRng(struct topology *topology, lp_id_t from, lp_id_t k, lp_id_t receivers[],
+    struct topology_rng *rng);
+extern void InitializeTopologyRng(struct topology_rng *rng, uint64_t seed, uint64_t index);
+extern lp_id_t GetReceiverWithRng(struct topology *topology, lp_id_t from, enum topology_direction direction,
+    struct topology_rng *rng);
+extern lp_id_t GetReceiverForEvent(struct topology *topology, lp_id_t from, enum topology_direction direction,
+    uint64_t seed, uint64_t event);
+extern void GetReceiversBatch(struct topology *topology, size_t n, const lp_id_t from[],
+    const enum topology_direction directions[], lp_id_t receivers[], struct topology_rng *rng);
 
 extern lp_id_t CountSources(struct topology *topology, lp_id_t me);
 extern void GetAllSources(struct topology *topology, lp_id_t to, lp_id_t *sources);
 
 extern void ReleaseTopology(struct topology *topology);
+extern bool FinalizeTopology(struct topology *topology);
+extern bool SaveTopology(struct topology *topology, const char *path);
+extern struct topology *MapTopology(const char *path);
+extern struct topology *LoadTopology(const char *path, enum topology_format format, bool weights);
+extern struct topology *GenerateErdosRenyiTopology(lp_id_t regions, double probability, uint64_t seed);
+extern struct topology *GenerateBarabasiAlbertTopology(lp_id_t regions, unsigned links, uint64_t seed);
+extern struct topology *GenerateWattsStrogatzTopology(lp_id_t regions, unsigned neighbors, double rewiring,
+    uint64_t seed);
+extern struct topology *GenerateRmatTopology(unsigned scale, uint64_t links, double a, double b, double c,
+    uint64_t seed);
+extern struct topology *GenerateGeometricTopology(lp_id_t regions, double radius, bool torus, uint64_t seed);
+extern struct topology *GenerateStochasticBlockTopology(unsigned blocks, const lp_id_t sizes[],
+    const double probabilities[], uint64_t seed, unsigned block[]);
+extern bool GetRegionPosition(struct topology *topology, lp_id_t region, double *x, double *y);
 extern bool AddTopologyLink(struct topology *topology, lp_id_t from, lp_id_t to, double probability);
+extern bool RemoveTopologyLink(struct topology *topology, lp_id_t from, lp_id_t to);
+extern bool RewireTopologyLink(struct topology *topology, lp_id_t from, lp_id_t to, lp_id_t new_to);
+extern bool AddTopologyLinks(struct topology *topology, size_t n, const lp_id_t from[], const lp_id_t to[],
+    const double probabilities[], void *const data[]);
+extern struct topology_builder *InitializeTopologyBuilder(struct topology *topology, unsigned threads);
+extern bool AddTopologyBuilderLink(struct topology_builder *builder, unsigned thread, lp_id_t from, lp_id_t to,
+    double probability);
+extern bool CommitTopologyBuilder(struct topology_builder *builder);
 extern bool IsNeighbor(struct topology *topology, lp_id_t from, lp_id_t to);
 extern bool NormalizeLinkProbabilities(struct topology *topology);
+extern bool SetTopologyWeights(struct topology *topology, bool weights);
+extern bool SetTopologySampling(struct topology *topology, enum topology_sampling sampling);
+extern bool SetTopologyPrecision(struct topology *topology, enum topology_precision precision);
+extern bool ReorderTopology(struct topology *topology, enum topology_order order, lp_id_t *old_to_new,
+    lp_id_t *new_to_old);
+extern bool PartitionTopology(struct topology *topology, unsigned parts, double balance, unsigned part[],
+    struct topology_partition_stats *stats);
 bool SetTopologyLinkData(struct topology *topology, lp_id_t from, lp_id_t to, void *data);
 void *GetTopologyLinkData(struct topology *topology, lp_id_t from, lp_id_t to);
+extern unsigned AddTopologyAttribute(struct topology *topology, size_t size);
+extern void *GetTopologyLinkAttribute(struct topology *topology, unsigned attribute, lp_id_t from, lp_id_t to);
+extern bool GetTopologyLinkAttributes(struct topology *topology, unsigned attribute, lp_id_t from, void *values);
+extern bool SetTopologyLinkAttributes(struct topology *topology, unsigned attribute, lp_id_t from,
+    const void *values);
 
 
 // The following trick belongs to Laurent Deniau at CERN.
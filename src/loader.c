@@ -0,0 +1,665 @@
+/**
+ * @file src/loader.c
+ *
+ * @brief Graph file loaders
+ *
+ * Streaming parsers of the most common text formats for graphs. Files are
+ * read in fixed-size chunks and parsed in place, so that only the edges, and
+ * never the whole text, are kept in memory.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ROOT-Sim/topology.h>
+#include <likely.h>
+
+/// The size of the chunks graph files are read in
+#define LOADER_CHUNK_SIZE ((size_t)1 << 20)
+/// The initial number of edges the edge buffer can keep
+#define LOADER_INITIAL_EDGES 1024
+/// The longest number which can be parsed
+#define LOADER_MAX_NUMBER 128
+
+/// A buffered reader returning a text file line by line
+struct reader {
+	FILE *file;       /**< The file being read */
+	const char *path; /**< The path of the file, for error messages */
+	char *buffer;     /**< The chunk of the file being parsed */
+	size_t capacity;  /**< The size of the buffer */
+	size_t begin;     /**< The first unparsed byte in the buffer */
+	size_t end;       /**< The end of the valid bytes in the buffer */
+	size_t line;      /**< The number of the last line returned */
+	bool eof;         /**< Whether the whole file has been read in the buffer */
+	bool failed;      /**< Whether reading the file failed */
+};
+
+/// The edges read from a graph file
+struct edge_buffer {
+	lp_id_t *from;     /**< The sources of the edges */
+	lp_id_t *to;       /**< The destinations of the edges */
+	double *weights;   /**< The weights of the edges */
+	size_t size;       /**< The number of edges */
+	size_t capacity;   /**< The number of edges the arrays can keep */
+	double max_weight; /**< The largest weight of the edges */
+};
+
+
+/**
+ * @brief Get the next line of a file
+ *
+ * If the current chunk only contains the beginning of a line, the beginning
+ * is moved to the front of the buffer and the rest of the chunk is refilled.
+ * The buffer only grows if a single line does not fit in it.
+ *
+ * @param r the reader to read from
+ * @param line where to store the pointer to the first character of the line
+ * @param line_end where to store the pointer past the last character of the
+ * line, excluding the line terminator
+ * @return true if a line was returned, false at the end of the file or on error
+ */
+static bool reader_next(struct reader *r, const char **line, const char **line_end)
+{
+	for(;;) {
+		char *newline = memchr(r->buffer + r->begin, '\n', r->end - r->begin);
+		if(likely(newline != NULL) || (r->eof && r->begin != r->end)) {
+			char *last = newline != NULL ? newline : r->buffer + r->end;
+			*line = r->buffer + r->begin;
+			r->begin = last - r->buffer + (newline != NULL);
+			if(last != *line && last[-1] == '\r')
+				last--;
+			*line_end = last;
+			r->line++;
+			return true;
+		}
+		if(r->eof)
+			return false;
+
+		memmove(r->buffer, r->buffer + r->begin, r->end - r->begin);
+		r->end -= r->begin;
+		r->begin = 0;
+
+		if(unlikely(r->end == r->capacity)) {
+			char *buffer = realloc(r->buffer, 2 * r->capacity);
+			if(buffer == NULL) {
+				fprintf(stderr, "[ERROR] Unable to allocate memory to read %s.", r->path);
+				r->failed = true;
+				return false;
+			}
+			r->buffer = buffer;
+			r->capacity *= 2;
+		}
+
+		size_t read = fread(r->buffer + r->end, 1, r->capacity - r->end, r->file);
+		r->end += read;
+		if(read == 0) {
+			if(ferror(r->file)) {
+				fprintf(stderr, "[ERROR] Unable to read %s.", r->path);
+				r->failed = true;
+				return false;
+			}
+			r->eof = true;
+		}
+	}
+}
+
+
+/**
+ * @brief Tell whether a character separates the fields of a line
+ * @param c the character to check
+ * @return true if @p c is a blank or a comma, false otherwise
+ */
+static inline bool is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == ',' || c == '\r' || c == '\f' || c == '\v';
+}
+
+
+/**
+ * @brief Skip the separators at the beginning of a string
+ * @param p the beginning of the string
+ * @param end the end of the string
+ * @return a pointer to the first character which is not a separator
+ */
+static inline const char *skip_blanks(const char *p, const char *end)
+{
+	while(p < end && is_blank(*p))
+		p++;
+	return p;
+}
+
+
+/**
+ * @brief Tell whether a line has no more fields
+ * @param p the current position in the line
+ * @param end the end of the line
+ * @return true if only separators are left in the line
+ */
+static inline bool at_end(const char *p, const char *end)
+{
+	return skip_blanks(p, end) == end;
+}
+
+
+/**
+ * @brief Parse an unsigned integer field
+ * @param p the current position in the line, advanced past the field on success
+ * @param end the end of the line
+ * @param value where to store the parsed value
+ * @return true on success, false if the field is missing or malformed
+ */
+static bool parse_uint(const char **p, const char *end, uint64_t *value)
+{
+	const char *s = skip_blanks(*p, end);
+	uint64_t v = 0;
+
+	if(unlikely(s == end || *s < '0' || *s > '9'))
+		return false;
+
+	do {
+		unsigned digit = (unsigned)(*s - '0');
+		if(unlikely(v > (UINT64_MAX - digit) / 10))
+			return false;
+		v = v * 10 + digit;
+		s++;
+	} while(s < end && *s >= '0' && *s <= '9');
+
+	if(unlikely(s < end && !is_blank(*s)))
+		return false;
+
+	*p = s;
+	*value = v;
+	return true;
+}
+
+
+/**
+ * @brief Parse a real number field
+ *
+ * Numbers whose significant digits fit in the mantissa of a double, and
+ * whose decimal exponent has a small magnitude, are converted exactly with
+ * a single multiplication or division. All other numbers are handed to
+ * strtod().
+ *
+ * @param p the current position in the line, advanced past the field on success
+ * @param end the end of the line
+ * @param value where to store the parsed value
+ * @return true on success, false if the field is missing or malformed
+ */
+static bool parse_double(const char **p, const char *end, double *value)
+{
+	static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13,
+	    1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	const char *s = skip_blanks(*p, end), *start = s;
+	uint64_t mantissa = 0;
+	int exponent = 0, digits = 0;
+	bool negative = false, exact = true;
+
+	if(s < end && (*s == '-' || *s == '+'))
+		negative = *s++ == '-';
+
+	for(; s < end && *s >= '0' && *s <= '9'; s++, digits++) {
+		if(mantissa < (UINT64_C(1) << 53) / 10)
+			mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+		else
+			exact = false;
+	}
+	if(s < end && *s == '.') {
+		for(s++; s < end && *s >= '0' && *s <= '9'; s++, digits++) {
+			if(mantissa < (UINT64_C(1) << 53) / 10) {
+				mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+				exponent--;
+			} else {
+				exact = false;
+			}
+		}
+	}
+	if(unlikely(digits == 0))
+		return false;
+
+	if(s < end && (*s == 'e' || *s == 'E')) {
+		bool negative_exponent = false;
+		int e = 0;
+
+		s++;
+		if(s < end && (*s == '-' || *s == '+'))
+			negative_exponent = *s++ == '-';
+		if(unlikely(s == end || *s < '0' || *s > '9'))
+			return false;
+		for(; s < end && *s >= '0' && *s <= '9'; s++)
+			if(e < 10000)
+				e = e * 10 + (*s - '0');
+		exponent += negative_exponent ? -e : e;
+	}
+
+	if(unlikely(s < end && !is_blank(*s)))
+		return false;
+
+	if(likely(exact && exponent >= -22 && exponent <= 22)) {
+		double v = (double)mantissa;
+		v = exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+		*value = negative ? -v : v;
+	} else {
+		char number[LOADER_MAX_NUMBER];
+		if(unlikely((size_t)(s - start) >= sizeof(number)))
+			return false;
+		memcpy(number, start, s - start);
+		number[s - start] = '\0';
+		*value = strtod(number, NULL);
+	}
+
+	*p = s;
+	return true;
+}
+
+
+/**
+ * @brief Append an edge to an edge buffer
+ * @param edges the buffer to append to
+ * @param from the source of the edge
+ * @param to the destination of the edge
+ * @param weight the weight of the edge
+ * @return true on success, false if memory could not be allocated
+ */
+static bool push_edge(struct edge_buffer *edges, lp_id_t from, lp_id_t to, double weight)
+{
+	if(unlikely(edges->size == edges->capacity)) {
+		size_t capacity = edges->capacity ? 2 * edges->capacity : LOADER_INITIAL_EDGES;
+		lp_id_t *f = realloc(edges->from, capacity * sizeof(*f));
+		if(f != NULL)
+			edges->from = f;
+		lp_id_t *t = realloc(edges->to, capacity * sizeof(*t));
+		if(t != NULL)
+			edges->to = t;
+		double *w = realloc(edges->weights, capacity * sizeof(*w));
+		if(w != NULL)
+			edges->weights = w;
+		if(f == NULL || t == NULL || w == NULL) {
+			fprintf(stderr, "[ERROR] Unable to allocate memory for the links.");
+			return false;
+		}
+		edges->capacity = capacity;
+	}
+
+	edges->from[edges->size] = from;
+	edges->to[edges->size] = to;
+	edges->weights[edges->size] = weight;
+	edges->size++;
+	if(weight > edges->max_weight)
+		edges->max_weight = weight;
+	return true;
+}
+
+
+/**
+ * @brief Report a malformed line of a graph file
+ * @param r the reader which returned the line
+ * @return false, to be returned by the caller
+ */
+static bool malformed(const struct reader *r)
+{
+	fprintf(stderr, "[ERROR] Malformed line %zu in %s.", r->line, r->path);
+	return false;
+}
+
+
+/**
+ * @brief Parse an edge list
+ *
+ * Every line holds the 0-based source and destination of an edge, optionally
+ * followed by its weight. Fields are separated by blanks or commas. Empty
+ * lines, and lines starting with '#' or '%', are ignored.
+ *
+ * @param r the reader to parse
+ * @param edges the buffer to store edges in
+ * @param regions where to store the number of nodes, one more than the largest node ID
+ * @return true on success, false otherwise
+ */
+static bool parse_edge_list(struct reader *r, struct edge_buffer *edges, uint64_t *regions)
+{
+	const char *p, *end;
+	uint64_t max_id = 0;
+	bool any = false;
+
+	while(reader_next(r, &p, &end)) {
+		uint64_t from, to;
+		double weight = 1.0;
+
+		p = skip_blanks(p, end);
+		if(p == end || *p == '#' || *p == '%')
+			continue;
+
+		if(!parse_uint(&p, end, &from) || !parse_uint(&p, end, &to) ||
+		    (!at_end(p, end) && !parse_double(&p, end, &weight)) || !at_end(p, end))
+			return malformed(r);
+
+		if(from > max_id)
+			max_id = from;
+		if(to > max_id)
+			max_id = to;
+		any = true;
+		if(!push_edge(edges, from, to, weight))
+			return false;
+	}
+
+	*regions = any ? max_id + 1 : 0;
+	return !r->failed;
+}
+
+
+/**
+ * @brief Parse a DIMACS shortest path graph
+ *
+ * The file holds a problem line "p sp <nodes> <arcs>" followed by arc lines
+ * "a <from> <to> <weight>" with 1-based node IDs. Lines starting with 'c'
+ * are comments.
+ *
+ * @param r the reader to parse
+ * @param edges the buffer to store edges in
+ * @param regions where to store the number of nodes
+ * @return true on success, false otherwise
+ */
+static bool parse_dimacs(struct reader *r, struct edge_buffer *edges, uint64_t *regions)
+{
+	const char *p, *end;
+	uint64_t nodes = 0, arcs;
+
+	*regions = 0;
+	while(reader_next(r, &p, &end)) {
+		uint64_t from, to;
+		double weight = 1.0;
+
+		p = skip_blanks(p, end);
+		if(p == end || *p == 'c')
+			continue;
+
+		if(*p == 'p') {
+			// The problem type is not checked, since several are in use
+			for(p++, p = skip_blanks(p, end); p < end && !is_blank(*p); p++)
+				;
+			if(nodes != 0 || !parse_uint(&p, end, &nodes) || !parse_uint(&p, end, &arcs) || !at_end(p, end))
+				return malformed(r);
+			continue;
+		}
+
+		if(*p != 'a' || nodes == 0)
+			return malformed(r);
+		p++;
+		if(!parse_uint(&p, end, &from) || !parse_uint(&p, end, &to) ||
+		    (!at_end(p, end) && !parse_double(&p, end, &weight)) || !at_end(p, end))
+			return malformed(r);
+		if(from == 0 || from > nodes || to == 0 || to > nodes)
+			return malformed(r);
+		if(!push_edge(edges, from - 1, to - 1, weight))
+			return false;
+	}
+
+	*regions = nodes;
+	return !r->failed;
+}
+
+
+/**
+ * @brief Compare a token of a line with a lowercase word, ignoring case
+ * @param p the current position in the line, advanced past the token
+ * @param end the end of the line
+ * @param word the lowercase word to compare against
+ * @return true if the token matches @p word, false otherwise
+ */
+static bool match_token(const char **p, const char *end, const char *word)
+{
+	const char *s = skip_blanks(*p, end);
+	size_t len = strlen(word);
+
+	if((size_t)(end - s) < len)
+		return false;
+	for(size_t i = 0; i < len; i++)
+		if((s[i] >= 'A' && s[i] <= 'Z' ? s[i] - 'A' + 'a' : s[i]) != word[i])
+			return false;
+	if(s + len < end && !is_blank(s[len]))
+		return false;
+	*p = s + len;
+	return true;
+}
+
+
+/**
+ * @brief Parse a Matrix Market coordinate matrix
+ *
+ * Every entry (i, j) of the matrix becomes an edge from node i - 1 to node
+ * j - 1, weighted with the value of the entry, if any. For symmetric,
+ * skew-symmetric and Hermitian matrices, the mirrored edges are added too.
+ * The weights of skew-symmetric matrices are taken in absolute value.
+ *
+ * @param r the reader to parse
+ * @param edges the buffer to store edges in
+ * @param regions where to store the number of nodes, the largest matrix dimension
+ * @return true on success, false otherwise
+ */
+static bool parse_matrix_market(struct reader *r, struct edge_buffer *edges, uint64_t *regions)
+{
+	const char *p, *end;
+	uint64_t rows = 0, columns = 0, entries;
+	bool pattern, symmetric, skew;
+
+	*regions = 0;
+	if(!reader_next(r, &p, &end) || !match_token(&p, end, "%%matrixmarket") ||
+	    !match_token(&p, end, "matrix") || !match_token(&p, end, "coordinate"))
+		return r->failed ? false : malformed(r);
+
+	pattern = match_token(&p, end, "pattern");
+	if(!pattern && !match_token(&p, end, "real") && !match_token(&p, end, "integer"))
+		return malformed(r);
+
+	skew = match_token(&p, end, "skew-symmetric");
+	symmetric = skew || match_token(&p, end, "symmetric") || match_token(&p, end, "hermitian");
+	if(!symmetric && !match_token(&p, end, "general"))
+		return malformed(r);
+
+	while(reader_next(r, &p, &end)) {
+		uint64_t i, j;
+		double weight = 1.0;
+
+		p = skip_blanks(p, end);
+		if(p == end || *p == '%')
+			continue;
+
+		if(rows == 0) {
+			if(!parse_uint(&p, end, &rows) || !parse_uint(&p, end, &columns) ||
+			    !parse_uint(&p, end, &entries) || !at_end(p, end) || rows == 0 || columns == 0)
+				return malformed(r);
+			continue;
+		}
+
+		if(!parse_uint(&p, end, &i) || !parse_uint(&p, end, &j) ||
+		    (!pattern && !parse_double(&p, end, &weight)) || !at_end(p, end))
+			return malformed(r);
+		if(i == 0 || i > rows || j == 0 || j > columns)
+			return malformed(r);
+		if(skew)
+			weight = fabs(weight);
+		if(!push_edge(edges, i - 1, j - 1, weight) || (symmetric && i != j && !push_edge(edges, j - 1, i - 1, weight)))
+			return false;
+	}
+
+	*regions = rows > columns ? rows : columns;
+	return !r->failed;
+}
+
+
+/**
+ * @brief Parse a METIS graph
+ *
+ * The header "<nodes> <edges> [<fmt> [<ncon>]]" is followed by one line per
+ * node, listing its 1-based neighbors. Depending on @c fmt, every line starts
+ * with the size and the @c ncon weights of the node, which are skipped, and
+ * every neighbor is followed by the weight of the edge. Lines starting with
+ * '%' are comments.
+ *
+ * @param r the reader to parse
+ * @param edges the buffer to store edges in
+ * @param regions where to store the number of nodes
+ * @return true on success, false otherwise
+ */
+static bool parse_metis(struct reader *r, struct edge_buffer *edges, uint64_t *regions)
+{
+	const char *p, *end;
+	uint64_t nodes = 0, edge_count, fmt = 0, ncon = 0, node = 0;
+	bool header = false;
+
+	*regions = 0;
+	while(reader_next(r, &p, &end)) {
+		if(p < end && *p == '%')
+			continue;
+
+		if(!header) {
+			if(at_end(p, end))
+				continue;
+			if(!parse_uint(&p, end, &nodes) || !parse_uint(&p, end, &edge_count) ||
+			    (!at_end(p, end) && !parse_uint(&p, end, &fmt)) ||
+			    (!at_end(p, end) && !parse_uint(&p, end, &ncon)) || !at_end(p, end))
+				return malformed(r);
+			if(fmt % 10 > 1 || fmt / 10 % 10 > 1 || fmt / 100 > 1)
+				return malformed(r);
+			if(fmt / 10 % 10 && ncon == 0)
+				ncon = 1;
+			header = true;
+			continue;
+		}
+
+		if(node == nodes) {
+			if(at_end(p, end))
+				continue;
+			return malformed(r);
+		}
+
+		uint64_t skip = (fmt / 100) + (fmt / 10 % 10 ? ncon : 0);
+		for(uint64_t k = 0; k < skip; k++) {
+			double ignored;
+			if(!parse_double(&p, end, &ignored))
+				return malformed(r);
+		}
+
+		while(!at_end(p, end)) {
+			uint64_t to;
+			double weight = 1.0;
+
+			if(!parse_uint(&p, end, &to) || (fmt % 10 && !parse_double(&p, end, &weight)))
+				return malformed(r);
+			if(to == 0 || to > nodes)
+				return malformed(r);
+			if(!push_edge(edges, node, to - 1, weight))
+				return false;
+		}
+		node++;
+	}
+
+	if(r->failed)
+		return false;
+	if(node != nodes) {
+		fprintf(stderr, "[ERROR] Missing node lines in %s.", r->path);
+		return false;
+	}
+	*regions = nodes;
+	return true;
+}
+
+
+/**
+ * @brief Load a graph topology from a text file
+ *
+ * The file is read in fixed-size chunks and parsed as it is read. If
+ * @p weights is true, the probability of every link is proportional to the
+ * weight of the corresponding edge, so that random receivers are picked
+ * proportionally to the weights. Otherwise, or if the file has no weights,
+ * all the links of a node are equally likely. Weights must not be negative.
+ * If the same link appears more than once in the file, the last occurrence
+ * wins.
+ *
+ * The returned topology is finalized, as if FinalizeTopology() had been called.
+ *
+ * @param path    The path of the file to load
+ * @param format  The format of the file
+ * @param weights Whether to derive the link probabilities from the edge weights
+ * @return A pointer to the topology structure, NULL on failure
+ */
+struct topology *LoadTopology(const char *path, enum topology_format format, bool weights)
+{
+	struct topology *topology = NULL;
+	struct edge_buffer edges = {0};
+	struct reader r = {0};
+	uint64_t regions = 0;
+	bool ok;
+
+	r.path = path;
+	r.file = fopen(path, "rb");
+	if(unlikely(r.file == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to open %s.", path);
+		return NULL;
+	}
+	r.capacity = LOADER_CHUNK_SIZE;
+	r.buffer = malloc(r.capacity);
+	if(unlikely(r.buffer == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory to read %s.", path);
+		goto out;
+	}
+
+	switch(format) {
+		case FORMAT_EDGE_LIST:
+			ok = parse_edge_list(&r, &edges, &regions);
+			break;
+		case FORMAT_DIMACS:
+			ok = parse_dimacs(&r, &edges, &regions);
+			break;
+		case FORMAT_MATRIX_MARKET:
+			ok = parse_matrix_market(&r, &edges, &regions);
+			break;
+		case FORMAT_METIS:
+			ok = parse_metis(&r, &edges, &regions);
+			break;
+		default:
+			fprintf(stderr, "[ERROR] Unexpected graph file format.");
+			goto out;
+	}
+	if(!ok)
+		goto out;
+
+	if(unlikely(regions == 0 || regions > UINT_MAX)) {
+		fprintf(stderr, "[ERROR] Unsupported number of nodes in %s.", path);
+		goto out;
+	}
+
+	for(size_t i = 0; i < edges.size; i++) {
+		if(unlikely(!(edges.weights[i] >= 0 && edges.weights[i] <= DBL_MAX))) {
+			fprintf(stderr, "[ERROR] Invalid edge weight in %s.", path);
+			goto out;
+		}
+		if(!weights)
+			edges.weights[i] = 1.0;
+		else if(edges.max_weight > 0)
+			edges.weights[i] /= edges.max_weight;
+	}
+
+	topology = InitializeTopology(TOPOLOGY_GRAPH, (unsigned)regions);
+	if(unlikely(topology == NULL))
+		goto out;
+	if(!AddTopologyLinks(topology, edges.size, edges.from, edges.to, edges.weights, NULL) ||
+	    !FinalizeTopology(topology)) {
+		ReleaseTopology(topology);
+		topology = NULL;
+	}
+
+out:
+	free(edges.from);
+	free(edges.to);
+	free(edges.weights);
+	free(r.buffer);
+	fclose(r.file);
+	return topology;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file src/parallel.h
+ *
+ * @brief Parallel loops
+ *
+ * Thin wrappers around OpenMP work-sharing loops. If the library is built
+ * without OpenMP support, the loops simply run sequentially.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+/// Expand to a pragma whose text is the macro argument
+#define parallel_pragma(x) _Pragma(#x)
+
+#ifdef _OPENMP
+#include <omp.h>
+
+/// Run the iterations of the following loop in parallel, if @p cond holds
+#define parallel_for(cond) parallel_pragma(omp parallel for schedule(static) if(cond))
+/// Run the iterations of the following loop in parallel, balancing iterations of uneven cost, if @p cond holds
+#define parallel_for_dynamic(cond) parallel_pragma(omp parallel for schedule(dynamic, 1024) if(cond))
+/// The number of threads available to parallel loops
+#define parallel_threads() ((unsigned)omp_get_max_threads())
+/// The index of the calling thread, between 0 and parallel_threads() - 1
+#define parallel_thread() ((unsigned)omp_get_thread_num())
+
+#else
+
+/// Run the iterations of the following loop in parallel, if @p cond holds
+#define parallel_for(cond)
+/// Run the iterations of the following loop in parallel, balancing iterations of uneven cost, if @p cond holds
+#define parallel_for_dynamic(cond)
+/// The number of threads available to parallel loops
+#define parallel_threads() 1U
+/// The index of the calling thread, between 0 and parallel_threads() - 1
+#define parallel_thread() 0U
+
+#endif
+
+/// The minimum amount of work worth spreading over several threads
+#define PARALLEL_MIN_WORK 65536
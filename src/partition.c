@@ -0,0 +1,811 @@
+/**
+ * @file src/partition.c
+ *
+ * @brief Topology partitioning
+ *
+ * Balanced partitions of the regions of a topology which keep linked
+ * regions in the same part. Regular geometries are cut in closed form,
+ * while graphs go through a multilevel partitioner in the spirit of METIS:
+ * the graph is made undirected, weighting every edge with the probabilities
+ * of the links it stands for, and is repeatedly coarsened by collapsing
+ * matched pairs of nodes. The coarsest graph is partitioned by recursive
+ * bisection, and the partition is projected back level by level, moving
+ * boundary nodes to the part they are most connected to at every level.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <partition.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <parallel.h>
+#include <sort.h>
+
+/// Coarsening stops when the graph has no more than this number of nodes per part
+#define COARSEST_NODES_PER_PART 20
+/// The maximum number of levels of the multilevel hierarchy
+#define MAX_LEVELS 64
+/// Coarsening stops when a level keeps more than this share of the nodes of the finer one
+#define MIN_SHRINK 0.95
+/// The number of rounds of handshake matching used to coarsen a level
+#define MATCHING_ROUNDS 4
+/// The maximum number of refinement passes per level
+#define REFINE_PASSES 8
+/// A node which has not been matched yet
+#define UNMATCHED UINT64_MAX
+
+/// A weighted link of an undirected level graph
+struct level_link {
+	lp_id_t node;  /**< The other endpoint of the link */
+	double weight; /**< The weight of the link */
+};
+
+/// An undirected weighted graph, one level of the multilevel hierarchy
+struct level {
+	lp_id_t nodes;            /**< The number of nodes */
+	uint64_t *offsets;        /**< The first link of every node, plus a final sentinel */
+	struct level_link *links; /**< The links of every node, sorted by endpoint */
+	uint64_t *weights;        /**< The number of regions collapsed into every node */
+	lp_id_t *coarse;          /**< The node of the next coarser level every node is collapsed into */
+};
+
+/// The scratch memory a thread needs to evaluate the moves of a node
+struct scratch {
+	double *connection; /**< The weight of the links towards every part, negative for parts not linked */
+	unsigned *linked;   /**< The parts with a non-negative connection */
+};
+
+
+/**
+ * @brief Compute the largest size a part may have
+ * @param total the total size of the parts
+ * @param parts the number of parts
+ * @param balance the largest allowed ratio between the size of a part and the average size
+ * @return the largest size of a part, never below the size of a perfectly balanced part
+ */
+uint64_t partition_max_size(uint64_t total, unsigned parts, double balance)
+{
+	uint64_t even = (total + parts - 1) / parts;
+	double max = floor(balance * (double)total / parts);
+
+	if(max >= (double)total)
+		return total;
+	return (uint64_t)max > even ? (uint64_t)max : even;
+}
+
+
+/**
+ * @brief Cut a range of regions in contiguous blocks of IDs
+ * @param regions the number of regions
+ * @param parts the number of blocks, whose sizes differ by at most one
+ * @param part where to store the block of every region
+ */
+void partition_blocks(lp_id_t regions, unsigned parts, unsigned *part)
+{
+	parallel_for(regions > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < regions; i++)
+		part[i] = (unsigned)(i * parts / regions);
+}
+
+
+/**
+ * @brief Cut a grid in rectangular tiles
+ *
+ * Among the ways of arranging @p parts tiles in rows and columns, the one
+ * with the shortest boundary between tiles is picked, as long as tiles fit
+ * in the grid and respect @p balance. If no arrangement does, the grid is
+ * cut in blocks of rows.
+ *
+ * @param width the width of the grid
+ * @param height the height of the grid
+ * @param wrap true if the grid wraps around, as a torus does
+ * @param parts the number of tiles
+ * @param balance the largest allowed ratio between the size of a tile and the average size
+ * @param part where to store the tile of every cell, in row-major order
+ */
+void partition_grid(uint32_t width, uint32_t height, bool wrap, unsigned parts, double balance, unsigned *part)
+{
+	uint64_t regions = (uint64_t)width * height, max_size = partition_max_size(regions, parts, balance);
+	uint64_t best_cost = UINT64_MAX;
+	unsigned columns = 0, rows = 0;
+
+	for(unsigned x = 1; x <= parts && x <= width; x++) {
+		unsigned y = parts / x;
+		if(x * y != parts || y > height)
+			continue;
+		uint64_t size = (uint64_t)((width + x - 1) / x) * ((height + y - 1) / y);
+		// A torus cut in a single column or row has no boundary across the wrapping links
+		uint64_t cost = (uint64_t)(x - !wrap - (wrap && x == 1)) * height +
+				(uint64_t)(y - !wrap - (wrap && y == 1)) * width;
+		if(size <= max_size && cost < best_cost) {
+			best_cost = cost;
+			columns = x;
+			rows = y;
+		}
+	}
+
+	if(columns == 0) {
+		partition_blocks(regions, parts, part);
+		return;
+	}
+
+	parallel_for(regions > PARALLEL_MIN_WORK)
+	for(uint64_t i = 0; i < regions; i++) {
+		uint64_t y = i / width, x = i % width;
+		part[i] = (unsigned)(y * rows / height * columns + x * columns / width);
+	}
+}
+
+
+/**
+ * @brief Release the memory of a level
+ * @param level the level to release
+ */
+static void release_level(struct level *level)
+{
+	free(level->offsets);
+	free(level->links);
+	free(level->weights);
+	free(level->coarse);
+}
+
+
+/**
+ * @brief Compare two links by endpoint, for qsort()
+ */
+static int compare_links(const void *a, const void *b)
+{
+	const struct level_link *x = a, *y = b;
+	return (x->node > y->node) - (x->node < y->node);
+}
+
+
+/**
+ * @brief Sort the rows of a level, merge the links with the same endpoint and pack the rows
+ * @param level the level to pack, whose offsets bound the rows
+ * @param sizes the number of links filled in every row, with room for one more element, which is consumed
+ * @return true on success, false if memory could not be allocated
+ */
+static bool pack_level(struct level *level, uint64_t *sizes)
+{
+	parallel_for_dynamic(level->nodes > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < level->nodes; i++) {
+		struct level_link *row = level->links + level->offsets[i];
+		uint64_t n = 0;
+		qsort(row, sizes[i], sizeof(*row), compare_links);
+		for(uint64_t j = 0; j < sizes[i]; j++) {
+			if(n != 0 && row[n - 1].node == row[j].node)
+				row[n - 1].weight += row[j].weight;
+			else
+				row[n++] = row[j];
+		}
+		sizes[i] = n;
+	}
+	sizes[level->nodes] = 0;
+
+	uint64_t total = prefix_sum(sizes, level->nodes + 1);
+	struct level_link *links = malloc((total + 1) * sizeof(*links));
+	if(links == NULL) {
+		free(sizes);
+		return false;
+	}
+
+	parallel_for(level->nodes > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < level->nodes; i++)
+		memcpy(links + sizes[i], level->links + level->offsets[i], (sizes[i + 1] - sizes[i]) * sizeof(*links));
+
+	free(level->links);
+	free(level->offsets);
+	level->links = links;
+	level->offsets = sizes;
+	return true;
+}
+
+
+/**
+ * @brief Build the finest level of a graph
+ *
+ * Every link, in either direction, becomes an undirected edge weighted by
+ * its probability, and links between the same nodes are merged. Self-loops
+ * never cross parts, so they are dropped.
+ *
+ * @param level the level to build
+ * @param graph the finalized graph to partition
+ * @return true on success, false if memory could not be allocated
+ */
+static bool build_level(struct level *level, const struct graph *graph)
+{
+	lp_id_t n = graph->regions;
+	uint64_t *sizes = calloc(n + 1, sizeof(*sizes));
+
+	level->nodes = n;
+	level->offsets = calloc(n + 1, sizeof(*level->offsets));
+	level->weights = malloc(n * sizeof(*level->weights));
+	if(sizes == NULL || level->offsets == NULL || level->weights == NULL) {
+		free(sizes);
+		return false;
+	}
+
+	for(lp_id_t i = 0; i < n; i++) {
+		struct graph_edges edges = graph_out_edges(graph, i);
+		for(size_t j = 0; j < edges.size; j++) {
+			lp_id_t to = graph_neighbor(&edges, j);
+			if(to != i) {
+				level->offsets[i]++;
+				level->offsets[to]++;
+			}
+		}
+	}
+	uint64_t total = prefix_sum(level->offsets, n + 1);
+	level->links = malloc((total + 1) * sizeof(*level->links));
+	if(level->links == NULL) {
+		free(sizes);
+		return false;
+	}
+
+	for(lp_id_t i = 0; i < n; i++) {
+		struct graph_edges edges = graph_out_edges(graph, i);
+		for(size_t j = 0; j < edges.size; j++) {
+			lp_id_t to = graph_neighbor(&edges, j);
+			if(to == i)
+				continue;
+			double weight = graph_get_probability(graph, i, j);
+			level->links[level->offsets[i] + sizes[i]++] = (struct level_link){to, weight};
+			level->links[level->offsets[to] + sizes[to]++] = (struct level_link){i, weight};
+		}
+	}
+
+	parallel_for(n > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < n; i++)
+		level->weights[i] = 1;
+
+	return pack_level(level, sizes);
+}
+
+
+/**
+ * @brief Compute a pseudo-random priority of an edge, the same from both endpoints
+ *
+ * Matching breaks ties between equally heavy edges by this priority, so that
+ * regular graphs are matched as well as irregular ones.
+ *
+ * @param a one endpoint of the edge
+ * @param b the other endpoint of the edge
+ * @return the priority of the edge
+ */
+static uint64_t edge_priority(lp_id_t a, lp_id_t b)
+{
+	uint64_t x = (a < b ? a : b) * UINT64_C(0x9E3779B97F4A7C15) ^ (a < b ? b : a);
+	x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return x ^ (x >> 31);
+}
+
+
+/**
+ * @brief Match the nodes of a level along heavy edges
+ *
+ * Handshake matching: in every round, every unmatched node proposes to the
+ * unmatched neighbor it has the heaviest edge to, and mutual proposals are
+ * matched. Rounds are run in parallel, and the result does not depend on the
+ * number of threads.
+ *
+ * @param level the level to match
+ * @param max_weight the largest weight of a matched pair
+ * @param mate where to store the node every node is matched with, the node itself if unmatched
+ * @param proposal scratch memory with room for a node per node
+ */
+static void match(const struct level *level, uint64_t max_weight, lp_id_t *mate, lp_id_t *proposal)
+{
+	parallel_for(level->nodes > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < level->nodes; i++)
+		mate[i] = UNMATCHED;
+
+	for(unsigned round = 0; round < MATCHING_ROUNDS; round++) {
+		parallel_for_dynamic(level->nodes > PARALLEL_MIN_WORK)
+		for(lp_id_t i = 0; i < level->nodes; i++) {
+			double best = -1;
+			uint64_t best_priority = 0;
+
+			proposal[i] = UNMATCHED;
+			if(mate[i] != UNMATCHED)
+				continue;
+			for(uint64_t j = level->offsets[i]; j < level->offsets[i + 1]; j++) {
+				const struct level_link *link = &level->links[j];
+				if(mate[link->node] != UNMATCHED || level->weights[i] + level->weights[link->node] > max_weight)
+					continue;
+				uint64_t priority = edge_priority(i, link->node);
+				if(link->weight > best || (link->weight == best && priority > best_priority)) {
+					best = link->weight;
+					best_priority = priority;
+					proposal[i] = link->node;
+				}
+			}
+		}
+
+		parallel_for(level->nodes > PARALLEL_MIN_WORK)
+		for(lp_id_t i = 0; i < level->nodes; i++)
+			if(proposal[i] != UNMATCHED && proposal[proposal[i]] == i)
+				mate[i] = proposal[i];
+	}
+
+	parallel_for(level->nodes > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < level->nodes; i++)
+		if(mate[i] == UNMATCHED)
+			mate[i] = i;
+}
+
+
+/**
+ * @brief Build the next coarser level, collapsing matched pairs of nodes
+ * @param fine the level to coarsen, which gets the map to the coarser level
+ * @param coarse the level to build
+ * @param max_weight the largest weight of a node of the coarser level
+ * @return true on success, false if memory could not be allocated
+ */
+static bool coarsen(struct level *fine, struct level *coarse, uint64_t max_weight)
+{
+	lp_id_t n = fine->nodes;
+	lp_id_t *mate = malloc(n * sizeof(*mate));
+	lp_id_t *leaders = malloc(n * sizeof(*leaders));
+	uint64_t *ids = malloc((n + 1) * sizeof(*ids));
+	uint64_t *sizes = NULL;
+	bool ret = false;
+
+	fine->coarse = malloc(n * sizeof(*fine->coarse));
+	if(mate == NULL || leaders == NULL || ids == NULL || fine->coarse == NULL)
+		goto out;
+
+	match(fine, max_weight, mate, leaders);
+
+	// The lower node of every pair leads it, and coarse nodes are numbered after their leaders
+	parallel_for(n > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < n; i++)
+		ids[i] = mate[i] >= i;
+	ids[n] = 0;
+	coarse->nodes = prefix_sum(ids, n + 1);
+
+	parallel_for(n > PARALLEL_MIN_WORK)
+	for(lp_id_t i = 0; i < n; i++) {
+		if(mate[i] >= i)
+			leaders[ids[i]] = i;
+		fine->coarse[i] = ids[mate[i] < i ? mate[i] : i];
+	}
+
+	coarse->offsets = malloc((coarse->nodes + 1) * sizeof(*coarse->offsets));
+	coarse->weights = malloc(coarse->nodes * sizeof(*coarse->weights));
+	sizes = malloc((coarse->nodes + 1) * sizeof(*sizes));
+	if(coarse->offsets == NULL || coarse->weights == NULL || sizes == NULL)
+		goto out;
+
+	parallel_for(coarse->nodes > PARALLEL_MIN_WORK)
+	for(lp_id_t c = 0; c < coarse->nodes; c++) {
+		lp_id_t u = leaders[c], v = mate[u];
+		coarse->offsets[c] = fine->offsets[u + 1] - fine->offsets[u];
+		coarse->weights[c] = fine->weights[u];
+		if(v != u) {
+			coarse->offsets[c] += fine->offsets[v + 1] - fine->offsets[v];
+			coarse->weights[c] += fine->weights[v];
+		}
+	}
+	coarse->offsets[coarse->nodes] = 0;
+	uint64_t total = prefix_sum(coarse->offsets, coarse->nodes + 1);
+	coarse->links = malloc((total + 1) * sizeof(*coarse->links));
+	if(coarse->links == NULL)
+		goto out;
+
+	parallel_for_dynamic(coarse->nodes > PARALLEL_MIN_WORK)
+	for(lp_id_t c = 0; c < coarse->nodes; c++) {
+		lp_id_t members[2] = {leaders[c], mate[leaders[c]]};
+		struct level_link *row = coarse->links + coarse->offsets[c];
+		uint64_t size = 0;
+		for(unsigned m = 0; m < 2 - (members[0] == members[1]); m++) {
+			for(uint64_t j = fine->offsets[members[m]]; j < fine->offsets[members[m] + 1]; j++) {
+				lp_id_t to = fine->coarse[fine->links[j].node];
+				if(to != c)
+					row[size++] = (struct level_link){to, fine->links[j].weight};
+			}
+		}
+		sizes[c] = size;
+	}
+
+	ret = pack_level(coarse, sizes);
+	sizes = NULL;
+out:
+	free(mate);
+	free(leaders);
+	free(ids);
+	free(sizes);
+	return ret;
+}
+
+
+/**
+ * @brief Find the part a node should move to
+ *
+ * A node moves to the part it has the heaviest links to among the ones
+ * which have room for it, if this lowers the weight of the cut edges, or if
+ * it leaves the cut alone and improves the balance.
+ *
+ * @param level the level the node belongs to
+ * @param node the node to move
+ * @param part the part of every node
+ * @param part_weights the weight of every part
+ * @param max_weight the largest weight of a part
+ * @param force true to move the node to the best part with room for it, even if the cut grows
+ * @param scratch the scratch memory of the calling thread
+ * @return the part to move @p node to, its own part if it should stay
+ */
+static unsigned best_part(const struct level *level, lp_id_t node, const unsigned *part,
+    const uint64_t *part_weights, uint64_t max_weight, bool force, const struct scratch *scratch)
+{
+	unsigned own = part[node], ret = own, linked = 0;
+	uint64_t weight = level->weights[node];
+	double best_gain = -INFINITY;
+
+	for(uint64_t j = level->offsets[node]; j < level->offsets[node + 1]; j++) {
+		unsigned p = part[level->links[j].node];
+		if(scratch->connection[p] < 0) {
+			scratch->connection[p] = 0;
+			scratch->linked[linked++] = p;
+		}
+		scratch->connection[p] += level->links[j].weight;
+	}
+
+	double internal = scratch->connection[own] < 0 ? 0 : scratch->connection[own];
+	for(unsigned i = 0; i < linked; i++) {
+		unsigned p = scratch->linked[i];
+		double gain = scratch->connection[p] - internal;
+		scratch->connection[p] = -1;
+		if(p == own || part_weights[p] + weight > max_weight)
+			continue;
+		if(gain > best_gain || (gain == best_gain && part_weights[p] < part_weights[ret])) {
+			best_gain = gain;
+			ret = p;
+		}
+	}
+
+	if(ret != own && !force && best_gain <= 0 &&
+	    (best_gain < 0 || part_weights[ret] + weight >= part_weights[own]))
+		ret = own;
+	return ret;
+}
+
+
+/**
+ * @brief Move a node to another part
+ * @param level the level the node belongs to
+ * @param node the node to move
+ * @param to the part to move @p node to
+ * @param part the part of every node
+ * @param part_weights the weight of every part
+ */
+static void move_node(const struct level *level, lp_id_t node, unsigned to, unsigned *part, uint64_t *part_weights)
+{
+	part_weights[part[node]] -= level->weights[node];
+	part_weights[to] += level->weights[node];
+	part[node] = to;
+}
+
+
+/**
+ * @brief Move nodes out of the parts which are too heavy
+ *
+ * Nodes of a part above the weight limit move to the linked part which
+ * loses the least, or to the lightest part if no linked part has room.
+ * With unit node weights, as on the finest level, this always succeeds.
+ *
+ * @param level the level to balance
+ * @param parts the number of parts
+ * @param max_weight the largest weight of a part
+ * @param part the part of every node
+ * @param part_weights the weight of every part
+ * @param scratch the scratch memory of the calling thread
+ */
+static void rebalance(const struct level *level, unsigned parts, uint64_t max_weight, unsigned *part,
+    uint64_t *part_weights, const struct scratch *scratch)
+{
+	unsigned heavy = 0;
+
+	for(unsigned p = 0; p < parts; p++)
+		heavy += part_weights[p] > max_weight;
+
+	for(lp_id_t i = 0; heavy != 0 && i < level->nodes; i++) {
+		unsigned own = part[i], to;
+		if(part_weights[own] <= max_weight)
+			continue;
+
+		to = best_part(level, i, part, part_weights, max_weight, true, scratch);
+		if(to == own) {
+			for(unsigned p = 0; p < parts; p++)
+				to = part_weights[p] < part_weights[to] ? p : to;
+			if(part_weights[to] + level->weights[i] > max_weight)
+				continue;
+		}
+		move_node(level, i, to, part, part_weights);
+		heavy -= part_weights[own] <= max_weight;
+	}
+}
+
+
+/**
+ * @brief Refine a partition by greedily moving boundary nodes
+ *
+ * The moves of all the nodes are evaluated in parallel against the current
+ * partition, and are then applied one after the other, evaluating them again
+ * so that every applied move lowers the cut or improves the balance.
+ *
+ * @param level the level to refine
+ * @param max_weight the largest weight of a part
+ * @param part the part of every node
+ * @param part_weights the weight of every part
+ * @param moves scratch memory with room for a part per node
+ * @param scratch the scratch memory of every thread
+ */
+static void refine(const struct level *level, uint64_t max_weight, unsigned *part, uint64_t *part_weights,
+    unsigned *moves, const struct scratch *scratch)
+{
+	for(unsigned pass = 0; pass < REFINE_PASSES; pass++) {
+		bool moved = false;
+
+		parallel_for_dynamic(level->nodes > PARALLEL_MIN_WORK)
+		for(lp_id_t i = 0; i < level->nodes; i++)
+			moves[i] = best_part(level, i, part, part_weights, max_weight, false, &scratch[parallel_thread()]);
+
+		for(lp_id_t i = 0; i < level->nodes; i++) {
+			if(moves[i] == part[i])
+				continue;
+			unsigned to = best_part(level, i, part, part_weights, max_weight, false, scratch);
+			if(to != part[i]) {
+				move_node(level, i, to, part, part_weights);
+				moved = true;
+			}
+		}
+
+		if(!moved)
+			break;
+	}
+}
+
+
+/// The state of the recursive bisection of the coarsest level
+struct bisection {
+	const struct level *level; /**< The level being partitioned */
+	unsigned *part;            /**< The part of every node, the first part of its subset while it is bisected */
+	lp_id_t *queue;            /**< The queue of the breadth-first visits */
+	uint64_t *visited;         /**< The last visit which reached every node */
+	uint64_t visit;            /**< The number of visits started so far */
+};
+
+
+/**
+ * @brief Visit a subset breadth-first and find the node farthest from the root
+ * @param bisection the state of the bisection
+ * @param root the node to start from
+ * @param subset the part the nodes of the subset are assigned to
+ * @return the last node reached by the visit
+ */
+static lp_id_t farthest(struct bisection *bisection, lp_id_t root, unsigned subset)
+{
+	const struct level *level = bisection->level;
+	lp_id_t head = 0, tail = 0, node = root;
+
+	bisection->visited[root] = ++bisection->visit;
+	bisection->queue[tail++] = root;
+	while(head < tail) {
+		node = bisection->queue[head++];
+		for(uint64_t j = level->offsets[node]; j < level->offsets[node + 1]; j++) {
+			lp_id_t next = level->links[j].node;
+			if(bisection->part[next] == subset && bisection->visited[next] != bisection->visit) {
+				bisection->visited[next] = bisection->visit;
+				bisection->queue[tail++] = next;
+			}
+		}
+	}
+	return node;
+}
+
+
+/**
+ * @brief Split a subset of the coarsest level in parts by recursive bisection
+ *
+ * The first half of the parts grows breadth-first from a pseudo-peripheral
+ * node of the subset until it reaches its share of the weight, jumping to
+ * another node of the subset when its connected component is exhausted.
+ * Both halves are then split in turn.
+ *
+ * @param bisection the state of the bisection
+ * @param nodes the nodes of the subset, all assigned to part @p first, which are reordered
+ * @param n the number of nodes of the subset
+ * @param first the first part to split the subset in
+ * @param parts the number of parts to split the subset in
+ */
+static void bisect(struct bisection *bisection, lp_id_t *nodes, lp_id_t n, unsigned first, unsigned parts)
+{
+	const struct level *level = bisection->level;
+	unsigned left = parts / 2, right = first + left;
+	uint64_t total = 0, weight = 0;
+	lp_id_t head = 0, tail = 0, seed = 0, split = 0;
+
+	if(parts == 1 || n == 0)
+		return;
+
+	for(lp_id_t i = 0; i < n; i++) {
+		bisection->part[nodes[i]] = right;
+		total += level->weights[nodes[i]];
+	}
+	uint64_t target = total * left / parts;
+	lp_id_t root = farthest(bisection, farthest(bisection, nodes[0], right), right);
+
+	bisection->visited[root] = ++bisection->visit;
+	bisection->queue[tail++] = root;
+	while(weight < target) {
+		if(head == tail) {
+			while(seed < n && (bisection->part[nodes[seed]] != right ||
+			    bisection->visited[nodes[seed]] == bisection->visit))
+				seed++;
+			if(seed == n)
+				break;
+			bisection->visited[nodes[seed]] = bisection->visit;
+			bisection->queue[tail++] = nodes[seed];
+		}
+
+		lp_id_t node = bisection->queue[head++];
+		// Nodes which would overshoot the target more than they fill it are left to the other half
+		if(2 * (target - weight) < level->weights[node])
+			continue;
+		bisection->part[node] = first;
+		weight += level->weights[node];
+		for(uint64_t j = level->offsets[node]; j < level->offsets[node + 1]; j++) {
+			lp_id_t next = level->links[j].node;
+			if(bisection->part[next] == right && bisection->visited[next] != bisection->visit) {
+				bisection->visited[next] = bisection->visit;
+				bisection->queue[tail++] = next;
+			}
+		}
+	}
+
+	for(lp_id_t i = 0; i < n; i++) {
+		if(bisection->part[nodes[i]] == first) {
+			lp_id_t swap = nodes[split];
+			nodes[split++] = nodes[i];
+			nodes[i] = swap;
+		}
+	}
+	bisect(bisection, nodes, split, first, left);
+	bisect(bisection, nodes + split, n - split, right, parts - left);
+}
+
+
+/**
+ * @brief Partition the coarsest level by recursive bisection
+ * @param level the level to partition
+ * @param parts the number of parts
+ * @param part where to store the part of every node
+ * @param part_weights where to store the weight of every part
+ * @return true on success, false if memory could not be allocated
+ */
+static bool initial_partition(const struct level *level, unsigned parts, unsigned *part, uint64_t *part_weights)
+{
+	struct bisection bisection = {
+		.level = level,
+		.part = part,
+		.queue = malloc(level->nodes * sizeof(*bisection.queue)),
+		.visited = calloc(level->nodes, sizeof(*bisection.visited)),
+	};
+	lp_id_t *nodes = malloc(level->nodes * sizeof(*nodes));
+	bool ret = bisection.queue != NULL && bisection.visited != NULL && nodes != NULL;
+
+	if(ret) {
+		for(lp_id_t i = 0; i < level->nodes; i++) {
+			nodes[i] = i;
+			part[i] = 0;
+		}
+		bisect(&bisection, nodes, level->nodes, 0, parts);
+
+		memset(part_weights, 0, parts * sizeof(*part_weights));
+		for(lp_id_t i = 0; i < level->nodes; i++)
+			part_weights[part[i]] += level->weights[i];
+	}
+
+	free(bisection.queue);
+	free(bisection.visited);
+	free(nodes);
+	return ret;
+}
+
+
+/**
+ * @brief Partition a graph with a multilevel algorithm
+ *
+ * Links are weighted by their probability, or by their weight if the graph
+ * takes weights, so that the links which carry most messages are the least
+ * likely to be cut. Every part gets at most partition_max_size() nodes.
+ *
+ * @param graph the finalized graph to partition
+ * @param parts the number of parts, between 1 and the number of nodes of @p graph
+ * @param balance the largest allowed ratio between the size of a part and the average size
+ * @param part where to store the part of every node
+ * @return true on success, false if memory could not be allocated
+ */
+bool partition_graph(const struct graph *graph, unsigned parts, double balance, unsigned *part)
+{
+	if(parts == 1) {
+		memset(part, 0, graph->regions * sizeof(*part));
+		return true;
+	}
+
+	struct level levels[MAX_LEVELS] = {0};
+	unsigned depth = 1, threads = parallel_threads();
+	uint64_t max_weight = partition_max_size(graph->regions, parts, balance);
+	// Coarse nodes stay light enough for the coarsest level to be balanced
+	uint64_t max_node_weight = 3 * graph->regions / (2 * COARSEST_NODES_PER_PART * (uint64_t)parts) + 1;
+	uint64_t *part_weights = malloc(parts * sizeof(*part_weights));
+	unsigned *moves = malloc(graph->regions * sizeof(*moves));
+	unsigned *coarse_part = NULL, *fine_part = NULL;
+	struct scratch scratch[threads];
+	bool ret = false;
+
+	memset(scratch, 0, sizeof(scratch));
+	for(unsigned t = 0; t < threads; t++) {
+		scratch[t].connection = malloc(parts * sizeof(*scratch[t].connection));
+		scratch[t].linked = malloc(parts * sizeof(*scratch[t].linked));
+		if(scratch[t].connection == NULL || scratch[t].linked == NULL)
+			goto out;
+		for(unsigned p = 0; p < parts; p++)
+			scratch[t].connection[p] = -1;
+	}
+	if(part_weights == NULL || moves == NULL || !build_level(&levels[0], graph))
+		goto out;
+
+	while(depth < MAX_LEVELS && levels[depth - 1].nodes > (uint64_t)COARSEST_NODES_PER_PART * parts) {
+		if(!coarsen(&levels[depth - 1], &levels[depth], max_node_weight))
+			goto out;
+		depth++;
+		if(levels[depth - 1].nodes > MIN_SHRINK * levels[depth - 2].nodes)
+			break;
+	}
+
+	for(unsigned l = depth; l-- > 0;) {
+		fine_part = l == 0 ? part : malloc(levels[l].nodes * sizeof(*fine_part));
+		if(fine_part == NULL)
+			goto out;
+
+		if(l == depth - 1) {
+			if(!initial_partition(&levels[l], parts, fine_part, part_weights))
+				goto out;
+		} else {
+			parallel_for(levels[l].nodes > PARALLEL_MIN_WORK)
+			for(lp_id_t i = 0; i < levels[l].nodes; i++)
+				fine_part[i] = coarse_part[levels[l].coarse[i]];
+			free(coarse_part);
+		}
+		coarse_part = fine_part;
+		fine_part = NULL;
+
+		rebalance(&levels[l], parts, max_weight, coarse_part, part_weights, scratch);
+		refine(&levels[l], max_weight, coarse_part, part_weights, moves, scratch);
+	}
+	coarse_part = NULL;
+	ret = true;
+
+out:
+	if(fine_part != part)
+		free(fine_part);
+	if(coarse_part != part)
+		free(coarse_part);
+	for(unsigned l = 0; l < depth; l++)
+		release_level(&levels[l]);
+	if(depth < MAX_LEVELS)
+		release_level(&levels[depth]);
+	for(unsigned t = 0; t < threads; t++) {
+		free(scratch[t].connection);
+		free(scratch[t].linked);
+	}
+	free(part_weights);
+	free(moves);
+	return ret;
+}
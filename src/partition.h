@@ -0,0 +1,24 @@
+/**
+ * @file src/partition.h
+ *
+ * @brief Topology partitioning
+ *
+ * Balanced partitions of the regions of a topology which keep linked
+ * regions in the same part: closed-form blocks and tiles for the regular
+ * geometries, and a multilevel partitioner for graphs.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <ROOT-Sim/topology.h>
+#include <graph.h>
+
+extern uint64_t partition_max_size(uint64_t total, unsigned parts, double balance);
+extern void partition_blocks(lp_id_t regions, unsigned parts, unsigned *part);
+extern void partition_grid(uint32_t width, uint32_t height, bool wrap, unsigned parts, double balance, unsigned *part);
+extern bool partition_graph(const struct graph *graph, unsigned parts, double balance, unsigned *part);
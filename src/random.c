@@ -12,6 +12,8 @@
  */
 #include <assert.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -53,9 +55,14 @@ int gettimeofday(struct timeval *tp, void *tzp)
 #include <random.h>
 #include <xxtea.h>
 
-struct {
-	uint64_t state[4];
-} ctx = {0};
+/// The master state, which every thread takes its own stream from before jumping it ahead
+struct topology_rng ctx = {0};
+/// The lock protecting the master state
+static atomic_flag ctx_lock = ATOMIC_FLAG_INIT;
+/// The state of the calling thread, used by the queries which take no explicit state
+static _Thread_local struct topology_rng thread_ctx;
+/// Whether the state of the calling thread has been taken from the master state
+static _Thread_local bool thread_ctx_ready;
 
 // clang-format off
 static const uint32_t xxtea_seeding_key[4] = {
@@ -93,9 +100,109 @@ static const uint32_t xxtea_seeding_key[4] = {
        __res;                                                                                                 \
    })
 
+/// A vector of one 64-bit word of every lane of struct random_lanes
+typedef uint64_t lanes_vector __attribute__((vector_size(RANDOM_LANES * sizeof(uint64_t))));
+
+/**
+ * @brief Advance all the lanes by a number of rounds, with vector instructions
+ *
+ * This is a xoshiro256** step where every state word is a vector holding
+ * that word for all the lanes. It is inlined in variants compiled for
+ * different instruction sets, which only differ in the width of the
+ * instructions the vectors are split into.
+ *
+ * @param lanes the lanes to advance
+ * @param values where to store the RANDOM_LANES values of every round, lane after lane
+ * @param rounds the number of rounds
+ */
+__attribute__((always_inline)) static inline void lanes_kernel(struct random_lanes *lanes, uint64_t *values,
+    size_t rounds)
+{
+	lanes_vector s0, s1, s2, s3;
+
+	memcpy(&s0, lanes->state[0], sizeof(s0));
+	memcpy(&s1, lanes->state[1], sizeof(s1));
+	memcpy(&s2, lanes->state[2], sizeof(s2));
+	memcpy(&s3, lanes->state[3], sizeof(s3));
+
+	for(size_t r = 0; r < rounds; r++) {
+		lanes_vector x = s1 * 5;
+		lanes_vector res = ((x << 7) | (x >> 57)) * 9;
+		lanes_vector t = s1 << 17;
+
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = (s3 << 45) | (s3 >> 19);
+		memcpy(values + r * RANDOM_LANES, &res, sizeof(res));
+	}
+
+	memcpy(lanes->state[0], &s0, sizeof(s0));
+	memcpy(lanes->state[1], &s1, sizeof(s1));
+	memcpy(lanes->state[2], &s2, sizeof(s2));
+	memcpy(lanes->state[3], &s3, sizeof(s3));
+}
+
+/**
+ * @brief Advance all the lanes by a number of rounds, one lane after the other
+ *
+ * This is the reference implementation of random_lanes_u64(), which every
+ * vector variant must match bit by bit.
+ *
+ * @param lanes the lanes to advance
+ * @param values where to store the RANDOM_LANES values of every round, lane after lane
+ * @param rounds the number of rounds
+ */
+void random_lanes_scalar(struct random_lanes *lanes, uint64_t *values, size_t rounds)
+{
+	for(unsigned l = 0; l < RANDOM_LANES; l++) {
+		uint64_t state[4] = {lanes->state[0][l], lanes->state[1][l], lanes->state[2][l], lanes->state[3][l]};
+
+		for(size_t r = 0; r < rounds; r++)
+			values[r * RANDOM_LANES + l] = random_u64(state);
+		for(unsigned k = 0; k < 4; k++)
+			lanes->state[k][l] = state[k];
+	}
+}
+
+/// Advance all the lanes, with the vector instructions of the baseline target
+static void lanes_vector_default(struct random_lanes *lanes, uint64_t *values, size_t rounds)
+{
+	lanes_kernel(lanes, values, rounds);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/// Advance all the lanes, with AVX2 instructions
+__attribute__((target("avx2"))) static void lanes_vector_avx2(struct random_lanes *lanes, uint64_t *values,
+    size_t rounds)
+{
+	lanes_kernel(lanes, values, rounds);
+}
+
+/// Advance all the lanes, with AVX-512 instructions
+__attribute__((target("avx512f"))) static void lanes_vector_avx512(struct random_lanes *lanes, uint64_t *values,
+    size_t rounds)
+{
+	lanes_kernel(lanes, values, rounds);
+}
+#endif
+
+/// The widest implementation of random_lanes_u64() the processor supports, picked at startup
+static void (*lanes_rounds)(struct random_lanes *lanes, uint64_t *values, size_t rounds) = lanes_vector_default;
+
 __attribute__((used)) __attribute__((constructor))
 static void init(void)
 {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f"))
+		lanes_rounds = lanes_vector_avx512;
+	else if(__builtin_cpu_supports("avx2"))
+		lanes_rounds = lanes_vector_avx2;
+#endif
+
 	struct timeval t;
 	gettimeofday(&t, NULL);
 	uint64_t master_seed = ((t.tv_sec * 1000000ULL + t.tv_usec) * 1000) % INT64_MAX;
@@ -107,13 +214,36 @@ static void init(void)
 	xxtea_encode((uint32_t *)ctx.state, 8, xxtea_seeding_key);
 }
 
+/**
+ * @brief Get the random state of the calling thread
+ *
+ * On its first call in a thread, the state is copied from the master state,
+ * which is then jumped 2^128 values ahead, so that the streams of different
+ * threads never overlap. The state is private to the thread, so that no
+ * synchronization is needed afterwards.
+ *
+ * @return The random state of the calling thread
+ */
+struct topology_rng *random_thread_rng(void)
+{
+	if(unlikely(!thread_ctx_ready)) {
+		while(atomic_flag_test_and_set_explicit(&ctx_lock, memory_order_acquire))
+			;
+		thread_ctx = ctx;
+		random_stream_jump(&ctx);
+		atomic_flag_clear_explicit(&ctx_lock, memory_order_release);
+		thread_ctx_ready = true;
+	}
+	return &thread_ctx;
+}
+
 /**
  * @brief Return a random 64-bit value
  * @return The random number
  */
 static uint64_t topology_randomU64(void)
 {
-	return random_u64(ctx.state);
+	return random_u64(random_thread_rng()->state);
 }
 
 /**
@@ -142,3 +272,137 @@ int topology_randomrange(int min, int max)
 {
 	return (int)floor(topology_random() * (max - min + 1)) + min;
 }
+
+
+/**
+ * @brief Initialize an independent random stream
+ *
+ * Every (@p seed, @p index) pair starts a different stream, so that a
+ * parallel loop can draw the numbers of every item from its own stream and
+ * give the same results regardless of the number of threads.
+ *
+ * @param stream the stream to initialize
+ * @param seed the seed shared by a family of streams
+ * @param index the index of the stream in its family
+ */
+void random_stream_init(struct topology_rng *stream, uint64_t seed, uint64_t index)
+{
+	uint64_t x = random_mix(seed) ^ random_mix(index + UINT64_C(0x9E3779B97F4A7C15));
+
+	for(unsigned i = 0; i < 4; i++)
+		stream->state[i] = random_mix(x += UINT64_C(0x9E3779B97F4A7C15));
+}
+
+/**
+ * @brief Initialize the stream of an event, as a pure function of its coordinates
+ *
+ * The state is derived from a keyed hash of the seed, of the LP and of the
+ * event counter, built on the SplitMix64 finalizer, so that the numbers
+ * drawn for an event can be drawn again at any time, for instance when the
+ * event is re-executed after a rollback, without saving any state. For a
+ * given seed and LP, different counters always give different streams.
+ *
+ * @param stream the stream to initialize
+ * @param seed the seed of the simulation
+ * @param lp the LP drawing the numbers
+ * @param counter the counter of the event of @p lp drawing the numbers
+ */
+void random_counter_init(struct topology_rng *stream, uint64_t seed, uint64_t lp, uint64_t counter)
+{
+	uint64_t x = random_mix(random_mix(seed ^ random_mix(lp + UINT64_C(0x9E3779B97F4A7C15))) ^ counter);
+
+	for(unsigned i = 0; i < 4; i++)
+		stream->state[i] = random_mix(x += UINT64_C(0x9E3779B97F4A7C15));
+}
+
+/**
+ * @brief Advance a stream by 2^128 values
+ *
+ * This is equivalent to 2^128 calls to random_stream_u64(), and is used to
+ * split a stream into non-overlapping sub-streams.
+ *
+ * @param stream the stream to advance
+ */
+void random_stream_jump(struct topology_rng *stream)
+{
+	static const uint64_t jump[] = {UINT64_C(0x180ec6d33cfd0aba), UINT64_C(0xd5a61266f0c9392c),
+	    UINT64_C(0xa9582618e03fc9aa), UINT64_C(0x39abdc4529b1661c)};
+	uint64_t state[4] = {0};
+
+	for(unsigned i = 0; i < 4; i++) {
+		for(unsigned b = 0; b < 64; b++) {
+			if(jump[i] & UINT64_C(1) << b)
+				for(unsigned k = 0; k < 4; k++)
+					state[k] ^= stream->state[k];
+			(void)random_u64(stream->state);
+		}
+	}
+	memcpy(stream->state, state, sizeof(state));
+}
+
+
+/**
+ * @brief Initialize interleaved random streams
+ *
+ * Lane l draws the same numbers as the stream random_stream_init() starts
+ * from @p seed and index @p index * RANDOM_LANES + l.
+ *
+ * @param lanes the lanes to initialize
+ * @param seed the seed shared by a family of streams
+ * @param index the index of the group of lanes in its family
+ */
+void random_lanes_init(struct random_lanes *lanes, uint64_t seed, uint64_t index)
+{
+	for(unsigned l = 0; l < RANDOM_LANES; l++) {
+		struct topology_rng stream;
+		random_stream_init(&stream, seed, index * RANDOM_LANES + l);
+		for(unsigned k = 0; k < 4; k++)
+			lanes->state[k][l] = stream.state[k];
+	}
+}
+
+/**
+ * @brief Fill an array with random 64-bit values from interleaved streams
+ *
+ * Value i is drawn from lane i % RANDOM_LANES. All the lanes advance by the
+ * same amount, so if @p n is not a multiple of RANDOM_LANES the values drawn
+ * for the last lanes in the last round are discarded. The result does not
+ * depend on the instruction set the processor supports.
+ *
+ * @param lanes the lanes to draw from
+ * @param values where to store the random numbers
+ * @param n the number of random numbers to draw
+ */
+void random_lanes_u64(struct random_lanes *lanes, uint64_t *values, size_t n)
+{
+	uint64_t last[RANDOM_LANES];
+	size_t rounds = n / RANDOM_LANES, left = n % RANDOM_LANES;
+
+	lanes_rounds(lanes, values, rounds);
+	if(left != 0) {
+		lanes_rounds(lanes, last, 1);
+		memcpy(values + rounds * RANDOM_LANES, last, left * sizeof(*last));
+	}
+}
+
+/**
+ * @brief Fill an array with random values in [0,1) from interleaved streams
+ *
+ * Values are drawn as in random_lanes_u64(), and converted as in
+ * random_stream_double().
+ *
+ * @param lanes the lanes to draw from
+ * @param values where to store the random numbers, multiples of 2^-53
+ * @param n the number of random numbers to draw
+ */
+void random_lanes_double(struct random_lanes *lanes, double *values, size_t n)
+{
+	uint64_t chunk[32 * RANDOM_LANES];
+
+	for(size_t i = 0; i < n; i += sizeof(chunk) / sizeof(*chunk)) {
+		size_t size = n - i < sizeof(chunk) / sizeof(*chunk) ? n - i : sizeof(chunk) / sizeof(*chunk);
+		random_lanes_u64(lanes, chunk, size);
+		for(size_t j = 0; j < size; j++)
+			values[i + j] = (double)(chunk[j] >> 11) * 0x1.0p-53;
+	}
+}
@@ -10,7 +10,85 @@
  */
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include <ROOT-Sim/topology.h>
+
+/// The number of interleaved streams of struct random_lanes
+#define RANDOM_LANES 8
+
+/// Interleaved xoshiro256** streams, advanced together so that they map to the lanes of vector registers
+struct random_lanes {
+	uint64_t state[4][RANDOM_LANES]; /**< The states of the streams, word by word */
+};
+
 extern double topology_random(void);
 extern int topology_randomrange(int min, int max);
+extern struct topology_rng *random_thread_rng(void);
+
+extern void random_stream_init(struct topology_rng *stream, uint64_t seed, uint64_t index);
+extern void random_counter_init(struct topology_rng *stream, uint64_t seed, uint64_t lp, uint64_t counter);
+extern void random_stream_jump(struct topology_rng *stream);
+
+extern void random_lanes_init(struct random_lanes *lanes, uint64_t seed, uint64_t index);
+extern void random_lanes_u64(struct random_lanes *lanes, uint64_t *values, size_t n);
+extern void random_lanes_double(struct random_lanes *lanes, double *values, size_t n);
+extern void random_lanes_scalar(struct random_lanes *lanes, uint64_t *values, size_t rounds);
+
+/**
+ * @brief Scramble a 64-bit value, with the finalizer of SplitMix64
+ * @param x the value to scramble
+ * @return the scrambled value, which is a bijective function of @p x
+ */
+static inline uint64_t random_mix(uint64_t x)
+{
+	x = (x ^ (x >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94D049BB133111EB);
+	return x ^ (x >> 31);
+}
+
+/**
+ * @brief Map a random 64-bit value to a range, without divisions
+ * @param random a uniformly distributed 64-bit value
+ * @param n the size of the range
+ * @return a value in [0, @p n)
+ */
+static inline uint64_t random_range(uint64_t random, uint64_t n)
+{
+	__extension__ typedef unsigned __int128 uint128;
+	return (uint64_t)(((uint128)random * n) >> 64);
+}
+
+/**
+ * @brief Return a random 64-bit value from a stream
+ *
+ * This is a xoshiro256** step, inlined since random queries draw a single
+ * value.
+ *
+ * @param stream the stream to draw from
+ * @return The random number
+ */
+static inline uint64_t random_stream_u64(struct topology_rng *stream)
+{
+	uint64_t *s = stream->state;
+	uint64_t x = s[1] * 5, ret = ((x << 7) | (x >> 57)) * 9, t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 45) | (s[3] >> 19);
+	return ret;
+}
+
+/**
+ * @brief Return a random value in [0,1) from a stream, according to a uniform distribution
+ * @param stream the stream to draw from
+ * @return The random number, a multiple of 2^-53
+ */
+static inline double random_stream_double(struct topology_rng *stream)
+{
+	return (double)(random_stream_u64(stream) >> 11) * 0x1.0p-53;
+}
@@ -0,0 +1,219 @@
+/**
+ * @file src/reorder.c
+ *
+ * @brief Graph reordering
+ *
+ * Node orderings which place the neighbors of a node close to it, so that
+ * the IDs of adjacent nodes, and their data, end up close in memory. All the
+ * orderings treat links as undirected, and are deterministic.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <reorder.h>
+
+#include <assert.h>
+#include <stdlib.h>
+
+/// A node along with the key it is sorted by
+struct ranked_node {
+	uint64_t key; /**< The sorting key */
+	lp_id_t id;   /**< The ID of the node */
+};
+
+
+/**
+ * @brief Compare two ranked nodes by key and then by ID, for qsort()
+ */
+static int compare_ranked(const void *a, const void *b)
+{
+	const struct ranked_node *x = a, *y = b;
+	if(x->key != y->key)
+		return (x->key > y->key) - (x->key < y->key);
+	return (x->id > y->id) - (x->id < y->id);
+}
+
+
+/**
+ * @brief Compare two 64-bit integers, for qsort()
+ */
+static int compare_keys(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Count the links of a node in either direction
+ * @param graph the finalized graph to inspect
+ * @param node the node whose links are counted
+ * @return the number of out-edges plus the number of in-edges of @p node
+ */
+static uint64_t node_degree(struct graph *graph, lp_id_t node)
+{
+	return graph_out_degree(graph, node) + graph_in_degree(graph, node);
+}
+
+
+/**
+ * @brief Sort the nodes of a graph by degree
+ * @param graph the finalized graph to inspect
+ * @param descending true to sort by decreasing degree, false to sort by increasing degree
+ * @return the nodes, sorted by degree and then by ID, NULL if memory could not be allocated
+ */
+static struct ranked_node *sort_by_degree(struct graph *graph, bool descending)
+{
+	struct ranked_node *ret = malloc(graph->regions * sizeof(*ret));
+	if(ret == NULL)
+		return NULL;
+
+	for(lp_id_t i = 0; i < graph->regions; i++) {
+		uint64_t degree = node_degree(graph, i);
+		ret[i].key = descending ? UINT64_MAX - degree : degree;
+		ret[i].id = i;
+	}
+	qsort(ret, graph->regions, sizeof(*ret), compare_ranked);
+	return ret;
+}
+
+
+/**
+ * @brief Sort the nodes just discovered by a Cuthill-McKee visit by increasing degree
+ *
+ * Degree and ID are packed in a single key, which requires compact IDs: on
+ * larger graphs the nodes are left in discovery order.
+ *
+ * @param graph the finalized graph being visited
+ * @param nodes the nodes to sort
+ * @param n the number of nodes to sort
+ * @param keys scratch memory with room for @p n keys
+ */
+static void sort_discovered(struct graph *graph, lp_id_t *nodes, size_t n, uint64_t *keys)
+{
+	if(n < 2 || !graph_has_compact_ids(graph))
+		return;
+
+	for(size_t i = 0; i < n; i++) {
+		uint64_t degree = node_degree(graph, nodes[i]);
+		keys[i] = (degree < UINT32_MAX ? degree : UINT32_MAX) << 32 | nodes[i];
+	}
+	qsort(keys, n, sizeof(*keys), compare_keys);
+	for(size_t i = 0; i < n; i++)
+		nodes[i] = keys[i] & UINT32_MAX;
+}
+
+
+/**
+ * @brief Visit a graph breadth-first, one connected component after the other
+ *
+ * The order array doubles as the queue of the visit. Neighbors are reached
+ * through both out-edges and in-edges.
+ *
+ * @param graph the finalized graph to visit
+ * @param starts the candidate roots of the components, in the order they are tried
+ * @param cuthill_mckee true to enqueue the neighbors of every node by increasing degree
+ * @param order where to store the nodes in visit order
+ * @return true on success, false if memory could not be allocated
+ */
+static bool visit(struct graph *graph, const struct ranked_node *starts, bool cuthill_mckee, lp_id_t *order)
+{
+	bool *visited = calloc(graph->regions, sizeof(*visited));
+	uint64_t *keys = cuthill_mckee ? malloc(graph->regions * sizeof(*keys)) : NULL;
+	lp_id_t head = 0, tail = 0;
+
+	if(visited == NULL || (cuthill_mckee && keys == NULL)) {
+		free(visited);
+		free(keys);
+		return false;
+	}
+
+	for(lp_id_t s = 0; s < graph->regions; s++) {
+		lp_id_t root = starts != NULL ? starts[s].id : s;
+		if(visited[root])
+			continue;
+		visited[root] = true;
+		order[tail++] = root;
+
+		while(head < tail) {
+			lp_id_t node = order[head++], discovered = tail;
+			struct graph_edges edges = graph_out_edges(graph, node);
+			for(size_t i = 0; i < edges.size; i++) {
+				lp_id_t next = graph_neighbor(&edges, i);
+				if(!visited[next]) {
+					visited[next] = true;
+					order[tail++] = next;
+				}
+			}
+			struct graph_sources sources = graph_in_edges(graph, node);
+			for(size_t i = 0; i < sources.size; i++) {
+				lp_id_t next = graph_source(&sources, i);
+				if(!visited[next]) {
+					visited[next] = true;
+					order[tail++] = next;
+				}
+			}
+			if(cuthill_mckee)
+				sort_discovered(graph, order + discovered, tail - discovered, keys);
+		}
+	}
+
+	free(visited);
+	free(keys);
+	return true;
+}
+
+
+/**
+ * @brief Compute a locality-improving ordering of the nodes of a graph
+ *
+ * ORDER_BFS visits every component breadth-first from its lowest ID.
+ * ORDER_RCM is the reverse Cuthill-McKee ordering: every component is
+ * visited breadth-first from a node of minimum degree, enqueueing the
+ * neighbors of every node by increasing degree, and the visit order is then
+ * reversed. This keeps the IDs of adjacent nodes within a narrow band.
+ * ORDER_DEGREE sorts the nodes by decreasing degree, so that hubs are
+ * packed together.
+ *
+ * @param graph the finalized graph to reorder
+ * @param order the ordering to compute
+ * @param new_to_old where to store the old ID of every node, indexed by new ID
+ * @return true on success, false if memory could not be allocated
+ */
+bool reorder_compute(struct graph *graph, enum topology_order order, lp_id_t *new_to_old)
+{
+	struct ranked_node *ranked = NULL;
+	bool ret;
+
+	assert(graph_is_finalized(graph));
+
+	switch(order) {
+		case ORDER_DEGREE:
+			ranked = sort_by_degree(graph, true);
+			if(ranked == NULL)
+				return false;
+			for(lp_id_t i = 0; i < graph->regions; i++)
+				new_to_old[i] = ranked[i].id;
+			ret = true;
+			break;
+
+		case ORDER_BFS:
+			ret = visit(graph, NULL, false, new_to_old);
+			break;
+
+		default:
+			ranked = sort_by_degree(graph, false);
+			if(ranked == NULL)
+				return false;
+			ret = visit(graph, ranked, true, new_to_old);
+			for(lp_id_t i = 0; ret && i < graph->regions / 2; i++) {
+				lp_id_t swap = new_to_old[i];
+				new_to_old[i] = new_to_old[graph->regions - 1 - i];
+				new_to_old[graph->regions - 1 - i] = swap;
+			}
+			break;
+	}
+
+	free(ranked);
+	return ret;
+}
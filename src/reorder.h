@@ -0,0 +1,19 @@
+/**
+ * @file src/reorder.h
+ *
+ * @brief Graph reordering
+ *
+ * Node orderings which place the neighbors of a node close to it, so that
+ * the IDs of adjacent nodes, and their data, end up close in memory.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <stdbool.h>
+
+#include <ROOT-Sim/topology.h>
+#include <graph.h>
+
+extern bool reorder_compute(struct graph *graph, enum topology_order order, lp_id_t *new_to_old);
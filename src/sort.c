@@ -0,0 +1,186 @@
+/**
+ * @file src/sort.c
+ *
+ * @brief Radix sort and prefix sum
+ *
+ * A stable LSD radix sort of integer keys carrying a payload, and an exclusive
+ * prefix sum. Both split large inputs across threads when OpenMP is available.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <sort.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <parallel.h>
+
+/// The number of key bits processed by each pass of the radix sort
+#define RADIX_BITS 11
+/// The number of buckets of each pass of the radix sort
+#define RADIX_BUCKETS (1U << RADIX_BITS)
+
+
+/**
+ * @brief Compute the number of bits needed to represent a value
+ * @param max_value the largest value to represent
+ * @return the number of significant bits of @p max_value
+ */
+unsigned bits_needed(uint64_t max_value)
+{
+	unsigned bits = 0;
+
+	while(bits < 64 && (max_value >> bits) != 0)
+		bits++;
+	return bits;
+}
+
+
+/**
+ * @brief Replace an array with its exclusive prefix sum
+ *
+ * The array is split in one block per thread: every block is summed, the
+ * block sums are scanned, and then every block is scanned from its offset.
+ *
+ * @param values the array to scan
+ * @param n the number of elements in the array
+ * @return the sum of all the elements
+ */
+uint64_t prefix_sum(uint64_t *values, size_t n)
+{
+	size_t blocks = n / PARALLEL_MIN_WORK + 1;
+	uint64_t total = 0;
+
+	if(blocks > parallel_threads())
+		blocks = parallel_threads();
+
+	uint64_t block_sums[blocks];
+	size_t block_size = (n + blocks - 1) / blocks;
+
+	parallel_for(blocks > 1)
+	for(size_t b = 0; b < blocks; b++) {
+		size_t end = (b + 1) * block_size < n ? (b + 1) * block_size : n;
+		uint64_t sum = 0;
+		for(size_t i = b * block_size; i < end; i++)
+			sum += values[i];
+		block_sums[b] = sum;
+	}
+
+	for(size_t b = 0; b < blocks; b++) {
+		uint64_t sum = block_sums[b];
+		block_sums[b] = total;
+		total += sum;
+	}
+
+	parallel_for(blocks > 1)
+	for(size_t b = 0; b < blocks; b++) {
+		size_t end = (b + 1) * block_size < n ? (b + 1) * block_size : n;
+		uint64_t sum = block_sums[b];
+		for(size_t i = b * block_size; i < end; i++) {
+			uint64_t v = values[i];
+			values[i] = sum;
+			sum += v;
+		}
+	}
+
+	return total;
+}
+
+
+/**
+ * @brief Sort key/value pairs by key
+ *
+ * This is a least significant digit radix sort, so it is stable: pairs with
+ * the same key keep their relative order. Only the lowest @p key_bits bits of
+ * the keys are inspected, so that small keys are sorted in fewer passes.
+ *
+ * Large inputs are split in one block per thread. In every pass, each thread
+ * counts the digits in its block, the counts are scanned bucket by bucket and
+ * block by block, and then each thread scatters its block. This yields
+ * exactly the same order as a sequential sort.
+ *
+ * @param keys the keys to sort
+ * @param values the payloads to move along with the keys, can be NULL
+ * @param n the number of pairs
+ * @param key_bits the number of significant bits in the keys
+ * @return true on success, false if scratch memory could not be allocated.
+ * In the latter case the pairs are left untouched.
+ */
+bool radix_sort(uint64_t *keys, uint64_t *values, size_t n, unsigned key_bits)
+{
+	uint64_t *src_keys = keys, *src_values = values;
+	size_t blocks = n / PARALLEL_MIN_WORK + 1;
+
+	if(n < 2 || key_bits == 0)
+		return true;
+
+	if(blocks > parallel_threads())
+		blocks = parallel_threads();
+	size_t block_size = (n + blocks - 1) / blocks;
+
+	uint64_t *dst_keys = malloc(n * sizeof(*dst_keys));
+	uint64_t *dst_values = values != NULL ? malloc(n * sizeof(*dst_values)) : NULL;
+	size_t *counts = malloc(blocks * RADIX_BUCKETS * sizeof(*counts));
+	if(dst_keys == NULL || (values != NULL && dst_values == NULL) || counts == NULL) {
+		free(dst_keys);
+		free(dst_values);
+		free(counts);
+		return false;
+	}
+
+	for(unsigned shift = 0; shift < key_bits; shift += RADIX_BITS) {
+		parallel_for(blocks > 1)
+		for(size_t b = 0; b < blocks; b++) {
+			size_t *c = counts + b * RADIX_BUCKETS;
+			size_t end = (b + 1) * block_size < n ? (b + 1) * block_size : n;
+
+			memset(c, 0, RADIX_BUCKETS * sizeof(*c));
+			for(size_t i = b * block_size; i < end; i++)
+				c[(src_keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+		}
+
+		size_t sum = 0;
+		for(unsigned d = 0; d < RADIX_BUCKETS; d++) {
+			for(size_t b = 0; b < blocks; b++) {
+				size_t c = counts[b * RADIX_BUCKETS + d];
+				counts[b * RADIX_BUCKETS + d] = sum;
+				sum += c;
+			}
+		}
+
+		parallel_for(blocks > 1)
+		for(size_t b = 0; b < blocks; b++) {
+			size_t *c = counts + b * RADIX_BUCKETS;
+			size_t end = (b + 1) * block_size < n ? (b + 1) * block_size : n;
+
+			for(size_t i = b * block_size; i < end; i++) {
+				size_t pos = c[(src_keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+				dst_keys[pos] = src_keys[i];
+				if(values != NULL)
+					dst_values[pos] = src_values[i];
+			}
+		}
+
+		uint64_t *t = src_keys;
+		src_keys = dst_keys;
+		dst_keys = t;
+		t = src_values;
+		src_values = dst_values;
+		dst_values = t;
+	}
+	free(counts);
+
+	// After an odd number of passes the sorted pairs sit in the scratch buffers
+	if(src_keys != keys) {
+		memcpy(keys, src_keys, n * sizeof(*keys));
+		if(values != NULL)
+			memcpy(values, src_values, n * sizeof(*values));
+		free(src_keys);
+		free(src_values);
+	} else {
+		free(dst_keys);
+		free(dst_values);
+	}
+	return true;
+}
@@ -0,0 +1,20 @@
+/**
+ * @file src/sort.h
+ *
+ * @brief Radix sort and prefix sum
+ *
+ * A stable LSD radix sort of integer keys carrying a payload, and an exclusive
+ * prefix sum. Both split large inputs across threads when OpenMP is available.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+extern bool radix_sort(uint64_t *keys, uint64_t *values, size_t n, unsigned key_bits);
+extern unsigned bits_needed(uint64_t max_value);
+extern uint64_t prefix_sum(uint64_t *values, size_t n);
@@ -0,0 +1,443 @@
+/**
+ * @file src/storage.c
+ *
+ * @brief Topology files
+ *
+ * A versioned binary format to save topologies and to map them back in memory.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <storage.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <likely.h>
+
+/// The magic string every topology file starts with
+#define STORAGE_MAGIC "RSTOPOLG"
+/// The version of the file format, to be bumped on every incompatible change
+#define STORAGE_VERSION 4
+/// The endianness marker, which reads differently on machines with a different byte order
+#define STORAGE_ENDIANNESS UINT32_C(0x01020304)
+/// The alignment of the arrays in a topology file
+#define STORAGE_ALIGNMENT 64
+
+/// The arrays of a graph kept in a topology file
+enum storage_section {
+	SECTION_OFFSETS,
+	SECTION_NEIGHBORS,
+	SECTION_PROBABILITIES,
+	SECTION_PROBABILITIES_FLOAT,
+	SECTION_THRESHOLDS,
+	SECTION_TOTALS,
+	SECTION_ALIAS_PROBABILITIES,
+	SECTION_ALIAS_INDICES,
+	SECTION_IN_OFFSETS,
+	SECTION_IN_SOURCES,
+	SECTION_INDEX_OFFSETS,
+	SECTION_INDEX_SLOTS,
+	SECTION_NEIGHBORS_COMPACT,
+	SECTION_IN_SOURCES_COMPACT,
+	SECTION_CUMULATIVE,
+	SECTION_COUNT
+};
+
+/// The header of a topology file
+struct storage_header {
+	char magic[8];                     /**< The STORAGE_MAGIC string, not NUL-terminated */
+	uint32_t endianness;               /**< The STORAGE_ENDIANNESS marker */
+	uint32_t version;                  /**< The STORAGE_VERSION of the file format */
+	uint32_t geometry;                 /**< The geometry of the topology */
+	uint32_t sampling;                 /**< The sampling algorithm of a graph */
+	uint64_t regions;                  /**< The number of regions of the topology */
+	uint32_t width;                    /**< The width of the grid */
+	uint32_t height;                   /**< The height of the grid */
+	uint32_t precision;                /**< The storage format of the probabilities of a graph */
+	uint32_t reserved;                 /**< Unused, always zero */
+	uint64_t edges;                    /**< The number of edges of a graph */
+	uint64_t index_slots;              /**< The number of slots of the edge indexes of a graph */
+	uint64_t sections[SECTION_COUNT];  /**< The file offset of each array, 0 if the array is absent */
+	uint64_t checksum;                 /**< The checksum of all the preceding fields */
+};
+
+_Static_assert(sizeof(struct storage_header) == offsetof(struct storage_header, checksum) + sizeof(uint64_t),
+    "The header of a topology file must not be padded");
+
+
+/**
+ * @brief Compute the checksum of a topology file header
+ *
+ * This is the 64-bit FNV-1a hash of all the header fields but the checksum.
+ *
+ * @param header the header to hash
+ * @return the checksum of @p header
+ */
+static uint64_t header_checksum(const struct storage_header *header)
+{
+	const unsigned char *bytes = (const unsigned char *)header;
+	uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+	for(size_t i = 0; i < offsetof(struct storage_header, checksum); i++) {
+		hash ^= bytes[i];
+		hash *= UINT64_C(0x100000001b3);
+	}
+	return hash;
+}
+
+
+/**
+ * @brief Compute the size in bytes of an array of a topology file
+ * @param header the header of the file
+ * @param section the array to measure
+ * @return the size of the array in bytes
+ */
+static uint64_t section_size(const struct storage_header *header, enum storage_section section)
+{
+	switch(section) {
+		case SECTION_OFFSETS:
+		case SECTION_IN_OFFSETS:
+		case SECTION_INDEX_OFFSETS:
+			return (header->regions + 1) * sizeof(uint64_t);
+		case SECTION_NEIGHBORS:
+		case SECTION_IN_SOURCES:
+			return header->edges * sizeof(lp_id_t);
+		case SECTION_PROBABILITIES:
+		case SECTION_ALIAS_PROBABILITIES:
+		case SECTION_CUMULATIVE:
+			return header->edges * sizeof(double);
+		case SECTION_PROBABILITIES_FLOAT:
+			return header->edges * sizeof(float);
+		case SECTION_THRESHOLDS:
+			return header->edges * sizeof(uint16_t);
+		case SECTION_TOTALS:
+			return header->regions * sizeof(float);
+		case SECTION_ALIAS_INDICES:
+		case SECTION_NEIGHBORS_COMPACT:
+		case SECTION_IN_SOURCES_COMPACT:
+			return header->edges * sizeof(uint32_t);
+		case SECTION_INDEX_SLOTS:
+			return header->index_slots * sizeof(uint32_t);
+		default:
+			return 0;
+	}
+}
+
+
+/**
+ * @brief Save a topology to a file
+ *
+ * The data attached to the edges of a graph is not saved, since it is made of
+ * pointers which are meaningless in other processes.
+ *
+ * @param path the path of the file to write
+ * @param shape the geometry and the dimensions of the topology
+ * @param graph the finalized graph of the topology, NULL for other geometries
+ * @return true on success, false otherwise
+ */
+bool storage_save(const char *path, const struct storage_shape *shape, const struct graph *graph)
+{
+	static const char padding[STORAGE_ALIGNMENT] = {0};
+	const void *arrays[SECTION_COUNT] = {0};
+	struct storage_header header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, STORAGE_MAGIC, sizeof(header.magic));
+	header.endianness = STORAGE_ENDIANNESS;
+	header.version = STORAGE_VERSION;
+	header.geometry = shape->geometry;
+	header.regions = shape->regions;
+	header.width = shape->width;
+	header.height = shape->height;
+
+	if(graph != NULL) {
+		header.sampling = graph->sampling;
+		header.precision = graph->precision;
+		header.edges = graph->offsets[graph->regions];
+		if(graph->index_offsets != NULL)
+			header.index_slots = graph->index_offsets[graph->regions];
+		arrays[SECTION_OFFSETS] = graph->offsets;
+		arrays[SECTION_NEIGHBORS] = graph->neighbors;
+		arrays[SECTION_NEIGHBORS_COMPACT] = graph->neighbors_compact;
+		arrays[SECTION_PROBABILITIES] = graph->probabilities;
+		arrays[SECTION_PROBABILITIES_FLOAT] = graph->probabilities_float;
+		arrays[SECTION_THRESHOLDS] = graph->thresholds;
+		arrays[SECTION_TOTALS] = graph->totals;
+		arrays[SECTION_ALIAS_PROBABILITIES] = graph->alias_probabilities;
+		arrays[SECTION_ALIAS_INDICES] = graph->alias_indices;
+		arrays[SECTION_CUMULATIVE] = graph->cumulative;
+		arrays[SECTION_IN_OFFSETS] = graph->in_offsets;
+		arrays[SECTION_IN_SOURCES] = graph->in_sources;
+		arrays[SECTION_IN_SOURCES_COMPACT] = graph->in_sources_compact;
+		arrays[SECTION_INDEX_OFFSETS] = graph->index_offsets;
+		arrays[SECTION_INDEX_SLOTS] = graph->index_slots;
+	}
+
+	uint64_t position = (sizeof(header) + STORAGE_ALIGNMENT - 1) / STORAGE_ALIGNMENT * STORAGE_ALIGNMENT;
+	for(enum storage_section s = 0; s < SECTION_COUNT; s++) {
+		if(arrays[s] == NULL)
+			continue;
+		header.sections[s] = position;
+		position += (section_size(&header, s) + STORAGE_ALIGNMENT - 1) / STORAGE_ALIGNMENT * STORAGE_ALIGNMENT;
+	}
+	header.checksum = header_checksum(&header);
+
+	FILE *file = fopen(path, "wb");
+	if(unlikely(file == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to open %s for writing.", path);
+		return false;
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	position = sizeof(header);
+	for(enum storage_section s = 0; ok && s < SECTION_COUNT; s++) {
+		if(header.sections[s] == 0)
+			continue;
+		uint64_t size = section_size(&header, s);
+		ok = fwrite(padding, 1, header.sections[s] - position, file) == header.sections[s] - position &&
+		     fwrite(arrays[s], 1, size, file) == size;
+		position = header.sections[s] + size;
+	}
+
+	if(fclose(file) != 0)
+		ok = false;
+	if(unlikely(!ok)) {
+		fprintf(stderr, "[ERROR] Unable to write to %s.", path);
+		remove(path);
+	}
+	return ok;
+}
+
+
+/**
+ * @brief Map the whole content of a file in memory, read-only
+ *
+ * Where mmap() is available the pages of the file are shared with the page
+ * cache, otherwise the file is read into a private buffer.
+ *
+ * @param path the path of the file to map
+ * @param size where to store the size of the file
+ * @return the address the file is mapped at, NULL on failure
+ */
+static void *map_file(const char *path, size_t *size)
+{
+	void *ret;
+	struct stat info;
+
+#ifdef _WIN32
+	FILE *file = fopen(path, "rb");
+	if(file == NULL)
+		return NULL;
+	if(stat(path, &info) != 0 || (ret = malloc(info.st_size)) == NULL) {
+		fclose(file);
+		return NULL;
+	}
+	if(fread(ret, 1, info.st_size, file) != (size_t)info.st_size) {
+		free(ret);
+		ret = NULL;
+	}
+	fclose(file);
+#else
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+	if(fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return NULL;
+	}
+	ret = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ret == MAP_FAILED)
+		return NULL;
+#endif
+
+	*size = info.st_size;
+	return ret;
+}
+
+
+/**
+ * @brief Release a file mapped by storage_map()
+ * @param mapping the address the file is mapped at
+ * @param size the size of the file
+ */
+void storage_unmap(void *mapping, size_t size)
+{
+#ifdef _WIN32
+	(void)size;
+	free(mapping);
+#else
+	munmap(mapping, size);
+#endif
+}
+
+
+/**
+ * @brief Check the header of a topology file
+ * @param header the header to check
+ * @param size the size of the whole file
+ * @return a description of the first problem found, NULL if the header is valid
+ */
+static const char *check_header(const struct storage_header *header, size_t size)
+{
+	if(size < sizeof(*header) || memcmp(header->magic, STORAGE_MAGIC, sizeof(header->magic)) != 0)
+		return "not a topology file";
+	if(header->endianness != STORAGE_ENDIANNESS)
+		return "written on a machine with a different byte order";
+	if(header->version != STORAGE_VERSION)
+		return "written with an unsupported version of the file format";
+	if(header->checksum != header_checksum(header))
+		return "corrupted header";
+	if(header->geometry > TOPOLOGY_GRAPH || header->regions == 0)
+		return "invalid topology";
+	if(header->geometry != TOPOLOGY_GRAPH)
+		return NULL;
+
+	if(header->sampling != SAMPLING_ALIAS && header->sampling != SAMPLING_LINEAR &&
+	    header->sampling != SAMPLING_CUMULATIVE)
+		return "invalid sampling algorithm";
+	if(header->precision > PRECISION_FIXED16)
+		return "invalid probability precision";
+	if(header->regions >= SIZE_MAX / sizeof(uint64_t) || header->edges >= SIZE_MAX / sizeof(double) ||
+	    header->index_slots >= SIZE_MAX / sizeof(uint32_t))
+		return "truncated file";
+
+	// Graphs keep node IDs in 32 bits whenever they fit, see graph_has_compact_ids()
+	bool compact = header->regions - 1 <= UINT32_MAX;
+	for(enum storage_section s = 0; s < SECTION_COUNT; s++) {
+		bool required = s == SECTION_OFFSETS || s == SECTION_IN_OFFSETS;
+		if(compact)
+			required |= s == SECTION_NEIGHBORS_COMPACT || s == SECTION_IN_SOURCES_COMPACT;
+		else
+			required |= s == SECTION_NEIGHBORS || s == SECTION_IN_SOURCES;
+		switch(header->precision) {
+			case PRECISION_DOUBLE:
+				required |= s == SECTION_PROBABILITIES;
+				break;
+			case PRECISION_FLOAT:
+				required |= s == SECTION_PROBABILITIES_FLOAT;
+				break;
+			default:
+				required |= s == SECTION_THRESHOLDS || s == SECTION_TOTALS;
+				break;
+		}
+		if(header->sections[s] == 0) {
+			if(required && section_size(header, s) != 0)
+				return "missing graph arrays";
+			continue;
+		}
+		if(header->sections[s] % STORAGE_ALIGNMENT != 0 || header->sections[s] > size ||
+		    section_size(header, s) > size - header->sections[s])
+			return "truncated file";
+	}
+	if((header->sections[SECTION_ALIAS_PROBABILITIES] == 0) != (header->sections[SECTION_ALIAS_INDICES] == 0) ||
+	    (header->sections[SECTION_INDEX_OFFSETS] == 0) != (header->sections[SECTION_INDEX_SLOTS] == 0))
+		return "missing graph arrays";
+	return NULL;
+}
+
+
+/**
+ * @brief Map a topology file in memory
+ *
+ * The arrays of a graph are used in place, so loading a topology costs time
+ * independent of its size, and concurrent processes mapping the same file
+ * share a single copy of it. The returned graph is read-only.
+ *
+ * @param path the path of the file to map
+ * @param shape where to store the geometry and the dimensions of the topology
+ * @param graph where to store the graph of the topology, set to NULL for other geometries
+ * @return true on success, false otherwise
+ */
+bool storage_map(const char *path, struct storage_shape *shape, struct graph **graph)
+{
+	size_t size;
+	void *mapping = map_file(path, &size);
+
+	if(unlikely(mapping == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to map %s.", path);
+		return false;
+	}
+
+	const struct storage_header *header = mapping;
+	const char *problem = check_header(header, size);
+	if(unlikely(problem != NULL)) {
+		fprintf(stderr, "[ERROR] Unable to map %s: %s.", path, problem);
+		storage_unmap(mapping, size);
+		return false;
+	}
+
+	shape->geometry = header->geometry;
+	shape->regions = header->regions;
+	shape->width = header->width;
+	shape->height = header->height;
+	*graph = NULL;
+
+	if(shape->geometry != TOPOLOGY_GRAPH) {
+		storage_unmap(mapping, size);
+		return true;
+	}
+
+	struct graph *g = calloc(1, sizeof(*g));
+	if(unlikely(g == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for the topology.");
+		storage_unmap(mapping, size);
+		return false;
+	}
+
+	char *base = mapping;
+	const uint64_t *sections = header->sections;
+	g->regions = header->regions;
+	g->sampling = header->sampling;
+	g->offsets = (uint64_t *)(base + sections[SECTION_OFFSETS]);
+	if(graph_has_compact_ids(g)) {
+		g->neighbors_compact = (uint32_t *)(base + sections[SECTION_NEIGHBORS_COMPACT]);
+		g->in_sources_compact = (uint32_t *)(base + sections[SECTION_IN_SOURCES_COMPACT]);
+	} else {
+		g->neighbors = (lp_id_t *)(base + sections[SECTION_NEIGHBORS]);
+		g->in_sources = (lp_id_t *)(base + sections[SECTION_IN_SOURCES]);
+	}
+	g->precision = header->precision;
+	if(sections[SECTION_PROBABILITIES] != 0)
+		g->probabilities = (double *)(base + sections[SECTION_PROBABILITIES]);
+	if(sections[SECTION_PROBABILITIES_FLOAT] != 0)
+		g->probabilities_float = (float *)(base + sections[SECTION_PROBABILITIES_FLOAT]);
+	if(sections[SECTION_THRESHOLDS] != 0) {
+		g->thresholds = (uint16_t *)(base + sections[SECTION_THRESHOLDS]);
+		g->totals = (float *)(base + sections[SECTION_TOTALS]);
+	}
+	g->in_offsets = (uint64_t *)(base + sections[SECTION_IN_OFFSETS]);
+	if(sections[SECTION_ALIAS_PROBABILITIES] != 0) {
+		g->alias_probabilities = (double *)(base + sections[SECTION_ALIAS_PROBABILITIES]);
+		g->alias_indices = (uint32_t *)(base + sections[SECTION_ALIAS_INDICES]);
+	}
+	if(sections[SECTION_CUMULATIVE] != 0)
+		g->cumulative = (double *)(base + sections[SECTION_CUMULATIVE]);
+	if(sections[SECTION_INDEX_OFFSETS] != 0) {
+		g->index_offsets = (uint64_t *)(base + sections[SECTION_INDEX_OFFSETS]);
+		g->index_slots = (uint32_t *)(base + sections[SECTION_INDEX_SLOTS]);
+	}
+	g->mapping = mapping;
+	g->mapping_size = size;
+
+	if(unlikely(g->offsets[g->regions] != header->edges || g->in_offsets[g->regions] != header->edges ||
+		    (g->index_offsets != NULL && g->index_offsets[g->regions] != header->index_slots))) {
+		fprintf(stderr, "[ERROR] Unable to map %s: inconsistent graph arrays.", path);
+		graph_release(g);
+		return false;
+	}
+
+	*graph = g;
+	return true;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file src/storage.h
+ *
+ * @brief Topology files
+ *
+ * A versioned binary format to save topologies and to map them back in
+ * memory without rebuilding them. A fixed-size header, protected by a
+ * checksum, describes the geometry of the topology and the position of the
+ * CSR arrays of graphs, which follow at 64-byte aligned offsets in the
+ * native byte order of the machine which wrote the file.
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ROOT-Sim/topology.h>
+#include <graph.h>
+
+/// The geometry and the dimensions of a topology, as kept in a topology file
+struct storage_shape {
+	enum topology_geometry geometry; /**< The geometry of the topology */
+	lp_id_t regions;                 /**< The number of regions of the topology */
+	uint32_t width;                  /**< The width of the grid, for grid geometries */
+	uint32_t height;                 /**< The height of the grid, for grid geometries */
+};
+
+extern bool storage_save(const char *path, const struct storage_shape *shape, const struct graph *graph);
+extern bool storage_map(const char *path, struct storage_shape *shape, struct graph **graph);
+extern void storage_unmap(void *mapping, size_t size);
@@ -10,23 +10,22 @@
  */
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include <ROOT-Sim/topology.h>
+#include <generators.h>
+#include <graph.h>
 #include <likely.h>
-#include <list.h>
+#include <parallel.h>
+#include <partition.h>
 #include <random.h>
-
-/// A node in the topology adjacency matrix
-struct graph_node {
-	lp_id_t neighbor;        /**< The ID of the neighbor */
-	double probability;      /**< The probability to traverse this edge */
-	void *data;              /**< Custom user data associated with this edge */
-	struct graph_node *next; /**< Next node in the adjacency list */
-	struct graph_node *prev; /**< Next node in the adjacency list */
-};
+#include <reorder.h>
+#include <sort.h>
+#include <storage.h>
 
 /// The structure describing a topology
 struct topology {
@@ -34,9 +33,18 @@ struct topology {
 	uint32_t width;                      /**< the width of the grid */
 	uint32_t height;                     /**< the height of the grid */
 	enum topology_geometry geometry;     /**< the topology geometry */
-	list(struct graph_node) * adjacency; /**< Adjacency list for the graph topology */
+	struct graph *graph;                 /**< Adjacency of the graph topology */
+	bool weights;                        /**< whether graph links take weights rather than probabilities */
+	double *positions;                   /**< the coordinates of the regions of a geometric graph, or NULL */
 };
 
+/// The number of queries of a batch whose random numbers are drawn at once
+#define BATCH_CHUNK 256
+/// How many queries ahead the adjacency of graph nodes is prefetched by batches
+#define BATCH_PREFETCH 8
+/// The number of slots of the sets of drawn receivers kept on the stack
+#define RECEIVER_SET_LOCAL 64
+
 /// Allowed directions to reach a neighbor in a TOPOLOGY_HEXAGON
 static enum topology_direction directions_hexagon[] = {DIRECTION_E, DIRECTION_W, DIRECTION_NE, DIRECTION_NW,
     DIRECTION_SE, DIRECTION_SW};
@@ -44,53 +52,134 @@ static enum topology_direction directions_hexagon[] = {DIRECTION_E, DIRECTION_W,
 static enum topology_direction directions_square_torus[] = {DIRECTION_E, DIRECTION_W, DIRECTION_N, DIRECTION_S};
 
 
+/// The cell on the west side of a grid
+#define CLASS_WEST 1U
+/// The cell on the east side of a grid
+#define CLASS_EAST 2U
+/// The cell on the north side of a grid
+#define CLASS_NORTH 4U
+/// The cell on the south side of a grid
+#define CLASS_SOUTH 8U
+/// The cell in an odd row of a TOPOLOGY_HEXAGON
+#define CLASS_ODD 16U
+
+/// The directions leading to an existing neighbor from every cell of a class of grid cells
+struct direction_class {
+	unsigned count;                        /**< the number of valid directions */
+	enum topology_direction directions[6]; /**< the valid directions */
+};
+
+/// The valid directions of TOPOLOGY_HEXAGON cells, by class
+static struct direction_class hexagon_classes[32];
+/// The valid directions of TOPOLOGY_SQUARE cells, by class
+static struct direction_class square_classes[16];
+/// The column offset of every direction in a grid, before the shift of the diagonals of odd hexagon rows
+static const int8_t direction_dx[DIRECTION_RANDOM + 1] = {
+    [DIRECTION_E] = 1, [DIRECTION_W] = -1, [DIRECTION_SW] = -1, [DIRECTION_NW] = -1};
+/// The row offset of every direction in a grid
+static const int8_t direction_dy[DIRECTION_RANDOM + 1] = {[DIRECTION_N] = -1, [DIRECTION_S] = 1, [DIRECTION_NE] = -1,
+    [DIRECTION_SW] = 1, [DIRECTION_NW] = -1, [DIRECTION_SE] = 1};
+/// The directions which exist in a TOPOLOGY_HEXAGON, as a bit mask
+#define HEXAGON_DIRECTIONS                                                                                             \
+	((1U << DIRECTION_E) | (1U << DIRECTION_W) | (1U << DIRECTION_NE) | (1U << DIRECTION_SW) |                     \
+	    (1U << DIRECTION_NW) | (1U << DIRECTION_SE))
+/// The directions which exist in a TOPOLOGY_SQUARE or a TOPOLOGY_TORUS, as a bit mask
+#define SQUARE_DIRECTIONS ((1U << DIRECTION_E) | (1U << DIRECTION_W) | (1U << DIRECTION_N) | (1U << DIRECTION_S))
+
+
 /**
- * @brief Return a random neighbor
- *
- * This function computes a random receiver, only for TOPOLOGY_HEXAGON,
- * TOPOLOGY_SQUARE, and TOPOLOGY_TORUS. The algorithm simply generates a
- * random permutation over the list of valid directions passed by the
- * caller, and then attempts to get a receiver in every direction. The first
- * direction that is not INVALID_DIRECTION dictates the picked random
- * neighbor.
- *
- * @param from source element of the random receiver computation
- * @param topology the topology currently being considered
- * @param n_directions the number of valid directions for the given topology
- * @param directions the number of directions (a variable array)
- *
- * @return A random neighbor according to the specified topology
+ * @brief Tell whether a direction leads to an existing neighbor from a class of grid cells
+ * @param geometry either TOPOLOGY_HEXAGON or TOPOLOGY_SQUARE
+ * @param class the class of the cells, a combination of the CLASS_* flags
+ * @param direction the direction to check
+ * @return true if the direction leads to an existing neighbor, false otherwise
  */
-static lp_id_t get_random_neighbor(lp_id_t from, struct topology *topology, size_t n_directions,
-    enum topology_direction directions[n_directions])
+static bool class_has_direction(enum topology_geometry geometry, unsigned class, enum topology_direction direction)
 {
-	lp_id_t ret = INVALID_DIRECTION;
+	bool odd = class & CLASS_ODD, west = !(class & CLASS_WEST), east = !(class & CLASS_EAST);
+	bool north = !(class & CLASS_NORTH), south = !(class & CLASS_SOUTH);
 
-	assert(topology->geometry != TOPOLOGY_RING);
-	assert(topology->geometry != TOPOLOGY_BIDRING);
-	assert(topology->geometry != TOPOLOGY_STAR);
-	assert(topology->geometry != TOPOLOGY_FCMESH);
-	assert(topology->geometry != TOPOLOGY_GRAPH);
+	switch(direction) {
+		case DIRECTION_E:
+			return east;
+		case DIRECTION_W:
+			return west;
+		case DIRECTION_N:
+			return geometry == TOPOLOGY_SQUARE && north;
+		case DIRECTION_S:
+			return geometry == TOPOLOGY_SQUARE && south;
+		// In odd rows, the cells to the north-east and south-east are one column to the east
+		case DIRECTION_NE:
+			return geometry == TOPOLOGY_HEXAGON && north && (!odd || east);
+		case DIRECTION_SE:
+			return geometry == TOPOLOGY_HEXAGON && south && (!odd || east);
+		// In even rows, the cells to the north-west and south-west are one column to the west
+		case DIRECTION_NW:
+			return geometry == TOPOLOGY_HEXAGON && north && (odd || west);
+		case DIRECTION_SW:
+			return geometry == TOPOLOGY_HEXAGON && south && (odd || west);
+		default:
+			return false;
+	}
+}
 
-	// Make a local copy of the directions array and shuffle it
-	enum topology_direction directions_copy[n_directions];
-	memcpy(directions_copy, directions, n_directions * sizeof(enum topology_direction));
 
-	for(size_t i = 0; i < n_directions - 1; i++) {
-		size_t j = topology_randomrange((int)i, (int)n_directions - 1);
-		enum topology_direction t = directions_copy[j];
-		directions_copy[j] = directions_copy[i];
-		directions_copy[i] = t;
+/**
+ * @brief Build the tables of the valid directions of every class of grid cells
+ *
+ * Whether a cell lies on each side of the grid, and in an odd row of a
+ * hexagonal grid, fully determines which of its neighbors exist, so the
+ * tables do not depend on the size of the grid.
+ */
+__attribute__((constructor)) static void init_direction_classes(void)
+{
+	for(unsigned class = 0; class < 32; class++) {
+		struct direction_class *hexagon = &hexagon_classes[class];
+		hexagon->count = 0;
+		for(unsigned i = 0; i < 6; i++)
+			if(class_has_direction(TOPOLOGY_HEXAGON, class, directions_hexagon[i]))
+				hexagon->directions[hexagon->count++] = directions_hexagon[i];
+
+		if(class & CLASS_ODD)
+			continue;
+		struct direction_class *square = &square_classes[class];
+		square->count = 0;
+		for(unsigned i = 0; i < 4; i++)
+			if(class_has_direction(TOPOLOGY_SQUARE, class, directions_square_torus[i]))
+				square->directions[square->count++] = directions_square_torus[i];
 	}
+}
 
-	for(size_t i = 0; i < n_directions; i++) {
-		ret = GetReceiver(topology, from, directions_copy[i]);
-		if(ret != INVALID_DIRECTION)
-			break;
-	}
 
-	assert(ret != INVALID_DIRECTION);
-	return ret;
+/**
+ * @brief Get the class of a grid cell
+ * @param x the column of the cell
+ * @param y the row of the cell
+ * @param topology the grid the cell belongs to
+ * @return the combination of CLASS_* flags describing the sides of the grid the cell lies on
+ */
+static inline unsigned grid_class(uint32_t x, uint32_t y, const struct topology *topology)
+{
+	return (x == 0 ? CLASS_WEST : 0) | (x == topology->width - 1 ? CLASS_EAST : 0) |
+	    (y == 0 ? CLASS_NORTH : 0) | (y == topology->height - 1 ? CLASS_SOUTH : 0);
+}
+
+
+/**
+ * @brief Pick a random valid direction from a class of grid cells
+ *
+ * This costs a single random draw and a table lookup, and every valid
+ * direction is equally likely.
+ *
+ * @param class the valid directions of the class of the cell
+ * @param draw a uniformly distributed 64-bit value
+ * @return a random valid direction, DIRECTION_RANDOM if the cell has no neighbors
+ */
+static inline enum topology_direction random_direction(const struct direction_class *class, uint64_t draw)
+{
+	if(unlikely(class->count == 0))
+		return DIRECTION_RANDOM;
+	return class->directions[random_range(draw, class->count)];
 }
 
 
@@ -140,10 +229,12 @@ static lp_id_t get_random_neighbor(lp_id_t from, struct topology *topology, size
  * @param from      The linear representation of the source element
  * @param topology  The structure keeping the information about the topology
  * @param direction The direction to move towards, to find a linear id
+ * @param draw      A uniformly distributed 64-bit value, which picks the direction if @p direction is DIRECTION_RANDOM
  * @return The linear id of the neighbor, INVALID_DIRECTION if such neighbor
  * does not exist in the topology.
  */
-static lp_id_t get_neighbor_hexagon(lp_id_t from, struct topology *topology, enum topology_direction direction)
+static lp_id_t get_neighbor_hexagon(lp_id_t from, struct topology *topology, enum topology_direction direction,
+    uint64_t draw)
 {
 	uint32_t x, y;
 
@@ -152,6 +243,9 @@ static lp_id_t get_neighbor_hexagon(lp_id_t from, struct topology *topology, enu
 	y = from / topology->width;
 	x = from - y * topology->width;
 
+	if(direction == DIRECTION_RANDOM)
+		direction = random_direction(&hexagon_classes[grid_class(x, y, topology) | (y & 1U ? CLASS_ODD : 0)], draw);
+
 	switch(direction) {
 		case DIRECTION_NW:
 			x += (y & 1U) - 1;
@@ -175,9 +269,6 @@ static lp_id_t get_neighbor_hexagon(lp_id_t from, struct topology *topology, enu
 		case DIRECTION_W:
 			x -= 1;
 			break;
-		case DIRECTION_RANDOM:
-			return get_random_neighbor(from, topology,
-			    sizeof(directions_hexagon) / sizeof(enum topology_direction), directions_hexagon);
 		default:
 			return INVALID_DIRECTION;
 	}
@@ -202,10 +293,12 @@ static lp_id_t get_neighbor_hexagon(lp_id_t from, struct topology *topology, enu
  * @param from      The linear representation of the source element
  * @param topology  The structure keeping the information about the topology
  * @param direction The direction to move towards, to find a linear id
+ * @param draw      A uniformly distributed 64-bit value, which picks the direction if @p direction is DIRECTION_RANDOM
  * @return The linear id of the neighbor, INVALID_DIRECTION if such neighbor
  * does not exist in the topology.
  */
-static lp_id_t get_neighbor_square(lp_id_t from, struct topology *topology, enum topology_direction direction)
+static lp_id_t get_neighbor_square(lp_id_t from, struct topology *topology, enum topology_direction direction,
+    uint64_t draw)
 {
 	unsigned x, y;
 
@@ -214,6 +307,9 @@ static lp_id_t get_neighbor_square(lp_id_t from, struct topology *topology, enum
 	y = from / topology->width;
 	x = from - y * topology->width;
 
+	if(direction == DIRECTION_RANDOM)
+		direction = random_direction(&square_classes[grid_class(x, y, topology)], draw);
+
 	switch(direction) {
 		case DIRECTION_N:
 			y -= 1;
@@ -227,9 +323,6 @@ static lp_id_t get_neighbor_square(lp_id_t from, struct topology *topology, enum
 		case DIRECTION_W:
 			x -= 1;
 			break;
-		case DIRECTION_RANDOM:
-			return get_random_neighbor(from, topology,
-			    sizeof(directions_square_torus) / sizeof(enum topology_direction), directions_square_torus);
 		default:
 			return INVALID_DIRECTION;
 	}
@@ -253,9 +346,11 @@ static lp_id_t get_neighbor_square(lp_id_t from, struct topology *topology, enum
  * @param from      The linear representation of the source element
  * @param topology  The structure keeping the information about the topology
  * @param direction The direction to move towards, to find a linear id
+ * @param draw      A uniformly distributed 64-bit value, which picks the direction if @p direction is DIRECTION_RANDOM
  * @return The linear id of the neighbor, which always exists.
  */
-static lp_id_t get_neighbor_torus(lp_id_t from, struct topology *topology, enum topology_direction direction)
+static lp_id_t get_neighbor_torus(lp_id_t from, struct topology *topology, enum topology_direction direction,
+    uint64_t draw)
 {
 	uint32_t x, y;
 
@@ -264,6 +359,9 @@ static lp_id_t get_neighbor_torus(lp_id_t from, struct topology *topology, enum
 	y = from / topology->width;
 	x = from - y * topology->width;
 
+	if(direction == DIRECTION_RANDOM)
+		direction = directions_square_torus[random_range(draw, 4)];
+
 	switch(direction) {
 		case DIRECTION_N:
 			y += topology->height - 1;
@@ -281,10 +379,6 @@ static lp_id_t get_neighbor_torus(lp_id_t from, struct topology *topology, enum
 			x += topology->width - 1;
 			x %= topology->width;
 			break;
-		case DIRECTION_RANDOM:
-			return get_random_neighbor(from, topology,
-			    sizeof(directions_square_torus) / sizeof(enum topology_direction), directions_square_torus);
-
 		default:
 			return INVALID_DIRECTION;
 	}
@@ -302,10 +396,12 @@ static lp_id_t get_neighbor_torus(lp_id_t from, struct topology *topology, enum
  * @param from      The linear representation of the source element
  * @param topology  The structure keeping the information about the topology
  * @param direction Can be only set to DIRECTION_RANDOM
+ * @param draw      A uniformly distributed 64-bit value, which picks the neighbor
  * @return The linear id of the neighbor, INVALID_DIRECTION if such neighbor
  * does not exist in the topology.
  */
-static lp_id_t get_neighbor_mesh(lp_id_t from, struct topology *topology, enum topology_direction direction)
+static lp_id_t get_neighbor_mesh(lp_id_t from, struct topology *topology, enum topology_direction direction,
+    uint64_t draw)
 {
 	lp_id_t ret;
 
@@ -320,20 +416,18 @@ static lp_id_t get_neighbor_mesh(lp_id_t from, struct topology *topology, enum t
 	if(topology->regions == 1)
 		return INVALID_DIRECTION;
 
-	do {
-		ret = (lp_id_t)((double)topology->regions * topology_random());
-	} while(ret == from);
-
-	return ret;
+	ret = random_range(draw, topology->regions - 1);
+	return ret + (ret >= from);
 }
 
 
-static lp_id_t get_neighbor_bidring(lp_id_t from, struct topology *topology, enum topology_direction direction)
+static lp_id_t get_neighbor_bidring(lp_id_t from, struct topology *topology, enum topology_direction direction,
+    uint64_t draw)
 {
 	assert(topology->geometry == TOPOLOGY_BIDRING);
 
 	if(direction == DIRECTION_RANDOM) {
-		if(topology_random() < 0.5)
+		if(draw >> 63)
 			direction = DIRECTION_E;
 		else
 			direction = DIRECTION_W;
@@ -357,7 +451,8 @@ static lp_id_t get_neighbor_ring(lp_id_t from, struct topology *topology, enum t
 }
 
 
-static lp_id_t get_neighbor_star(lp_id_t from, struct topology *topology, enum topology_direction direction)
+static lp_id_t get_neighbor_star(lp_id_t from, struct topology *topology, enum topology_direction direction,
+    uint64_t draw)
 {
 	assert(topology->geometry == TOPOLOGY_STAR);
 
@@ -367,19 +462,18 @@ static lp_id_t get_neighbor_star(lp_id_t from, struct topology *topology, enum t
 	}
 
 	if(from == 0)
-		return topology_randomrange(1, (int)(topology->regions - 1));
+		return 1 + random_range(draw, topology->regions - 1);
 	return 0;
 }
 
 
-static lp_id_t get_neighbor_graph(lp_id_t from, struct topology *topology, enum topology_direction direction)
+static lp_id_t get_neighbor_graph(lp_id_t from, struct topology *topology, enum topology_direction direction,
+    uint64_t draw)
 {
-	double rand, cumulative = 0.0;
-	struct graph_node *adj_node;
-	unsigned adj_neighbor;
+	struct graph_edges edges;
 
 	assert(topology->geometry == TOPOLOGY_GRAPH);
-	assert(topology->adjacency != NULL);
+	assert(topology->graph != NULL);
 	assert(from < topology->regions);
 
 	if(topology->geometry == TOPOLOGY_GRAPH && direction != DIRECTION_RANDOM) {
@@ -387,18 +481,11 @@ static lp_id_t get_neighbor_graph(lp_id_t from, struct topology *topology, enum
 		return INVALID_DIRECTION;
 	}
 
-	if(list_size(topology->adjacency[from]) == 0)
+	edges = graph_out_edges(topology->graph, from);
+	if(edges.size == 0)
 		return INVALID_DIRECTION;
 
-	rand = topology_random();
-	adj_node = list_head(topology->adjacency[from]);
-	do {
-		adj_neighbor = adj_node->neighbor;
-		cumulative += adj_node->probability;
-		adj_node = list_next(adj_node);
-	} while(rand < cumulative && adj_node != NULL);
-
-	return adj_neighbor;
+	return graph_neighbor(&edges, graph_sample(topology->graph, from, (double)(draw >> 11) * 0x1.0p-53));
 }
 
 
@@ -410,7 +497,6 @@ lp_id_t CountRegions(struct topology *topology)
 
 lp_id_t CountDirections(struct topology *topology, lp_id_t from)
 {
-	lp_id_t neighbors;
 	uint32_t x, y;
 
 	assert(topology);
@@ -422,16 +508,9 @@ lp_id_t CountDirections(struct topology *topology, lp_id_t from)
 
 		case TOPOLOGY_HEXAGON:
 			assert(topology->geometry == TOPOLOGY_HEXAGON);
-			neighbors = 6;
 			y = from / topology->width;
 			x = from - y * topology->width;
-			if(y == 0 || y == topology->height - 1)
-				neighbors -= x == 0 ? 1 : 2;
-			if(x == 0)
-				neighbors -= 3 - 2 * (y & 1U);
-			if(x == topology->width - 1)
-				neighbors -= 3 - 2 * (1 - (y & 1U));
-			return neighbors;
+			return hexagon_classes[grid_class(x, y, topology) | (y & 1U ? CLASS_ODD : 0)].count;
 
 		case TOPOLOGY_TORUS:
 			assert(topology->geometry == TOPOLOGY_TORUS);
@@ -439,14 +518,9 @@ lp_id_t CountDirections(struct topology *topology, lp_id_t from)
 
 		case TOPOLOGY_SQUARE:
 			assert(topology->geometry == TOPOLOGY_SQUARE);
-			neighbors = 4;
 			y = from / topology->width;
 			x = from - y * topology->width;
-			if(x == 0 || x == topology->width - 1)
-				neighbors--;
-			if(y == 0 || y == topology->height - 1)
-				neighbors--;
-			return neighbors;
+			return square_classes[grid_class(x, y, topology)].count;
 
 		case TOPOLOGY_BIDRING:
 			assert(topology->geometry == TOPOLOGY_BIDRING);
@@ -464,13 +538,24 @@ lp_id_t CountDirections(struct topology *topology, lp_id_t from)
 
 		case TOPOLOGY_GRAPH:
 			assert(topology->geometry == TOPOLOGY_GRAPH);
-			assert(topology->adjacency != NULL);
+			assert(topology->graph != NULL);
 			assert(from < topology->regions);
-			return list_size(topology->adjacency[from]);
+			return graph_out_edges(topology->graph, from).size;
 	}
 	return UINT_MAX;
 }
 
+/**
+ * @brief Scale the link probabilities of a graph so that they sum to 1 for every node
+ *
+ * The probabilities, or the weights, of the links of every node keep their
+ * proportions. If all the links of a node have zero probability, they become
+ * equally likely, while nodes with no links are left alone. Large graphs are
+ * normalized in parallel, and their sampling tables are rebuilt.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @return true on success, false otherwise
+ */
 bool NormalizeLinkProbabilities(struct topology *topology) {
 	assert(topology);
 
@@ -479,50 +564,349 @@ bool NormalizeLinkProbabilities(struct topology *topology) {
 		return false;
 	}
 
-	for(size_t i = 0; i < topology->regions; i++) {
-		int elements = list_size(topology->adjacency[i]);
-		struct graph_node *adj_node = list_head(topology->adjacency[i]);
-		double new_probability = 1. / elements;
-		while(adj_node) {
-			adj_node->probability = new_probability;
-			adj_node = list_next(adj_node);
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return false;
+	}
+
+	graph_normalize(topology->graph);
+	return true;
+}
+
+
+/**
+ * @brief Select the algorithm used to pick random neighbors in a graph
+ *
+ * Whatever the algorithm, a random neighbor is picked with a likelihood
+ * proportional to the probability of its link. SAMPLING_ALIAS (the default)
+ * picks a neighbor in constant time using per-node alias tables, which are
+ * built when the graph is finalized and kept up to date when probabilities
+ * change. SAMPLING_CUMULATIVE keeps the cumulative distribution of the links
+ * of every node the same way, and picks a neighbor with a binary search: its
+ * tables are cheaper to rebuild when probabilities change often.
+ * SAMPLING_LINEAR scans the links of the node, and is always used on graphs
+ * which have not been finalized yet.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @param sampling The algorithm to use
+ * @return true on success, false otherwise
+ */
+bool SetTopologySampling(struct topology *topology, enum topology_sampling sampling)
+{
+	assert(topology);
+
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Sampling algorithms can be selected only for graphs.");
+		return false;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return false;
+	}
+
+	if(unlikely(sampling != SAMPLING_ALIAS && sampling != SAMPLING_LINEAR && sampling != SAMPLING_CUMULATIVE)) {
+		fprintf(stderr, "[ERROR] Unexpected sampling algorithm.");
+		return false;
+	}
+
+	if(unlikely(!graph_set_sampling(topology->graph, sampling))) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for sampling tables.");
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * @brief Select the storage format of the link probabilities of a graph
+ *
+ * Links are always added with double precision probabilities, which are
+ * converted to @p precision when the graph is finalized. Less precise formats
+ * save memory on large graphs and fit more links per cache line:
+ * PRECISION_FLOAT keeps about 7 significant digits, while PRECISION_FIXED16
+ * keeps the share of every link out of the total of its node with a
+ * resolution of 1 / 65535, and picks random neighbors by comparing an integer
+ * draw against cumulative thresholds instead of using alias tables.
+ *
+ * Finalized graphs are converted immediately.
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param precision The storage format to use
+ * @return true on success, false otherwise
+ */
+bool SetTopologyPrecision(struct topology *topology, enum topology_precision precision)
+{
+	assert(topology);
+
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Probability precision can be selected only for graphs.");
+		return false;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return false;
+	}
+
+	if(unlikely(precision != PRECISION_DOUBLE && precision != PRECISION_FLOAT && precision != PRECISION_FIXED16)) {
+		fprintf(stderr, "[ERROR] Unexpected probability precision.");
+		return false;
+	}
+
+	if(unlikely(!graph_set_precision(topology->graph, precision))) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for link probabilities.");
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * @brief Relabel the nodes of a graph topology to improve locality
+ *
+ * When node IDs come from the input order of a model, adjacent nodes are
+ * often far apart, both in the arrays of the topology and in the mapping of
+ * LPs to threads. This computes an ordering of the nodes which places the
+ * neighbors of every node close to it, see enum topology_order, and
+ * relabels the topology accordingly. Every link keeps its probability, its
+ * data and its attributes. The topology is finalized first, if needed.
+ *
+ * The maps between old and new IDs are returned so that models can remap
+ * their own state. Either map can be NULL if it is not needed.
+ *
+ * @param topology   The structure keeping the information about the topology
+ * @param order      The ordering to apply
+ * @param old_to_new An array of CountRegions() elements to store the new ID of every node, indexed by old ID
+ * @param new_to_old An array of CountRegions() elements to store the old ID of every node, indexed by new ID
+ * @return true on success, false otherwise. In the latter case, the topology is not relabeled.
+ */
+bool ReorderTopology(struct topology *topology, enum topology_order order, lp_id_t *old_to_new,
+    lp_id_t *new_to_old)
+{
+	assert(topology);
+
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Reordering is only supported for graphs.");
+		return false;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return false;
+	}
+
+	if(unlikely(order != ORDER_RCM && order != ORDER_DEGREE && order != ORDER_BFS)) {
+		fprintf(stderr, "[ERROR] Unexpected node ordering.");
+		return false;
+	}
+
+	if(unlikely(!FinalizeTopology(topology)))
+		return false;
+
+	lp_id_t *rank = old_to_new != NULL ? old_to_new : malloc(topology->regions * sizeof(*rank));
+	lp_id_t *permutation = new_to_old != NULL ? new_to_old : malloc(topology->regions * sizeof(*permutation));
+	bool ret = rank != NULL && permutation != NULL && reorder_compute(topology->graph, order, permutation);
+
+	double *positions = NULL;
+
+	if(ret && topology->positions != NULL) {
+		positions = malloc(2 * topology->regions * sizeof(*positions));
+		ret = positions != NULL;
+	}
+	if(ret) {
+		for(lp_id_t i = 0; i < topology->regions; i++)
+			rank[permutation[i]] = i;
+		ret = graph_permute(topology->graph, permutation, rank);
+	}
+	if(ret && positions != NULL) {
+		for(lp_id_t i = 0; i < topology->regions; i++) {
+			positions[2 * rank[i]] = topology->positions[2 * i];
+			positions[2 * rank[i] + 1] = topology->positions[2 * i + 1];
 		}
+		free(topology->positions);
+		topology->positions = positions;
+		positions = NULL;
+	}
+	if(unlikely(!ret))
+		fprintf(stderr, "[ERROR] Unable to allocate memory to reorder the topology.");
+
+	free(positions);
+
+	if(rank != old_to_new)
+		free(rank);
+	if(permutation != new_to_old)
+		free(permutation);
+	return ret;
+}
+
+/**
+ * @brief Measure the quality of a partition
+ * @param topology The structure keeping the information about the topology
+ * @param parts    The number of parts
+ * @param part     The part of every region
+ * @param stats    Where to store the quality of the partition
+ * @return true on success, false if memory could not be allocated
+ */
+static bool partition_stats(struct topology *topology, unsigned parts, const unsigned part[],
+    struct topology_partition_stats *stats)
+{
+	lp_id_t n = topology->regions, receivers[6];
+	uint64_t *sizes = calloc(parts, sizeof(*sizes)), largest = 0;
+	double remote = 0;
+
+	if(sizes == NULL)
+		return false;
+	for(lp_id_t i = 0; i < n; i++)
+		sizes[part[i]]++;
+
+	stats->cut_links = 0;
+	switch(topology->geometry) {
+		case TOPOLOGY_STAR:
+			// The hub links to every leaf and every leaf links to the hub
+			stats->cut_links = 2 * (n - sizes[part[0]]);
+			remote = n - sizes[part[0]];
+			if(n > 1)
+				remote += (double)(n - sizes[part[0]]) / (n - 1);
+			break;
+
+		case TOPOLOGY_FCMESH:
+			for(unsigned p = 0; p < parts; p++) {
+				stats->cut_links += sizes[p] * (n - sizes[p]);
+				if(n > 1)
+					remote += (double)sizes[p] * (n - sizes[p]) / (n - 1);
+			}
+			break;
+
+		case TOPOLOGY_GRAPH:
+			for(lp_id_t i = 0; i < n; i++) {
+				struct graph_edges edges = graph_out_edges(topology->graph, i);
+				double total = 0, cut = 0;
+				for(size_t j = 0; j < edges.size; j++) {
+					double probability = graph_get_probability(topology->graph, i, j);
+					bool crossing = part[graph_neighbor(&edges, j)] != part[i];
+					stats->cut_links += crossing;
+					total += probability;
+					cut += crossing ? probability : 0;
+				}
+				if(total > 0)
+					remote += cut / total;
+			}
+			break;
+
+		default:
+			for(lp_id_t i = 0; i < n; i++) {
+				lp_id_t directions = CountDirections(topology, i), cut = 0;
+				GetAllReceivers(topology, i, receivers);
+				for(lp_id_t j = 0; j < directions; j++)
+					cut += part[receivers[j]] != part[i];
+				stats->cut_links += cut;
+				if(directions)
+					remote += (double)cut / directions;
+			}
+			break;
 	}
 
+	for(unsigned p = 0; p < parts; p++)
+		largest = sizes[p] > largest ? sizes[p] : largest;
+	stats->remote_share = remote / n;
+	stats->imbalance = (double)largest * parts / n;
+	free(sizes);
 	return true;
 }
 
-bool IsNeighbor(struct topology *topology, lp_id_t from, lp_id_t to)
+
+/**
+ * @brief Split the regions of a topology in balanced parts, keeping linked regions together
+ *
+ * Simulation models spread LPs over threads and nodes: assigning the regions
+ * of every part to the same worker keeps most messages local. Rings, stars
+ * and meshes are cut in blocks of contiguous IDs, and grids are tiled with
+ * rectangles arranged to cut as few links as possible. Graphs are
+ * partitioned by a multilevel algorithm which weights every link by its
+ * probability, and which runs in parallel on large graphs. The topology is
+ * finalized first, if needed.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @param parts    The number of parts, between 1 and CountRegions()
+ * @param balance  The largest allowed ratio between the size of a part and the average size, at least 1
+ * @param part     An array of CountRegions() elements to store the part of every region
+ * @param stats    Where to store the quality of the partition, can be NULL
+ * @return true on success, false otherwise
+ */
+bool PartitionTopology(struct topology *topology, unsigned parts, double balance, unsigned part[],
+    struct topology_partition_stats *stats)
 {
-	struct graph_node *adj_node;
+	assert(topology);
+
+	if(unlikely(parts == 0 || parts > topology->regions)) {
+		fprintf(stderr, "[ERROR] The number of parts must be between 1 and the number of regions.");
+		return false;
+	}
+
+	if(unlikely(!(balance >= 1.0))) {
+		fprintf(stderr, "[ERROR] The balance of a partition must be at least 1.");
+		return false;
+	}
+
+	switch(topology->geometry) {
+		case TOPOLOGY_HEXAGON:
+		case TOPOLOGY_SQUARE:
+		case TOPOLOGY_TORUS:
+			partition_grid(topology->width, topology->height, topology->geometry == TOPOLOGY_TORUS, parts,
+			    balance, part);
+			break;
+
+		case TOPOLOGY_GRAPH:
+			if(unlikely(!FinalizeTopology(topology)))
+				return false;
+			if(unlikely(!partition_graph(topology->graph, parts, balance, part))) {
+				fprintf(stderr, "[ERROR] Unable to allocate memory to partition the topology.");
+				return false;
+			}
+			break;
+
+		default:
+			partition_blocks(topology->regions, parts, part);
+			break;
+	}
+
+	if(unlikely(stats != NULL && !partition_stats(topology, parts, part, stats))) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory to partition the topology.");
+		return false;
+	}
+	return true;
+}
 
+bool IsNeighbor(struct topology *topology, lp_id_t from, lp_id_t to)
+{
 	switch(topology->geometry) {
 		case TOPOLOGY_HEXAGON:
 			assert(topology->geometry == TOPOLOGY_HEXAGON);
 			for(unsigned i = 0; i < DIRECTION_RANDOM; i++)
-				if(get_neighbor_hexagon(from, topology, i) == to)
+				if(get_neighbor_hexagon(from, topology, i, 0) == to)
 					return true;
 			break;
 
 		case TOPOLOGY_TORUS:
 			assert(topology->geometry == TOPOLOGY_TORUS);
 			for(unsigned i = 0; i < DIRECTION_NE; i++)
-				if(get_neighbor_torus(from, topology, i) == to)
+				if(get_neighbor_torus(from, topology, i, 0) == to)
 					return true;
 			break;
 
 		case TOPOLOGY_SQUARE:
 			assert(topology->geometry == TOPOLOGY_SQUARE);
 			for(unsigned i = 0; i < DIRECTION_NE; i++)
-				if(get_neighbor_square(from, topology, i) == to)
+				if(get_neighbor_square(from, topology, i, 0) == to)
 					return true;
 			break;
 
 		case TOPOLOGY_BIDRING:
 			assert(topology->geometry == TOPOLOGY_BIDRING);
-			if(get_neighbor_bidring(from, topology, DIRECTION_E) == to)
+			if(get_neighbor_bidring(from, topology, DIRECTION_E, 0) == to)
 				return true;
-			if(get_neighbor_bidring(from, topology, DIRECTION_W) == to)
+			if(get_neighbor_bidring(from, topology, DIRECTION_W, 0) == to)
 				return true;
 			break;
 
@@ -548,16 +932,10 @@ bool IsNeighbor(struct topology *topology, lp_id_t from, lp_id_t to)
 
 		case TOPOLOGY_GRAPH:
 			assert(topology->geometry == TOPOLOGY_GRAPH);
-			assert(topology->adjacency != NULL);
+			assert(topology->graph != NULL);
 
-			if(list_size(topology->adjacency[from]) == 0)
-				return false;
-			adj_node = list_head(topology->adjacency[from]);
-			while(adj_node && adj_node->neighbor != to)
-				adj_node = list_next(adj_node);
-			if(adj_node != NULL)
+			if(from < topology->regions && graph_find_edge(topology->graph, from, to) != INVALID_EDGE)
 				return true;
-
 			break;
 
 		default:
@@ -568,79 +946,358 @@ bool IsNeighbor(struct topology *topology, lp_id_t from, lp_id_t to)
 }
 
 
+/**
+ * @brief Initialize a random state owned by the caller
+ *
+ * Every (@p seed, @p index) pair starts a different stream, so that for
+ * instance every thread or every LP can own an independent state, derived
+ * from a shared seed and from its own ID.
+ *
+ * @param rng   The random state to initialize
+ * @param seed  The seed shared by a family of states
+ * @param index The index of the state in its family
+ */
+void InitializeTopologyRng(struct topology_rng *rng, uint64_t seed, uint64_t index)
+{
+	random_stream_init(rng, seed, index);
+}
+
+
+/**
+ * @brief Get the linear id of a neighbor, drawing from the random state of the calling thread
+ *
+ * The random state of every thread is taken from a shared state jumped ahead
+ * the first time the thread needs it, so the random neighbors drawn by
+ * different threads are independent and no synchronization is needed. To
+ * draw reproducible neighbors, use GetReceiverWithRng().
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param from      The linear representation of the source element
+ * @param direction The direction to move towards, or DIRECTION_RANDOM
+ * @return The linear id of the neighbor, INVALID_DIRECTION if such neighbor does not exist in the topology.
+ */
 lp_id_t GetReceiver(struct topology *topology, lp_id_t from, enum topology_direction direction)
+{
+	return GetReceiverWithRng(topology, from, direction, random_thread_rng());
+}
+
+
+/**
+ * @brief Get the linear id of a neighbor, drawing from a random state owned by the caller
+ *
+ * This function is reentrant: concurrent calls are safe as long as they use
+ * different random states, and the same sequence of calls on a state
+ * initialized the same way always gives the same neighbors.
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param from      The linear representation of the source element
+ * @param direction The direction to move towards, or DIRECTION_RANDOM
+ * @param rng       The random state to draw from, initialized with InitializeTopologyRng()
+ * @return The linear id of the neighbor, INVALID_DIRECTION if such neighbor does not exist in the topology.
+ */
+lp_id_t GetReceiverWithRng(struct topology *topology, lp_id_t from, enum topology_direction direction,
+    struct topology_rng *rng)
 {
 	if(unlikely(from >= topology->regions)) {
 		fprintf(stderr, "[ERROR] `from` does not belong to the topology.\n");
 		return INVALID_DIRECTION;
 	}
 
+	uint64_t draw = direction == DIRECTION_RANDOM ? random_stream_u64(rng) : 0;
+
 	switch(topology->geometry) {
 		case TOPOLOGY_HEXAGON:
-			return get_neighbor_hexagon(from, topology, direction);
+			return get_neighbor_hexagon(from, topology, direction, draw);
 
 		case TOPOLOGY_SQUARE:
-			return get_neighbor_square(from, topology, direction);
+			return get_neighbor_square(from, topology, direction, draw);
 
 		case TOPOLOGY_TORUS:
-			return get_neighbor_torus(from, topology, direction);
+			return get_neighbor_torus(from, topology, direction, draw);
 
 		case TOPOLOGY_FCMESH:
-			return get_neighbor_mesh(from, topology, direction);
+			return get_neighbor_mesh(from, topology, direction, draw);
 
 		case TOPOLOGY_BIDRING:
-			return get_neighbor_bidring(from, topology, direction);
+			return get_neighbor_bidring(from, topology, direction, draw);
 
 		case TOPOLOGY_RING:
 			return get_neighbor_ring(from, topology, direction);
 
 		case TOPOLOGY_STAR:
-			return get_neighbor_star(from, topology, direction);
+			return get_neighbor_star(from, topology, direction, draw);
 
 		case TOPOLOGY_GRAPH:
-			return get_neighbor_graph(from, topology, direction);
+			return get_neighbor_graph(from, topology, direction, draw);
 	}
 	return INVALID_DIRECTION;
 }
 
+
 /**
- * Populate an array of all neighbors of a given element.
+ * @brief Get the linear id of a neighbor, as a pure function of the event asking for it
+ *
+ * Random neighbors are drawn from a counter-based generator, keyed by the
+ * seed, by @p from and by the event counter, rather than from a state which
+ * evolves with every call. The same arguments always give the same neighbor,
+ * so that an optimistic simulator re-executing an event after a rollback
+ * gets the same neighbor again without saving or restoring any random state.
+ * Different event counters give independent neighbors. Different queries
+ * within the same event need different counters, for instance by reserving
+ * a range of counters per event.
  *
  * @param topology  The structure keeping the information about the topology
- * @param from      The linear representation of the source element
- * @param receivers An array of lp_id_t to store the neighbors. Can be preallocated externally using CountDirections().
+ * @param from      The linear representation of the source element, which also keys the generator
+ * @param direction The direction to move towards, or DIRECTION_RANDOM
+ * @param seed      The seed of the simulation
+ * @param event     The counter of the event of @p from asking for a neighbor
+ * @return The linear id of the neighbor, INVALID_DIRECTION if such neighbor does not exist in the topology.
  */
-void GetAllReceivers(struct topology *topology, lp_id_t from, lp_id_t *receivers)
+lp_id_t GetReceiverForEvent(struct topology *topology, lp_id_t from, enum topology_direction direction, uint64_t seed,
+    uint64_t event)
 {
-	struct graph_node *adj_node;
+	struct topology_rng rng;
 
-	if(unlikely(from >= topology->regions)) {
-		fprintf(stderr, "[ERROR] `from` does not belong to the topology.\n");
-		return;
-	}
+	random_counter_init(&rng, seed, from, event);
+	return GetReceiverWithRng(topology, from, direction, &rng);
+}
+
+
+/**
+ * @brief Resolve a chunk of a batch of neighbor queries
+ *
+ * The geometry is dispatched once for the whole chunk. Grids, rings, meshes
+ * and stars are resolved in closed form: the direction is picked from the
+ * draw with the tables of the boundary classes, the neighbor is found with
+ * the offsets of the direction and the wraparound or the edges of the grid
+ * are handled with selects, so that the loops have no branches but the loop
+ * itself. For finalized graphs, the CSR offsets of the sources are
+ * prefetched 2 * BATCH_PREFETCH queries ahead and their out-edges
+ * BATCH_PREFETCH queries ahead, so that the cache misses of several queries
+ * overlap.
+ *
+ * @param topology   The structure keeping the information about the topology
+ * @param n          The number of queries
+ * @param from       The source of every query
+ * @param directions The direction of every query, NULL if all are DIRECTION_RANDOM
+ * @param draws      A uniformly distributed 64-bit value for every query
+ * @param receivers  Where to store the neighbor of every query
+ * @return true if every source belongs to the topology, false otherwise
+ */
+static bool receivers_chunk(struct topology *topology, size_t n, const lp_id_t from[],
+    const enum topology_direction directions[], const uint64_t draws[], lp_id_t receivers[])
+{
+	lp_id_t regions = topology->regions;
+	uint32_t width = topology->width, height = topology->height;
+	bool inside = true;
+
+// Directions beyond DIRECTION_RANDOM do not exist in any geometry, and are all mapped to DIRECTION_RANDOM + 1
+#define batch_direction(i)                                                                                             \
+	(directions == NULL ? DIRECTION_RANDOM :                                                                       \
+	    directions[i] <= DIRECTION_RANDOM ? directions[i] : DIRECTION_RANDOM + 1)
 
 	switch(topology->geometry) {
 		case TOPOLOGY_HEXAGON:
-			for(unsigned i = 0; i < 6; ++i) {
-				lp_id_t receiver = GetReceiver(topology, from, directions_hexagon[i]);
-				if(receiver != INVALID_DIRECTION)
-					*receivers++ = receiver;
+		case TOPOLOGY_SQUARE: {
+			bool hexagon = topology->geometry == TOPOLOGY_HEXAGON;
+			unsigned mask = hexagon ? HEXAGON_DIRECTIONS : SQUARE_DIRECTIONS;
+			for(size_t i = 0; i < n; i++) {
+				uint32_t y = (uint32_t)(from[i] / width), x = (uint32_t)(from[i] - (lp_id_t)y * width);
+				unsigned odd = hexagon ? y & 1U : 0;
+				const struct direction_class *class = hexagon ?
+				    &hexagon_classes[grid_class(x, y, topology) | (odd ? CLASS_ODD : 0)] :
+				    &square_classes[grid_class(x, y, topology)];
+				unsigned direction = batch_direction(i);
+				unsigned drawn = DIRECTION_RANDOM + 1;
+				if(class->count != 0)
+					drawn = class->directions[random_range(draws[i], class->count)];
+				direction = direction == DIRECTION_RANDOM ? drawn : direction;
+				direction = direction < DIRECTION_RANDOM ? direction : DIRECTION_RANDOM;
+
+				// In odd hexagon rows, the diagonals lead one column further east
+				uint32_t shift = direction_dy[direction] ? odd : 0;
+				uint32_t nx = x + (uint32_t)direction_dx[direction] + shift;
+				uint32_t ny = y + (uint32_t)direction_dy[direction];
+				bool valid = from[i] < regions && ((mask >> direction) & 1U);
+				valid = valid && nx < width && ny < height;
+				inside &= from[i] < regions;
+				receivers[i] = valid ? (lp_id_t)ny * width + nx : INVALID_DIRECTION;
 			}
 			break;
+		}
 
-		case TOPOLOGY_SQUARE:
-			__attribute__((fallthrough));
 		case TOPOLOGY_TORUS:
-			for(unsigned i = 0; i < 4; ++i) {
-				lp_id_t receiver = GetReceiver(topology, from, directions_square_torus[i]);
-				if(receiver != INVALID_DIRECTION)
-					*receivers++ = receiver;
+			for(size_t i = 0; i < n; i++) {
+				uint32_t y = (uint32_t)(from[i] / width), x = (uint32_t)(from[i] - (lp_id_t)y * width);
+				unsigned direction = batch_direction(i);
+				// random_range(draw, 4) is the top two bits of the draw
+				if(direction == DIRECTION_RANDOM)
+					direction = directions_square_torus[draws[i] >> 62];
+
+				uint32_t east = x + 1 == width ? 0 : x + 1, west = x == 0 ? width - 1 : x - 1;
+				uint32_t south = y + 1 == height ? 0 : y + 1, north = y == 0 ? height - 1 : y - 1;
+				uint32_t nx = direction == DIRECTION_E ? east : direction == DIRECTION_W ? west : x;
+				uint32_t ny = direction == DIRECTION_S ? south : direction == DIRECTION_N ? north : y;
+				bool valid = from[i] < regions && ((SQUARE_DIRECTIONS >> direction) & 1U);
+				inside &= from[i] < regions;
+				receivers[i] = valid ? (lp_id_t)ny * width + nx : INVALID_DIRECTION;
 			}
 			break;
 
-		case TOPOLOGY_BIDRING:
-			*receivers++ = (from + 1) % topology->regions;
-			*receivers = (from + topology->regions - 1) % topology->regions;
+		case TOPOLOGY_FCMESH:
+			for(size_t i = 0; i < n; i++) {
+				lp_id_t drawn = random_range(draws[i], regions - 1);
+				bool valid = from[i] < regions && batch_direction(i) == DIRECTION_RANDOM && regions > 1;
+				inside &= from[i] < regions;
+				receivers[i] = valid ? drawn + (drawn >= from[i]) : INVALID_DIRECTION;
+			}
+			break;
+
+		case TOPOLOGY_STAR:
+			for(size_t i = 0; i < n; i++) {
+				lp_id_t leaf = 1 + random_range(draws[i], regions - 1);
+				bool valid = from[i] < regions && batch_direction(i) == DIRECTION_RANDOM && regions > 1;
+				inside &= from[i] < regions;
+				receivers[i] = valid ? (from[i] == 0 ? leaf : 0) : INVALID_DIRECTION;
+			}
+			break;
+
+		case TOPOLOGY_RING:
+			for(size_t i = 0; i < n; i++) {
+				unsigned direction = batch_direction(i);
+				lp_id_t next = from[i] + 1 == regions ? 0 : from[i] + 1;
+				bool valid = direction == DIRECTION_E || direction == DIRECTION_RANDOM;
+				inside &= from[i] < regions;
+				receivers[i] = from[i] < regions && valid ? next : INVALID_DIRECTION;
+			}
+			break;
+
+		case TOPOLOGY_BIDRING:
+			for(size_t i = 0; i < n; i++) {
+				unsigned direction = batch_direction(i);
+				lp_id_t next = from[i] + 1 == regions ? 0 : from[i] + 1;
+				lp_id_t previous = from[i] == 0 ? regions - 1 : from[i] - 1;
+				bool random = direction == DIRECTION_RANDOM, high = draws[i] >> 63;
+				bool east = direction == DIRECTION_E || (random && high);
+				bool west = direction == DIRECTION_W || (random && !high);
+				inside &= from[i] < regions;
+				receivers[i] = from[i] >= regions ? INVALID_DIRECTION :
+				    east                          ? next :
+				    west                          ? previous :
+				                                    INVALID_DIRECTION;
+			}
+			break;
+
+		case TOPOLOGY_GRAPH: {
+			bool finalized = graph_is_finalized(topology->graph);
+			for(size_t i = 0; i < n; i++) {
+				if(finalized) {
+					if(i + 2 * BATCH_PREFETCH < n && from[i + 2 * BATCH_PREFETCH] < regions)
+						graph_prefetch_offsets(topology->graph, from[i + 2 * BATCH_PREFETCH]);
+					if(i + BATCH_PREFETCH < n && from[i + BATCH_PREFETCH] < regions)
+						graph_prefetch_edges(topology->graph, from[i + BATCH_PREFETCH]);
+				}
+				enum topology_direction direction = batch_direction(i);
+				inside &= from[i] < regions;
+				receivers[i] = from[i] < regions ? get_neighbor_graph(from[i], topology, direction, draws[i]) :
+				                                   INVALID_DIRECTION;
+			}
+			break;
+		}
+	}
+
+#undef batch_direction
+	return inside;
+}
+
+
+/**
+ * @brief Get the linear ids of the neighbors of a batch of sources
+ *
+ * Explicit directions give the same receivers as GetReceiver(). Random
+ * neighbors are drawn with vector instructions from a separate stream,
+ * seeded by a single draw from @p rng the first time the batch asks for a
+ * random neighbor: a batch is reproducible given the state of @p rng, but it
+ * does not pick the same random neighbors as the same queries issued one at
+ * a time with GetReceiverWithRng(). The geometry is dispatched once per
+ * batch, and the memory accesses of consecutive graph queries overlap.
+ * Queries from sources which do not belong to the topology, or in directions
+ * which do not exist, give INVALID_DIRECTION.
+ *
+ * @param topology   The structure keeping the information about the topology
+ * @param n          The number of queries
+ * @param from       The source of every query
+ * @param directions The direction of every query, NULL to ask for a random neighbor of every source
+ * @param receivers  An array of @p n elements to store the neighbor of every query
+ * @param rng        The random state to draw from, NULL to use the state of the calling thread
+ */
+void GetReceiversBatch(struct topology *topology, size_t n, const lp_id_t from[],
+    const enum topology_direction directions[], lp_id_t receivers[], struct topology_rng *rng)
+{
+	uint64_t draws[BATCH_CHUNK] = {0};
+	struct random_lanes lanes;
+	bool seeded = false, inside = true;
+
+	assert(topology);
+
+	for(size_t base = 0; base < n; base += BATCH_CHUNK) {
+		size_t size = n - base < BATCH_CHUNK ? n - base : BATCH_CHUNK;
+		const enum topology_direction *chunk = directions != NULL ? directions + base : NULL;
+		bool random = chunk == NULL;
+
+		for(size_t i = 0; i < size && !random; i++)
+			random = chunk[i] == DIRECTION_RANDOM;
+		if(random) {
+			if(!seeded)
+				random_lanes_init(&lanes, random_stream_u64(rng != NULL ? rng : random_thread_rng()), 0);
+			seeded = true;
+			random_lanes_u64(&lanes, draws, size);
+		}
+		inside &= receivers_chunk(topology, size, from + base, chunk, draws, receivers + base);
+	}
+
+	if(unlikely(!inside))
+		fprintf(stderr, "[ERROR] Some `from` in the batch does not belong to the topology.\n");
+}
+
+/**
+ * Populate an array of all neighbors of a given element.
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param from      The linear representation of the source element
+ * @param receivers An array of lp_id_t to store the neighbors. Can be preallocated externally using CountDirections().
+ */
+void GetAllReceivers(struct topology *topology, lp_id_t from, lp_id_t *receivers)
+{
+	struct graph_edges edges;
+
+	if(unlikely(from >= topology->regions)) {
+		fprintf(stderr, "[ERROR] `from` does not belong to the topology.\n");
+		return;
+	}
+
+	switch(topology->geometry) {
+		case TOPOLOGY_HEXAGON:
+			for(unsigned i = 0; i < 6; ++i) {
+				lp_id_t receiver = GetReceiver(topology, from, directions_hexagon[i]);
+				if(receiver != INVALID_DIRECTION)
+					*receivers++ = receiver;
+			}
+			break;
+
+		case TOPOLOGY_SQUARE:
+			__attribute__((fallthrough));
+		case TOPOLOGY_TORUS:
+			for(unsigned i = 0; i < 4; ++i) {
+				lp_id_t receiver = GetReceiver(topology, from, directions_square_torus[i]);
+				if(receiver != INVALID_DIRECTION)
+					*receivers++ = receiver;
+			}
+			break;
+
+		case TOPOLOGY_BIDRING:
+			*receivers++ = (from + 1) % topology->regions;
+			*receivers = (from + topology->regions - 1) % topology->regions;
 			break;
 
 		case TOPOLOGY_RING:
@@ -648,11 +1305,12 @@ void GetAllReceivers(struct topology *topology, lp_id_t from, lp_id_t *receivers
 			break;
 
 		case TOPOLOGY_GRAPH:
-			adj_node = list_head(topology->adjacency[from]);
-			while(adj_node != NULL) {
-				*receivers++ = adj_node->neighbor;
-				adj_node = list_next(adj_node);
-			}
+			edges = graph_out_edges(topology->graph, from);
+			if(edges.neighbors_compact != NULL)
+				for(size_t i = 0; i < edges.size; i++)
+					receivers[i] = edges.neighbors_compact[i];
+			else if(edges.size != 0)
+				memcpy(receivers, edges.neighbors, edges.size * sizeof(*receivers));
 			break;
 
 		case TOPOLOGY_STAR:
@@ -665,6 +1323,343 @@ void GetAllReceivers(struct topology *topology, lp_id_t from, lp_id_t *receivers
 }
 
 
+/// A set of distinct values drawn by GetRandomReceivers(), hashed with open addressing
+struct receiver_set {
+	uint64_t *slots;                    /**< The values of the set plus one, 0 for empty slots */
+	uint64_t mask;                      /**< The number of slots minus one, a power of two minus one */
+	uint64_t local[RECEIVER_SET_LOCAL]; /**< The slots of small sets, to avoid an allocation */
+};
+
+/// A candidate receiver of a weighted sample, with its Efraimidis-Spirakis key
+struct receiver_key {
+	double key;  /**< log(u) / w for a uniform u in (0, 1] and the weight w of the edge: the largest keys win */
+	size_t edge; /**< The index of the out-edge */
+};
+
+
+/**
+ * @brief Prepare an empty set with room for a number of values
+ * @param set   The set to initialize
+ * @param count The largest number of values which will be inserted
+ * @return true on success, false if the slots could not be allocated
+ */
+static bool receiver_set_init(struct receiver_set *set, size_t count)
+{
+	uint64_t size = RECEIVER_SET_LOCAL;
+
+	while(size < 2 * (uint64_t)count)
+		size *= 2;
+	set->mask = size - 1;
+	if(size == RECEIVER_SET_LOCAL) {
+		memset(set->local, 0, sizeof(set->local));
+		set->slots = set->local;
+		return true;
+	}
+	set->slots = calloc(size, sizeof(*set->slots));
+	return set->slots != NULL;
+}
+
+
+/**
+ * @brief Release the slots of a set
+ * @param set The set to release
+ */
+static void receiver_set_release(struct receiver_set *set)
+{
+	if(set->slots != set->local)
+		free(set->slots);
+}
+
+
+/**
+ * @brief Find the slot of a value in a set
+ * @param set   The set to look up
+ * @param value The value to look for
+ * @return the slot keeping @p value, or the empty slot where it belongs
+ */
+static uint64_t *receiver_set_slot(const struct receiver_set *set, uint64_t value)
+{
+	uint64_t i = random_mix(value) & set->mask;
+
+	while(set->slots[i] != 0 && set->slots[i] != value + 1)
+		i = (i + 1) & set->mask;
+	return &set->slots[i];
+}
+
+
+/**
+ * @brief Insert a value in a set
+ * @param set   The set to update
+ * @param value The value to insert
+ * @return true if @p value was inserted, false if it was already in the set
+ */
+static bool receiver_set_insert(struct receiver_set *set, uint64_t value)
+{
+	uint64_t *slot = receiver_set_slot(set, value);
+
+	if(*slot != 0)
+		return false;
+	*slot = value + 1;
+	return true;
+}
+
+
+/**
+ * @brief Move the candidate at the root of a min-heap of keys down to its place
+ * @param heap The heap, whose root may be out of place
+ * @param size The number of candidates in the heap
+ */
+static void receiver_heap_sift(struct receiver_key *heap, size_t size)
+{
+	struct receiver_key root = heap[0];
+	size_t i = 0, child;
+
+	while((child = 2 * i + 1) < size) {
+		if(child + 1 < size && heap[child + 1].key < heap[child].key)
+			child++;
+		if(root.key <= heap[child].key)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = root;
+}
+
+
+/**
+ * @brief Draw distinct values out of [0, n) with Floyd's algorithm
+ *
+ * @param n      The size of the range, larger than @p k
+ * @param k      The number of values to draw
+ * @param values An array of @p k elements to store the values, in no particular order
+ * @param rng    The random state to draw from
+ * @return true on success, false if the set of drawn values could not be allocated
+ */
+static bool random_distinct(uint64_t n, uint64_t k, lp_id_t values[], struct topology_rng *rng)
+{
+	struct receiver_set set;
+
+	if(unlikely(!receiver_set_init(&set, k)))
+		return false;
+
+	for(uint64_t j = n - k; j < n; j++) {
+		uint64_t value = random_range(random_stream_u64(rng), j + 1);
+		if(!receiver_set_insert(&set, value)) {
+			value = j;
+			receiver_set_insert(&set, value);
+		}
+		*values++ = value;
+	}
+
+	receiver_set_release(&set);
+	return true;
+}
+
+
+/**
+ * @brief Draw distinct out-edges of a graph node, each time with a probability proportional to its weight
+ *
+ * Drawing neighbors with graph_sample() and rejecting the ones already drawn
+ * picks every neighbor with a probability proportional to its weight among
+ * the ones left, which is the definition of weighted sampling without
+ * replacement. This costs a single graph_sample() per neighbor as long as
+ * the neighbors drawn carry a small share of the total weight. After as many
+ * rejections as neighbors asked for, the remaining neighbors are drawn at
+ * once with the keys of Efraimidis and Spirakis, which give the same
+ * distribution at a cost of O(d log k) on a node with d out-edges. Edges
+ * without weight are never drawn, unless no edge of the node has weight, in
+ * which case every edge is equally likely, as with GetReceiver().
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param from      The node whose out-edges are drawn
+ * @param k         The number of out-edges to draw, at most the out-degree of @p from
+ * @param receivers An array of @p k elements to store the neighbors
+ * @param rng       The random state to draw from
+ * @return The number of neighbors drawn, INVALID_DIRECTION if memory could not be allocated
+ */
+static lp_id_t random_receivers_graph(struct topology *topology, lp_id_t from, lp_id_t k, lp_id_t receivers[],
+    struct topology_rng *rng)
+{
+	struct graph_edges edges = graph_out_edges(topology->graph, from);
+	struct receiver_set set;
+	struct receiver_key *heap;
+	lp_id_t count = 0, rejections = 0;
+	size_t size = 0;
+	bool uniform = true;
+
+	if(unlikely(!receiver_set_init(&set, k)))
+		return INVALID_DIRECTION;
+
+	while(count < k && rejections < k && graph_has_fast_sampling(topology->graph)) {
+		size_t edge = graph_sample(topology->graph, from, random_stream_double(rng));
+		if(!(graph_get_probability(topology->graph, from, edge) > 0.0))
+			break;
+		if(receiver_set_insert(&set, edge))
+			receivers[count++] = graph_neighbor(&edges, edge);
+		else
+			rejections++;
+	}
+
+	if(count == k) {
+		receiver_set_release(&set);
+		return count;
+	}
+
+	heap = malloc((k - count) * sizeof(*heap));
+	if(unlikely(heap == NULL)) {
+		receiver_set_release(&set);
+		return INVALID_DIRECTION;
+	}
+
+	for(size_t edge = 0; edge < edges.size && uniform; edge++)
+		uniform = !(graph_get_probability(topology->graph, from, edge) > 0.0);
+
+	for(size_t edge = 0; edge < edges.size; edge++) {
+		double weight = uniform ? 1.0 : graph_get_probability(topology->graph, from, edge);
+		if(!(weight > 0.0) || *receiver_set_slot(&set, edge) != 0)
+			continue;
+
+		double key = log((double)((random_stream_u64(rng) >> 11) + 1) * 0x1.0p-53) / weight;
+		if(size < k - count) {
+			heap[size] = (struct receiver_key){key, edge};
+			// Restore the heap bottom-up
+			for(size_t i = size++; i > 0 && heap[(i - 1) / 2].key > heap[i].key; i = (i - 1) / 2) {
+				struct receiver_key parent = heap[(i - 1) / 2];
+				heap[(i - 1) / 2] = heap[i];
+				heap[i] = parent;
+			}
+		} else if(key > heap[0].key) {
+			heap[0] = (struct receiver_key){key, edge};
+			receiver_heap_sift(heap, size);
+		}
+	}
+
+	for(size_t i = 0; i < size; i++)
+		receivers[count++] = graph_neighbor(&edges, heap[i].edge);
+
+	free(heap);
+	receiver_set_release(&set);
+	return count;
+}
+
+
+/**
+ * @brief Draw distinct random neighbors of a given element
+ *
+ * This replaces calling GetReceiver() with DIRECTION_RANDOM in a loop and
+ * discarding the duplicates, which takes longer and longer as @p k gets
+ * close to the number of neighbors. The neighbors of grids and rings are
+ * shuffled with a partial Fisher-Yates shuffle, and the neighbors of meshes
+ * and of the center of a star are drawn with Floyd's algorithm, in O(k)
+ * time. Graph neighbors are drawn without replacement, each time with a
+ * probability proportional to the weight of the link among the links not
+ * drawn yet, in O(k) or O(k log d) time as long as the neighbors drawn carry
+ * a small share of the weight of the d out-edges, and in O(d log k) time at
+ * worst. Links with no weight are never drawn.
+ *
+ * The random numbers are drawn from the random state of the calling thread,
+ * see GetRandomReceiversWithRng() to draw from a given one.
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param from      The linear representation of the source element
+ * @param k         The number of neighbors to draw
+ * @param receivers An array of @p k elements to store the neighbors, in no particular order
+ * @return The number of neighbors drawn, less than @p k if @p from has fewer neighbors, 0 on error
+ */
+lp_id_t GetRandomReceivers(struct topology *topology, lp_id_t from, lp_id_t k, lp_id_t receivers[])
+{
+	return GetRandomReceiversWithRng(topology, from, k, receivers, random_thread_rng());
+}
+
+
+/**
+ * @brief Draw distinct random neighbors of a given element, from a given random state
+ *
+ * This draws the same way as GetRandomReceivers(), but takes the random
+ * numbers from @p rng, so that a thread, or an LP, keeping its own state
+ * draws reproducible receivers, for instance to replay an event after a
+ * rollback by restoring the state.
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param from      The linear representation of the source element
+ * @param k         The number of neighbors to draw
+ * @param receivers An array of @p k elements to store the neighbors, in no particular order
+ * @param rng       The random state to draw from, initialized with InitializeTopologyRng()
+ * @return The number of neighbors drawn, less than @p k if @p from has fewer neighbors, 0 on error
+ */
+lp_id_t GetRandomReceiversWithRng(struct topology *topology, lp_id_t from, lp_id_t k, lp_id_t receivers[],
+    struct topology_rng *rng)
+{
+	lp_id_t neighbors[6], count, regions;
+
+	assert(topology);
+
+	if(unlikely(from >= topology->regions)) {
+		fprintf(stderr, "[ERROR] `from` does not belong to the topology.\n");
+		return 0;
+	}
+
+	regions = topology->regions;
+	switch(topology->geometry) {
+		case TOPOLOGY_HEXAGON:
+		case TOPOLOGY_SQUARE:
+		case TOPOLOGY_TORUS:
+		case TOPOLOGY_RING:
+		case TOPOLOGY_BIDRING:
+			// Degenerate tori and rings reach the same neighbor through more than one direction
+			GetAllReceivers(topology, from, neighbors);
+			count = 0;
+			for(lp_id_t i = 0; i < CountDirections(topology, from); i++) {
+				lp_id_t j = 0;
+				while(j < count && neighbors[j] != neighbors[i])
+					j++;
+				if(j == count)
+					neighbors[count++] = neighbors[i];
+			}
+			k = k < count ? k : count;
+			for(lp_id_t i = 0; i < k; i++) {
+				lp_id_t j = i + random_range(random_stream_u64(rng), count - i);
+				receivers[i] = neighbors[j];
+				neighbors[j] = neighbors[i];
+			}
+			return k;
+
+		case TOPOLOGY_STAR:
+			if(from != 0) {
+				if(k > 0)
+					receivers[0] = 0;
+				return k > 0;
+			}
+			__attribute__((fallthrough));
+		case TOPOLOGY_FCMESH:
+			// Every other region is a neighbor: draw positions among them and skip the source
+			k = k < regions - 1 ? k : regions - 1;
+			if(k == regions - 1) {
+				for(lp_id_t i = 0; i < k; i++)
+					receivers[i] = i;
+			} else if(unlikely(!random_distinct(regions - 1, k, receivers, rng))) {
+				fprintf(stderr, "[ERROR] Unable to allocate memory to draw the receivers.\n");
+				return 0;
+			}
+			for(lp_id_t i = 0; i < k; i++)
+				receivers[i] += receivers[i] >= from;
+			return k;
+
+		case TOPOLOGY_GRAPH:
+			count = graph_out_edges(topology->graph, from).size;
+			if(k == 0 || count == 0)
+				return 0;
+			count = random_receivers_graph(topology, from, k < count ? k : count, receivers, rng);
+			if(unlikely(count == INVALID_DIRECTION)) {
+				fprintf(stderr, "[ERROR] Unable to allocate memory to draw the receivers.\n");
+				return 0;
+			}
+			return count;
+	}
+	return 0;
+}
+
+
 /** Count the number of inboud edges to a graph node.
  *
  * @param topology  The structure keeping the information about the topology
@@ -672,38 +1667,33 @@ void GetAllReceivers(struct topology *topology, lp_id_t from, lp_id_t *receivers
  */
 lp_id_t CountSources(struct topology *topology, lp_id_t me)
 {
-	lp_id_t count = 0;
-
 	if(topology->geometry != TOPOLOGY_GRAPH) {
 		fprintf(stderr, "[WARNING] GetAllSources is meaningful for graph topologies only!\n");
 		return 0;
 	}
 
-	// Iterate over all the adjacency lists of all nodes to see whether we are the target of some edge
-	for(size_t i = 0; i < topology->regions; i++) {
-		struct graph_node *adj_node = list_head(topology->adjacency[i]);
-		while(adj_node != NULL) {
-			if(adj_node->neighbor == me) {
-				count++;
-				break;
-			}
-			adj_node = list_next(adj_node);
-		}
+	if(unlikely(me >= topology->regions)) {
+		fprintf(stderr, "[ERROR] `me` does not belong to the topology.\n");
+		return 0;
 	}
 
-	return count;
+	return graph_in_degree(topology->graph, me);
 }
 
 /**
  * Populate an array of all source nodes in a topology graph.
  *
+ * Sources are reported in increasing order. The graph keeps an index of the
+ * in-edges of every node, so this costs time proportional to the in-degree
+ * of @p to.
+ *
  * @param topology  The structure keeping the information about the topology
- * @param from      The linear representation of the destination element
- * @param sources   An array of lp_id_t to store the neighbors. Can be preallocated externally using CountDirections().
+ * @param to        The linear representation of the destination element
+ * @param sources   An array of lp_id_t to store the neighbors. Can be preallocated externally using CountSources().
  */
 void GetAllSources(struct topology *topology, lp_id_t to, lp_id_t *sources)
 {
-	struct graph_node *adj_node;
+	struct graph_sources in_edges;
 
 	if(topology->geometry != TOPOLOGY_GRAPH) {
 		fprintf(stderr, "[WARNING] GetAllSources is meaningful for graph topologies only!\n");
@@ -715,17 +1705,12 @@ void GetAllSources(struct topology *topology, lp_id_t to, lp_id_t *sources)
 		return;
 	}
 
-	// Iterate ove all the adjacency lists of all nodes to see whether we are the target of some edge
-	for(size_t i = 0; i < topology->regions; i++) {
-		adj_node = list_head(topology->adjacency[i]);
-		while(adj_node != NULL) {
-			if(adj_node->neighbor == to) {
-				*sources++ = i;
-				break;
-			}
-			adj_node = list_next(adj_node);
-		}
-	}
+	in_edges = graph_in_edges(topology->graph, to);
+	if(in_edges.sources_compact != NULL)
+		for(size_t i = 0; i < in_edges.size; i++)
+			sources[i] = in_edges.sources_compact[i];
+	else if(in_edges.size != 0)
+		memcpy(sources, in_edges.sources, in_edges.size * sizeof(*sources));
 }
 
 /**
@@ -806,30 +1791,17 @@ struct topology *vInitializeTopology(enum topology_geometry geometry, int argc,
 	topology->width = width;
 	topology->height = height;
 
-	// In case of a graph, allocate empty adjacency lists for all nodes
-	size_t i; // This is global for error recovery below, at label err2.
+	// In case of a graph, allocate empty adjacency rows for all nodes
 	if(topology->geometry == TOPOLOGY_GRAPH) {
-		topology->adjacency = malloc(sizeof(list(struct graph_node)) * regions);
-		if(topology->adjacency == NULL)
+		topology->graph = graph_new(regions);
+		if(topology->graph == NULL)
 			goto err1;
-
-		for(i = 0; i < regions; i++) {
-			topology->adjacency[i] = new_list(struct graph_node);
-			if(topology->adjacency[i] == NULL)
-				goto err2;
-		}
 	}
 
 out:
 	va_end(args);
 	return topology;
 
-err2:
-	// Free the memory that has been partially allocated
-	for(size_t k = 0; k < i; ++k)
-		free(topology->adjacency[k]);
-	free(topology->adjacency);
-
 err1:
 	free(topology);
 	topology = NULL;
@@ -839,84 +1811,911 @@ err1:
 
 void ReleaseTopology(struct topology *topology)
 {
-	if(topology->geometry == TOPOLOGY_GRAPH && topology->adjacency != NULL) {
-		for(size_t i = 0; i < topology->regions; i++) {
-			struct graph_node *curr;
-			while((curr = list_head(topology->adjacency[i])) != NULL) {
-				list_detach_by_content(topology->adjacency[i], curr);
-				free(curr);
-			}
-			free(topology->adjacency[i]);
-		}
-		free(topology->adjacency);
-	}
+	if(topology->geometry == TOPOLOGY_GRAPH && topology->graph != NULL)
+		graph_release(topology->graph);
+	free(topology->positions);
 	free(topology);
 }
 
 
-bool AddTopologyLink(struct topology *topology, lp_id_t from, lp_id_t to, double probability)
+/**
+ * @brief Save a topology to a file
+ *
+ * The file can be later loaded with MapTopology(), possibly by several
+ * processes at once. Graph topologies are finalized before being saved, and
+ * neither the custom data nor the attributes of their links are saved, nor
+ * the positions of the regions of geometric graphs. Files are written in
+ * the native byte order, and can only be mapped on machines sharing it.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @param path     The path of the file to write
+ * @return true on success, false otherwise
+ */
+bool SaveTopology(struct topology *topology, const char *path)
 {
-	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
-		fprintf(stderr, "[ERROR] Setting a weighted link in a topology which is not a graph.");
-		return false;
-	}
-
-	if(unlikely(probability < 0)) {
-		fprintf(stderr, "[ERROR] Setting a link probability < 0.");
-		return false;
-	}
-
-	if(unlikely(probability > 1)) {
-		fprintf(stderr, "[ERROR] Setting a link probability > 1.");
+	struct storage_shape shape = {
+		.geometry = topology->geometry,
+		.regions = topology->regions,
+		.width = topology->width,
+		.height = topology->height
+	};
+
+	if(unlikely(!FinalizeTopology(topology)))
 		return false;
-	}
+	return storage_save(path, &shape, topology->graph);
+}
 
-	assert(topology->adjacency != NULL);
-	assert(from < topology->regions);
-	assert(to < topology->regions);
 
-	// Get the correct adjacency list
-	list(struct graph_node) list = topology->adjacency[from];
+/**
+ * @brief Load a topology from a file written by SaveTopology()
+ *
+ * The file is mapped read-only in memory and used in place, so this costs
+ * time independent of the size of the topology, and concurrent processes
+ * share the same physical copy of the file. The links of a mapped graph
+ * cannot be modified. The topology must be released with ReleaseTopology().
+ *
+ * @param path The path of the file to load
+ * @return A pointer to the topology structure, NULL on failure
+ */
+struct topology *MapTopology(const char *path)
+{
+	struct storage_shape shape;
+	struct graph *graph;
 
-	// See if there is already a node representing the link
-	struct graph_node *element = list_head(list);
-	while(element && element->neighbor != to)
-		element = list_next(element);
+	if(!storage_map(path, &shape, &graph))
+		return NULL;
 
-	if(element == NULL) {
-		element = malloc(sizeof(*element));
-		element->neighbor = to;
-		list_insert_tail(list, element);
+	struct topology *topology = malloc(sizeof(*topology));
+	if(unlikely(topology == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for the topology.");
+		if(graph != NULL)
+			graph_release(graph);
+		return NULL;
 	}
+	memset(topology, 0, sizeof(*topology));
 
-	element->probability = probability;
-	return true;
+	topology->regions = shape.regions;
+	topology->geometry = shape.geometry;
+	topology->width = shape.width;
+	topology->height = shape.height;
+	topology->graph = graph;
+	return topology;
 }
 
-bool SetTopologyLinkData(struct topology *topology, lp_id_t from, lp_id_t to, void *data)
-{
-	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
-		fprintf(stderr, "[ERROR] Setting a weighted link in a topology which is not a graph.");
-		return false;
-	}
 
-	assert(topology->adjacency != NULL);
-	assert(from < topology->regions);
-	assert(to < topology->regions);
+/**
+ * @brief Build a graph topology from generated links
+ *
+ * The probabilities of the links of every node are made proportional to
+ * their weights, or all equal if no weights are given. The generated links
+ * and weights are released in any case.
+ *
+ * @param regions       The number of nodes of the graph
+ * @param ok            Whether the links were generated successfully
+ * @param keys          The generated links, packed as graph_build() expects them
+ * @param probabilities The bit patterns of the weights of the links, NULL if all links weigh the same
+ * @param n             The number of generated links
+ * @return A pointer to the finalized topology structure, NULL on failure
+ */
+static struct topology *generated_topology(lp_id_t regions, bool ok, uint64_t *keys, uint64_t *probabilities,
+    size_t n)
+{
+	struct topology *topology = NULL;
+
+	if(ok && probabilities == NULL) {
+		double probability = 1.0;
+		uint64_t one;
+
+		probabilities = malloc((n + 1) * sizeof(*probabilities));
+		if(probabilities != NULL) {
+			memcpy(&one, &probability, sizeof(one));
+			parallel_for(n > PARALLEL_MIN_WORK)
+			for(size_t i = 0; i < n; i++)
+				probabilities[i] = one;
+		}
+	}
+	if(unlikely(!ok || probabilities == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory to generate the topology.");
+		goto out;
+	}
+
+	topology = InitializeTopology(TOPOLOGY_GRAPH, (unsigned)regions);
+	if(unlikely(topology == NULL))
+		goto out;
+	if(unlikely(!graph_build(topology->graph, n, keys, probabilities))) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory to generate the topology.");
+		ReleaseTopology(topology);
+		topology = NULL;
+		goto out;
+	}
+	graph_normalize(topology->graph);
+
+out:
+	free(keys);
+	free(probabilities);
+	return topology;
+}
+
+
+/**
+ * @brief Generate an Erdős-Rényi random graph topology
+ *
+ * Every pair of distinct nodes is linked, in both directions, with
+ * probability @p probability. Gaps between links are drawn from a geometric
+ * distribution, so that generation costs time proportional to the number of
+ * links, and nodes are generated in parallel. All the links of a node are
+ * equally likely. The same seed always gives the same graph.
+ *
+ * @param regions     The number of nodes
+ * @param probability The probability that two nodes are linked
+ * @param seed        The seed of the random graph
+ * @return A pointer to the finalized topology structure, NULL on failure
+ */
+struct topology *GenerateErdosRenyiTopology(lp_id_t regions, double probability, uint64_t seed)
+{
+	uint64_t *keys = NULL;
+	size_t n = 0;
+
+	if(unlikely(regions == 0 || regions > UINT_MAX)) {
+		fprintf(stderr, "[ERROR] Unsupported number of nodes.");
+		return NULL;
+	}
+
+	if(unlikely(!(probability >= 0 && probability <= 1))) {
+		fprintf(stderr, "[ERROR] The probability of a link must be in [0, 1].");
+		return NULL;
+	}
+
+	bool ok = generate_erdos_renyi(regions, probability, seed, &keys, &n);
+	return generated_topology(regions, ok, keys, NULL, n);
+}
+
+
+/**
+ * @brief Generate a Barabási-Albert scale-free graph topology
+ *
+ * Nodes are added one after the other, and every node links, in both
+ * directions, to @p links earlier nodes picked proportionally to their
+ * degree, so that degrees follow a power law. Links picked more than once
+ * are kept once, and self-loops are dropped. All the links are resolved in
+ * parallel. All the links of a node are equally likely. The same seed always
+ * gives the same graph.
+ *
+ * @param regions The number of nodes
+ * @param links   The number of links every node adds, less than @p regions
+ * @param seed    The seed of the random graph
+ * @return A pointer to the finalized topology structure, NULL on failure
+ */
+struct topology *GenerateBarabasiAlbertTopology(lp_id_t regions, unsigned links, uint64_t seed)
+{
+	uint64_t *keys = NULL;
+	size_t n = 0;
+
+	if(unlikely(regions == 0 || regions > UINT_MAX)) {
+		fprintf(stderr, "[ERROR] Unsupported number of nodes.");
+		return NULL;
+	}
+
+	if(unlikely(links == 0 || links >= regions)) {
+		fprintf(stderr, "[ERROR] The number of links per node must be between 1 and the number of nodes.");
+		return NULL;
+	}
+
+	bool ok = generate_barabasi_albert(regions, links, seed, &keys, &n);
+	return generated_topology(regions, ok, keys, NULL, n);
+}
+
+
+/**
+ * @brief Generate a Watts-Strogatz small-world graph topology
+ *
+ * Nodes start on a ring, every node linked to the @p neighbors nodes on
+ * either side. Then, the link from every node to each of its following
+ * neighbors is replaced with probability @p rewiring by a link to a random
+ * node. All links go both ways. All the links of a node are equally likely.
+ * The same seed always gives the same graph.
+ *
+ * @param regions   The number of nodes
+ * @param neighbors The number of nodes every node is initially linked to on either side
+ * @param rewiring  The probability that a link is rewired
+ * @param seed      The seed of the random graph
+ * @return A pointer to the finalized topology structure, NULL on failure
+ */
+struct topology *GenerateWattsStrogatzTopology(lp_id_t regions, unsigned neighbors, double rewiring, uint64_t seed)
+{
+	uint64_t *keys = NULL;
+	size_t n = 0;
+
+	if(unlikely(regions == 0 || regions > UINT_MAX)) {
+		fprintf(stderr, "[ERROR] Unsupported number of nodes.");
+		return NULL;
+	}
+
+	if(unlikely(neighbors == 0 || 2 * (uint64_t)neighbors >= regions)) {
+		fprintf(stderr, "[ERROR] The number of neighbors on either side must be between 1 and half the nodes.");
+		return NULL;
+	}
+
+	if(unlikely(!(rewiring >= 0 && rewiring <= 1))) {
+		fprintf(stderr, "[ERROR] The rewiring probability must be in [0, 1].");
+		return NULL;
+	}
+
+	bool ok = generate_watts_strogatz(regions, neighbors, rewiring, seed, &keys, &n);
+	return generated_topology(regions, ok, keys, NULL, n);
+}
+
+
+/**
+ * @brief Generate an R-MAT graph topology
+ *
+ * The graph has 2^@p scale nodes, and @p links directed links, each placed
+ * by recursively picking one of the quadrants of the adjacency matrix with
+ * probabilities @p a, @p b, @p c and 1 - @p a - @p b - @p c. This samples a
+ * stochastic Kronecker graph with skewed degrees and community structure;
+ * the Graph500 benchmark uses a = 0.57 and b = c = 0.19. Links picked more
+ * than once are kept once, and self-loops are dropped. All the links of a
+ * node are equally likely. The same seed always gives the same graph.
+ *
+ * @param scale The base 2 logarithm of the number of nodes, between 1 and 31
+ * @param links The number of links to draw
+ * @param a     The probability of linking a node in the lower half of IDs to a node in the lower half
+ * @param b     The probability of linking a node in the lower half of IDs to a node in the upper half
+ * @param c     The probability of linking a node in the upper half of IDs to a node in the lower half
+ * @param seed  The seed of the random graph
+ * @return A pointer to the finalized topology structure, NULL on failure
+ */
+struct topology *GenerateRmatTopology(unsigned scale, uint64_t links, double a, double b, double c, uint64_t seed)
+{
+	uint64_t *keys = NULL;
+	size_t n = 0;
+
+	if(unlikely(scale == 0 || scale > 31)) {
+		fprintf(stderr, "[ERROR] Unsupported number of nodes.");
+		return NULL;
+	}
+
+	if(unlikely(!(a >= 0 && b >= 0 && c >= 0 && a + b + c <= 1))) {
+		fprintf(stderr, "[ERROR] The quadrant probabilities must be non-negative and sum to at most 1.");
+		return NULL;
+	}
+
+	bool ok = generate_rmat(scale, links, a, b, c, seed, &keys, &n);
+	return generated_topology((lp_id_t)1 << scale, ok, keys, NULL, n);
+}
+
+
+/**
+ * @brief Generate a random geometric graph topology
+ *
+ * Nodes are scattered uniformly at random on the unit square, and every two
+ * nodes closer than @p radius are linked in both directions. The probability
+ * of a link is proportional to 1 - distance / @p radius, so that closer
+ * nodes are more likely receivers. Nodes are binned into a grid of cells as
+ * wide as @p radius, so that the cost is proportional to the number of nodes
+ * plus the number of links. The position of every node can be retrieved with
+ * GetRegionPosition(). The same seed always gives the same graph.
+ *
+ * @param regions The number of nodes
+ * @param radius  The distance below which nodes are linked
+ * @param torus   Whether the square wraps around, so that nodes near opposite sides are close
+ * @param seed    The seed of the random graph
+ * @return A pointer to the finalized topology structure, NULL on failure
+ */
+struct topology *GenerateGeometricTopology(lp_id_t regions, double radius, bool torus, uint64_t seed)
+{
+	uint64_t *keys = NULL, *probabilities = NULL;
+	size_t n = 0;
+
+	if(unlikely(regions == 0 || regions > UINT_MAX)) {
+		fprintf(stderr, "[ERROR] Unsupported number of nodes.");
+		return NULL;
+	}
+
+	if(unlikely(!(radius > 0) || !isfinite(radius))) {
+		fprintf(stderr, "[ERROR] The radius must be positive and finite.");
+		return NULL;
+	}
+
+	double *positions = malloc(2 * regions * sizeof(*positions));
+	if(unlikely(positions == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory to generate the topology.");
+		return NULL;
+	}
+
+	bool ok = generate_geometric(regions, radius, torus, seed, positions, &keys, &probabilities, &n);
+	struct topology *topology = generated_topology(regions, ok, keys, probabilities, n);
+	if(unlikely(topology == NULL)) {
+		free(positions);
+		return NULL;
+	}
+	topology->positions = positions;
+	return topology;
+}
+
+
+/**
+ * @brief Generate a stochastic block model graph topology
+ *
+ * Nodes are split in @p blocks communities, and every two distinct nodes are
+ * linked in both directions with the probability given for their pair of
+ * blocks, typically higher within a block than across blocks. Gaps between
+ * links are drawn from a geometric distribution, so that the cost is
+ * proportional to the number of links plus the number of nodes times the
+ * number of blocks. Nodes are assigned to blocks at random rather than by
+ * consecutive IDs, and the assignment is returned as the ground truth of
+ * community detection or partitioning. All the links of a node are equally
+ * likely. The same seed always gives the same graph.
+ *
+ * @param blocks        The number of blocks
+ * @param sizes         The number of nodes of every block, each at least 1
+ * @param probabilities The probability of a link between two nodes of every pair of blocks, a symmetric
+ *                      @p blocks x @p blocks row-major matrix
+ * @param seed          The seed of the random graph
+ * @param block         An array of as many elements as nodes to store the block of every node, can be NULL
+ * @return A pointer to the finalized topology structure, NULL on failure
+ */
+struct topology *GenerateStochasticBlockTopology(unsigned blocks, const lp_id_t sizes[], const double probabilities[],
+    uint64_t seed, unsigned block[])
+{
+	uint64_t *keys = NULL, regions = 0;
+	size_t n = 0;
+
+	if(unlikely(blocks == 0)) {
+		fprintf(stderr, "[ERROR] The number of blocks must be at least 1.");
+		return NULL;
+	}
+
+	for(unsigned b = 0; b < blocks; b++) {
+		if(unlikely(sizes[b] == 0 || sizes[b] > UINT_MAX - regions)) {
+			fprintf(stderr, "[ERROR] Unsupported number of nodes.");
+			return NULL;
+		}
+		regions += sizes[b];
+	}
+
+	for(unsigned i = 0; i < blocks; i++) {
+		for(unsigned j = 0; j < blocks; j++) {
+			double probability = probabilities[i * blocks + j];
+			if(unlikely(!(probability >= 0 && probability <= 1) || probability != probabilities[j * blocks + i])) {
+				fprintf(stderr, "[ERROR] The block probabilities must be a symmetric matrix of values in [0, 1].");
+				return NULL;
+			}
+		}
+	}
+
+	bool ok = generate_block_model(blocks, sizes, probabilities, seed, block, &keys, &n);
+	return generated_topology(regions, ok, keys, NULL, n);
+}
+
+
+/**
+ * @brief Get the position of a region of a random geometric graph
+ *
+ * Positions are only known for topologies generated with
+ * GenerateGeometricTopology(), and follow the regions if the topology is
+ * reordered.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @param region   The region to locate
+ * @param x        Where to store the horizontal coordinate, in [0, 1)
+ * @param y        Where to store the vertical coordinate, in [0, 1)
+ * @return true on success, false if the topology has no positions or the region does not exist
+ */
+bool GetRegionPosition(struct topology *topology, lp_id_t region, double *x, double *y)
+{
+	assert(topology);
+
+	if(unlikely(topology->positions == NULL)) {
+		fprintf(stderr, "[ERROR] The topology has no region positions.");
+		return false;
+	}
+
+	if(unlikely(region >= topology->regions)) {
+		fprintf(stderr, "[ERROR] Querying the position of a non-existing region.");
+		return false;
+	}
+
+	*x = topology->positions[2 * region];
+	*y = topology->positions[2 * region + 1];
+	return true;
+}
+
+
+/**
+ * @brief Freeze a graph topology into its compressed sparse row representation
+ *
+ * Graph topologies are built by adding links one at a time, and are then
+ * typically only queried. This function packs the adjacency of all nodes
+ * into contiguous arrays, so that all subsequent queries scan memory
+ * sequentially. After a topology is finalized, the probability and the data
+ * of existing links can still be updated and links can be removed or rewired,
+ * but no new link can be added. Finalizing a topology again reclaims the
+ * memory of the links removed since.
+ *
+ * For geometries other than TOPOLOGY_GRAPH this function does nothing.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @return true on success, false if the memory to pack the graph could not be
+ * allocated. In the latter case, the topology remains usable as it was.
+ */
+bool FinalizeTopology(struct topology *topology)
+{
+	assert(topology);
+
+	if(topology->geometry != TOPOLOGY_GRAPH)
+		return true;
+
+	if(unlikely(!graph_finalize(topology->graph))) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory to finalize the topology.\n");
+		return false;
+	}
+	return true;
+}
+
+
+
+/**
+ * @brief Check the probability of a new link
+ *
+ * Probabilities must lie in [0, 1], unless the topology takes weights, in
+ * which case they can be any finite non-negative value.
+ *
+ * @param topology    The structure keeping the information about the topology
+ * @param probability The probability of the link
+ * @return true if the probability is valid, false otherwise
+ */
+static bool check_link_probability(const struct topology *topology, double probability)
+{
+	if(unlikely(probability < 0)) {
+		fprintf(stderr, "[ERROR] Setting a link probability < 0.");
+		return false;
+	}
+
+	if(unlikely(topology->weights ? !isfinite(probability) : probability > 1)) {
+		fprintf(stderr, topology->weights ? "[ERROR] Setting a link weight which is not finite." :
+		    "[ERROR] Setting a link probability > 1.");
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * @brief Let the links of a graph topology take arbitrary weights
+ *
+ * By default, link probabilities must lie in [0, 1]. In weight mode, links
+ * accept any finite non-negative weight instead. Random neighbors are always
+ * picked with a likelihood proportional to the weight of their link, and
+ * NormalizeLinkProbabilities() turns weights back into probabilities.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @param weights  true to accept weights, false to only accept probabilities
+ * @return true on success, false otherwise
+ */
+bool SetTopologyWeights(struct topology *topology, bool weights)
+{
+	assert(topology);
+
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Link weights are only supported for graphs.");
+		return false;
+	}
+
+	topology->weights = weights;
+	return true;
+}
+
+
+bool AddTopologyLink(struct topology *topology, lp_id_t from, lp_id_t to, double probability)
+{
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Setting a weighted link in a topology which is not a graph.");
+		return false;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return false;
+	}
 
-	// Get the correct adjacency list
-	list(struct graph_node) list = topology->adjacency[from];
+	if(unlikely(!check_link_probability(topology, probability)))
+		return false;
 
-	// See if there is already a node representing the link
-	struct graph_node *element = list_head(list);
-	while(element && element->neighbor != to)
-		element = list_next(element);
+	assert(topology->graph != NULL);
+	assert(from < topology->regions);
+	assert(to < topology->regions);
+
+	// See if there is already an edge representing the link
+	size_t edge = graph_find_edge(topology->graph, from, to);
 
-	if(unlikely(element == NULL)) {
+	if(edge == INVALID_EDGE) {
+		if(unlikely(graph_is_finalized(topology->graph))) {
+			fprintf(stderr, "[ERROR] Adding a link to a finalized topology.");
+			return false;
+		}
+		edge = graph_add_edge(topology->graph, from, to);
+		if(unlikely(edge == INVALID_EDGE)) {
+			fprintf(stderr, "[ERROR] Unable to allocate memory for a new link.");
+			return false;
+		}
+	}
+
+	graph_set_probability(topology->graph, from, edge, probability);
+	if(graph_is_finalized(topology->graph))
+		graph_build_node_sampling(topology->graph, from);
+	return true;
+}
+
+/**
+ * @brief Remove a link from a graph topology
+ *
+ * The other links of @p from keep their order, so that sampling only ever
+ * considers the remaining links. In a finalized topology the memory of
+ * removed links is reclaimed in bulk, once they make up a quarter of all the
+ * links or when the topology is finalized again. The data attached to the
+ * link, if any, is not released, and pointers returned by
+ * GetTopologyLinkAttribute() for the links of a finalized topology are
+ * invalidated.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @param from     The source of the link
+ * @param to       The destination of the link
+ * @return true on success, false otherwise
+ */
+bool RemoveTopologyLink(struct topology *topology, lp_id_t from, lp_id_t to)
+{
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Removing a link from a topology which is not a graph.");
+		return false;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return false;
+	}
+
+	if(unlikely(from >= topology->regions || to >= topology->regions)) {
+		fprintf(stderr, "[ERROR] Removing a link between nodes not belonging to the topology.");
+		return false;
+	}
+
+	size_t edge = graph_find_edge(topology->graph, from, to);
+	if(unlikely(edge == INVALID_EDGE)) {
+		fprintf(stderr, "[ERROR] Removing a non-existing link.");
+		return false;
+	}
+
+	if(unlikely(!graph_remove_edge(topology->graph, from, edge))) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory to remove a link.");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Change the destination of a link of a graph topology
+ *
+ * The link keeps its probability, its data and its attributes, and this
+ * works on finalized topologies too. In a finalized topology, the link is
+ * also moved among the sources of the nodes, using the free room kept next
+ * to them, so that CountSources() and GetAllSources() never update the
+ * topology and can be called concurrently. The sources are spread out again
+ * only when the room close to a node runs out, so the amortized cost of a
+ * rewire does not grow with the size of the topology.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @param from     The source of the link
+ * @param to       The current destination of the link
+ * @param new_to   The new destination of the link
+ * @return true on success, false otherwise
+ */
+bool RewireTopologyLink(struct topology *topology, lp_id_t from, lp_id_t to, lp_id_t new_to)
+{
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Rewiring a link in a topology which is not a graph.");
+		return false;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return false;
+	}
+
+	if(unlikely(from >= topology->regions || to >= topology->regions || new_to >= topology->regions)) {
+		fprintf(stderr, "[ERROR] Rewiring a link between nodes not belonging to the topology.");
+		return false;
+	}
+
+	size_t edge = graph_find_edge(topology->graph, from, to);
+	if(unlikely(edge == INVALID_EDGE)) {
+		fprintf(stderr, "[ERROR] Rewiring a non-existing link.");
+		return false;
+	}
+
+	if(new_to == to)
+		return true;
+
+	if(unlikely(graph_find_edge(topology->graph, from, new_to) != INVALID_EDGE)) {
+		fprintf(stderr, "[ERROR] Rewiring a link onto an existing link.");
+		return false;
+	}
+
+	if(unlikely(!graph_rewire_edge(topology->graph, from, edge, new_to))) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory to rewire a link.");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Add a batch of weighted links to a graph topology
+ *
+ * This is equivalent to calling AddTopologyLink() on every link of the batch
+ * in order, and then SetTopologyLinkData() if @p data is not NULL, but it is
+ * much faster on large batches: the links are sorted once and laid out in
+ * their adjacency rows in a single pass. As with AddTopologyLink(), if a
+ * link appears more than once, the last occurrence wins.
+ *
+ * @param topology      The structure keeping the information about the topology
+ * @param n             The number of links in the batch
+ * @param from          The sources of the links
+ * @param to            The destinations of the links
+ * @param probabilities The probabilities of the links
+ * @param data          The custom data to attach to the links, or NULL
+ * @return true on success, false otherwise. No link is added if some
+ * parameter is invalid.
+ */
+bool AddTopologyLinks(struct topology *topology, size_t n, const lp_id_t from[], const lp_id_t to[],
+    const double probabilities[], void *const data[])
+{
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Setting a weighted link in a topology which is not a graph.");
+		return false;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return false;
+	}
+
+	for(size_t i = 0; i < n; i++) {
+		if(unlikely(from[i] >= topology->regions || to[i] >= topology->regions)) {
+			fprintf(stderr, "[ERROR] Setting a link between nodes not belonging to the topology.");
+			return false;
+		}
+		if(unlikely(!check_link_probability(topology, probabilities[i])))
+			return false;
+	}
+
+	if(unlikely(!graph_add_edges(topology->graph, n, from, to, probabilities, data))) {
+		if(graph_is_finalized(topology->graph))
+			fprintf(stderr, "[ERROR] Adding a link to a finalized topology.");
+		else
+			fprintf(stderr, "[ERROR] Unable to allocate memory for new links.");
+		return false;
+	}
+	return true;
+}
+
+/// The links buffered by a single thread of a topology builder
+struct builder_buffer {
+	_Alignas(64) uint64_t *keys; /**< The links, packed as (from << bits) | to */
+	uint64_t *probabilities;     /**< The bit patterns of the probabilities of the links */
+	size_t size;                 /**< The number of buffered links */
+	size_t capacity;             /**< The number of links the buffer can keep */
+};
+
+/// A builder of graph topologies, filled concurrently by several threads
+struct topology_builder {
+	struct topology *topology;        /**< The topology being built */
+	unsigned bits;                    /**< The number of bits of the destination in the packed links */
+	unsigned threads;                 /**< The number of per-thread buffers */
+	struct builder_buffer buffers[];  /**< The per-thread buffers, each on its own cache line */
+};
+
+/**
+ * @brief Start building a graph topology from several threads
+ *
+ * Every thread adds links to its own buffer with AddTopologyBuilderLink(), so
+ * that no synchronization is needed while links are generated. The buffers
+ * are then merged by CommitTopologyBuilder().
+ *
+ * @param topology The structure keeping the information about the topology
+ * @param threads  The number of threads which will add links
+ * @return a pointer to the builder, NULL on failure
+ */
+struct topology_builder *InitializeTopologyBuilder(struct topology *topology, unsigned threads)
+{
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Building links in a topology which is not a graph.");
+		return NULL;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return NULL;
+	}
+	if(unlikely(threads == 0)) {
+		fprintf(stderr, "[ERROR] A topology builder needs at least one thread.");
+		return NULL;
+	}
+
+	struct topology_builder *builder = aligned_alloc(_Alignof(struct builder_buffer),
+	    sizeof(*builder) + threads * sizeof(*builder->buffers));
+	if(unlikely(builder == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for a topology builder.");
+		return NULL;
+	}
+	memset(builder->buffers, 0, threads * sizeof(*builder->buffers));
+	builder->topology = topology;
+	builder->bits = bits_needed(topology->regions - 1);
+	builder->threads = threads;
+	return builder;
+}
+
+/**
+ * @brief Buffer a weighted link in a topology builder
+ *
+ * Different threads can call this function concurrently, as long as each
+ * passes its own @p thread. The link is only added to the topology when the
+ * builder is committed.
+ *
+ * @param builder     The builder to add the link to
+ * @param thread      The index of the calling thread, less than the number of threads of the builder
+ * @param from        The source of the link
+ * @param to          The destination of the link
+ * @param probability The probability of the link
+ * @return true on success, false otherwise
+ */
+bool AddTopologyBuilderLink(struct topology_builder *builder, unsigned thread, lp_id_t from, lp_id_t to,
+    double probability)
+{
+	if(unlikely(thread >= builder->threads)) {
+		fprintf(stderr, "[ERROR] Adding a link from a thread not belonging to the builder.");
+		return false;
+	}
+	if(unlikely(from >= builder->topology->regions || to >= builder->topology->regions)) {
+		fprintf(stderr, "[ERROR] Setting a link between nodes not belonging to the topology.");
+		return false;
+	}
+	if(unlikely(!check_link_probability(builder->topology, probability)))
+		return false;
+
+	struct builder_buffer *buffer = &builder->buffers[thread];
+	if(unlikely(buffer->size == buffer->capacity)) {
+		size_t capacity = buffer->capacity ? 2 * buffer->capacity : 1024;
+		uint64_t *keys = realloc(buffer->keys, capacity * sizeof(*keys));
+		if(keys != NULL)
+			buffer->keys = keys;
+		uint64_t *probabilities = realloc(buffer->probabilities, capacity * sizeof(*probabilities));
+		if(probabilities != NULL)
+			buffer->probabilities = probabilities;
+		if(unlikely(keys == NULL || probabilities == NULL)) {
+			fprintf(stderr, "[ERROR] Unable to allocate memory for new links.");
+			return false;
+		}
+		buffer->capacity = capacity;
+	}
+
+	buffer->keys[buffer->size] = (from << builder->bits) | to;
+	memcpy(&buffer->probabilities[buffer->size], &probability, sizeof(probability));
+	buffer->size++;
+	return true;
+}
+
+/**
+ * @brief Add the links buffered by a topology builder and finalize the topology
+ *
+ * The result is the same as adding the links of every buffer, in increasing
+ * thread order, with AddTopologyLinks() and then calling FinalizeTopology().
+ * If the topology has no links yet, which is the common case, the packed
+ * representation is built directly from the buffered links, spreading the
+ * work over all the available threads.
+ *
+ * The builder is released in any case.
+ *
+ * @param builder The builder to commit
+ * @return true on success, false otherwise
+ */
+bool CommitTopologyBuilder(struct topology_builder *builder)
+{
+	struct topology *topology = builder->topology;
+	uint64_t *keys = NULL, *probabilities = NULL;
+	size_t n = 0;
+	bool ret = false;
+
+	for(unsigned t = 0; t < builder->threads; t++)
+		n += builder->buffers[t].size;
+
+	keys = malloc(n * sizeof(*keys));
+	probabilities = malloc(n * sizeof(*probabilities));
+	if(unlikely(n && (keys == NULL || probabilities == NULL))) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for new links.");
+		goto out;
+	}
+
+	n = 0;
+	for(unsigned t = 0; t < builder->threads; t++) {
+		struct builder_buffer *buffer = &builder->buffers[t];
+		if(buffer->size == 0)
+			continue;
+		memcpy(keys + n, buffer->keys, buffer->size * sizeof(*keys));
+		memcpy(probabilities + n, buffer->probabilities, buffer->size * sizeof(*probabilities));
+		n += buffer->size;
+		free(buffer->keys);
+		free(buffer->probabilities);
+		buffer->keys = buffer->probabilities = NULL;
+		buffer->size = 0;
+	}
+
+	bool empty = !graph_is_finalized(topology->graph);
+	for(lp_id_t i = 0; empty && i < topology->regions; i++)
+		empty = graph_out_edges(topology->graph, i).size == 0;
+
+	if(empty) {
+		ret = graph_build(topology->graph, n, keys, probabilities);
+		if(unlikely(!ret))
+			fprintf(stderr, "[ERROR] Unable to allocate memory for new links.");
+		goto out;
+	}
+
+	// The topology already has links: merge the new ones through the regular bulk path
+	lp_id_t *from = malloc(n * sizeof(*from));
+	lp_id_t *to = malloc(n * sizeof(*to));
+	double *p = malloc(n * sizeof(*p));
+	if(likely(!n || (from != NULL && to != NULL && p != NULL))) {
+		for(size_t i = 0; i < n; i++) {
+			from[i] = keys[i] >> builder->bits;
+			to[i] = keys[i] & (((uint64_t)1 << builder->bits) - 1);
+			memcpy(&p[i], &probabilities[i], sizeof(p[i]));
+		}
+		ret = AddTopologyLinks(topology, n, from, to, p, NULL) && FinalizeTopology(topology);
+	} else {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for new links.");
+	}
+	free(from);
+	free(to);
+	free(p);
+
+out:
+	for(unsigned t = 0; t < builder->threads; t++) {
+		free(builder->buffers[t].keys);
+		free(builder->buffers[t].probabilities);
+	}
+	free(keys);
+	free(probabilities);
+	free(builder);
+	return ret;
+}
+
+bool SetTopologyLinkData(struct topology *topology, lp_id_t from, lp_id_t to, void *data)
+{
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Setting a weighted link in a topology which is not a graph.");
+		return false;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return false;
+	}
+
+	assert(topology->graph != NULL);
+	assert(from < topology->regions);
+	assert(to < topology->regions);
+
+	// See if there is already an edge representing the link
+	size_t edge = graph_find_edge(topology->graph, from, to);
+
+	if(unlikely(edge == INVALID_EDGE)) {
 		fprintf(stderr, "[ERROR] Trying to store data in a non-existing edge.");
 		return false;
 	}
-	element->data = data;
+	if(unlikely(!graph_set_edge_data(topology->graph, from, edge, data))) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for link data.");
+		return false;
+	}
 	return true;
 }
 
@@ -927,22 +2726,166 @@ void *GetTopologyLinkData(struct topology *topology, lp_id_t from, lp_id_t to)
 		return NULL;
 	}
 
-	assert(topology->adjacency != NULL);
+	assert(topology->graph != NULL);
 	assert(from < topology->regions);
 	assert(to < topology->regions);
 
-	// Get the correct adjacency list
-	list(struct graph_node) list = topology->adjacency[from];
-
-	// See if there is already a node representing the link
-	struct graph_node *element = list_head(list);
-	while(element && element->neighbor != to)
-		element = list_next(element);
+	// See if there is already an edge representing the link
+	size_t edge = graph_find_edge(topology->graph, from, to);
 
-	if(unlikely(element == NULL)) {
+	if(unlikely(edge == INVALID_EDGE)) {
 		fprintf(stderr, "[ERROR] Trying to store data in a non-existing edge.");
 		return NULL;
 	}
 
-	return element->data;
+	struct graph_edges edges = graph_out_edges(topology->graph, from);
+	return edges.data != NULL ? edges.data[edge] : NULL;
+}
+
+/**
+ * @brief Add a typed attribute to the links of a graph topology
+ *
+ * Every link gets a zero-filled value of @p size bytes for the new attribute,
+ * for example a latency or a bandwidth. Unlike the custom data set with
+ * SetTopologyLinkData(), the values of an attribute are stored in a single
+ * column following the layout of the links, so no per-link allocation is
+ * needed and the values of the links of a node are contiguous in memory.
+ *
+ * @param topology The structure keeping the information about the topology
+ * @param size     The size of the values of the attribute
+ * @return the identifier of the new attribute, INVALID_ATTRIBUTE on failure
+ */
+unsigned AddTopologyAttribute(struct topology *topology, size_t size)
+{
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Adding a link attribute to a topology which is not a graph.");
+		return INVALID_ATTRIBUTE;
+	}
+
+	if(unlikely(graph_is_mapped(topology->graph))) {
+		fprintf(stderr, "[ERROR] Modifying a topology mapped from a file.");
+		return INVALID_ATTRIBUTE;
+	}
+
+	if(unlikely(size == 0)) {
+		fprintf(stderr, "[ERROR] Adding a link attribute with no size.");
+		return INVALID_ATTRIBUTE;
+	}
+
+	unsigned ret = graph_add_attribute(topology->graph, size);
+	if(unlikely(ret == INVALID_ATTRIBUTE))
+		fprintf(stderr, "[ERROR] Unable to allocate memory for a link attribute.");
+	return ret;
+}
+
+/**
+ * @brief Check the parameters of the functions accessing link attributes
+ * @param topology  The structure keeping the information about the topology
+ * @param attribute The identifier of the attribute
+ * @param from      The node whose links are accessed
+ * @return true if the parameters are valid, false otherwise
+ */
+static bool check_attribute(struct topology *topology, unsigned attribute, lp_id_t from)
+{
+	if(unlikely(topology->geometry != TOPOLOGY_GRAPH)) {
+		fprintf(stderr, "[ERROR] Accessing a link attribute in a topology which is not a graph.");
+		return false;
+	}
+	if(unlikely(attribute >= topology->graph->attributes)) {
+		fprintf(stderr, "[ERROR] Accessing a link attribute which does not exist.");
+		return false;
+	}
+	if(unlikely(from >= topology->regions)) {
+		fprintf(stderr, "[ERROR] Accessing links of a node not belonging to the topology.");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Get a pointer to the value of an attribute of a link
+ *
+ * The value can be read and written through the returned pointer, which
+ * remains valid until links are added to or removed from @p from, or the
+ * topology is finalized.
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param attribute The identifier of the attribute
+ * @param from      The source of the link
+ * @param to        The destination of the link
+ * @return a pointer to the value of the attribute, NULL on failure
+ */
+void *GetTopologyLinkAttribute(struct topology *topology, unsigned attribute, lp_id_t from, lp_id_t to)
+{
+	if(!check_attribute(topology, attribute, from))
+		return NULL;
+
+	size_t edge = graph_find_edge(topology->graph, from, to);
+	if(unlikely(edge == INVALID_EDGE)) {
+		fprintf(stderr, "[ERROR] Accessing an attribute of a non-existing link.");
+		return NULL;
+	}
+
+	unsigned char *values = graph_attribute(topology->graph, attribute, from);
+	if(unlikely(values == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for a link attribute.");
+		return NULL;
+	}
+	return values + edge * topology->graph->attribute_sizes[attribute];
+}
+
+/**
+ * @brief Read the values of an attribute for all the out-links of a node
+ *
+ * The values are copied in the same order as the receivers returned by
+ * GetAllReceivers().
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param attribute The identifier of the attribute
+ * @param from      The node whose out-links are read
+ * @param values    The array to fill, with room for CountDirections() values
+ * @return true on success, false otherwise
+ */
+bool GetTopologyLinkAttributes(struct topology *topology, unsigned attribute, lp_id_t from, void *values)
+{
+	if(!check_attribute(topology, attribute, from))
+		return false;
+
+	const void *column = graph_attribute(topology->graph, attribute, from);
+	if(unlikely(column == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for a link attribute.");
+		return false;
+	}
+	size_t size = graph_out_edges(topology->graph, from).size * topology->graph->attribute_sizes[attribute];
+	if(size)
+		memcpy(values, column, size);
+	return true;
+}
+
+/**
+ * @brief Write the values of an attribute for all the out-links of a node
+ *
+ * The values are taken in the same order as the receivers returned by
+ * GetAllReceivers().
+ *
+ * @param topology  The structure keeping the information about the topology
+ * @param attribute The identifier of the attribute
+ * @param from      The node whose out-links are written
+ * @param values    The CountDirections() values to write
+ * @return true on success, false otherwise
+ */
+bool SetTopologyLinkAttributes(struct topology *topology, unsigned attribute, lp_id_t from, const void *values)
+{
+	if(!check_attribute(topology, attribute, from))
+		return false;
+
+	void *column = graph_attribute(topology->graph, attribute, from);
+	if(unlikely(column == NULL)) {
+		fprintf(stderr, "[ERROR] Unable to allocate memory for a link attribute.");
+		return false;
+	}
+	size_t size = graph_out_edges(topology->graph, from).size * topology->graph->attribute_sizes[attribute];
+	if(size)
+		memcpy(column, values, size);
+	return true;
 }
@@ -0,0 +1,344 @@
+/**
+ * @file test/generators.c
+ *
+ * @brief Test: random graph generators
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include <test.h>
+#include <ROOT-Sim/topology.h>
+
+#define NODES 5000
+#define SEED 42
+#define RADIUS 0.03
+
+static lp_id_t receivers[NODES], sources[NODES];
+
+/**
+ * @brief Check the consistency of a generated topology
+ * @param topology the generated topology
+ * @param symmetric true if every link must have a link in the opposite direction
+ * @return the number of links of @p topology
+ */
+static uint64_t check_generated(struct topology *topology, bool symmetric)
+{
+	uint64_t links = 0;
+
+	test_assert(topology != NULL);
+	for(lp_id_t i = 0; i < CountRegions(topology); i++) {
+		lp_id_t n = CountDirections(topology, i);
+		GetAllReceivers(topology, i, receivers);
+		for(lp_id_t j = 0; j < n; j++) {
+			test_assert(receivers[j] < CountRegions(topology));
+			test_assert(receivers[j] != i);
+			test_assert(!symmetric || IsNeighbor(topology, receivers[j], i));
+		}
+		if(n != 0)
+			test_assert(IsNeighbor(topology, i, GetReceiver(topology, i, DIRECTION_RANDOM)));
+		links += n;
+	}
+	return links;
+}
+
+/**
+ * @brief Check that two topologies have exactly the same links
+ * @param a the first topology
+ * @param b the second topology
+ * @return true if the topologies have the same links, false otherwise
+ */
+static bool same_links(struct topology *a, struct topology *b)
+{
+	if(CountRegions(a) != CountRegions(b))
+		return false;
+	for(lp_id_t i = 0; i < CountRegions(a); i++) {
+		if(CountDirections(a, i) != CountDirections(b, i))
+			return false;
+		GetAllReceivers(a, i, receivers);
+		GetAllReceivers(b, i, sources);
+		for(lp_id_t j = 0; j < CountDirections(a, i); j++)
+			if(receivers[j] != sources[j])
+				return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Find the largest number of links of a node
+ * @param topology the topology to inspect
+ * @return the largest out-degree of @p topology
+ */
+static lp_id_t max_degree(struct topology *topology)
+{
+	lp_id_t ret = 0;
+
+	for(lp_id_t i = 0; i < CountRegions(topology); i++)
+		ret = CountDirections(topology, i) > ret ? CountDirections(topology, i) : ret;
+	return ret;
+}
+
+static int test_erdos_renyi(_unused void *_)
+{
+	struct topology *a = GenerateErdosRenyiTopology(NODES, 0.002, SEED);
+	struct topology *b = GenerateErdosRenyiTopology(NODES, 0.002, SEED);
+	struct topology *c = GenerateErdosRenyiTopology(NODES, 0.002, SEED + 1);
+
+	// About 0.002 * NODES * (NODES - 1) links, with a standard deviation below 1%
+	uint64_t links = check_generated(a, true);
+	test_assert(links > 0.97 * 0.002 * NODES * (NODES - 1) && links < 1.03 * 0.002 * NODES * (NODES - 1));
+	test_assert(same_links(a, b));
+	test_assert(!same_links(a, c));
+	ReleaseTopology(a);
+	ReleaseTopology(b);
+	ReleaseTopology(c);
+
+	a = GenerateErdosRenyiTopology(100, 1.0, SEED);
+	test_assert(check_generated(a, true) == 100 * 99);
+	ReleaseTopology(a);
+	a = GenerateErdosRenyiTopology(100, 0.0, SEED);
+	test_assert(check_generated(a, true) == 0);
+	ReleaseTopology(a);
+	return 0;
+}
+
+static int test_barabasi_albert(_unused void *_)
+{
+	struct topology *a = GenerateBarabasiAlbertTopology(NODES, 3, SEED);
+	struct topology *b = GenerateBarabasiAlbertTopology(NODES, 3, SEED);
+
+	uint64_t links = check_generated(a, true);
+	test_assert(links <= 2 * 3 * NODES && links > 0.9 * 2 * 3 * NODES);
+	test_assert(same_links(a, b));
+	// Preferential attachment grows hubs far above the average degree
+	test_assert(max_degree(a) > 10 * 2 * 3);
+	ReleaseTopology(a);
+	ReleaseTopology(b);
+	return 0;
+}
+
+static int test_watts_strogatz(_unused void *_)
+{
+	struct topology *a = GenerateWattsStrogatzTopology(NODES, 3, 0.0, SEED);
+
+	// Without rewiring, the graph is a ring lattice
+	test_assert(check_generated(a, true) == 2 * 3 * NODES);
+	for(lp_id_t i = 0; i < NODES; i++)
+		for(lp_id_t j = 1; j <= 3; j++)
+			test_assert(IsNeighbor(a, i, (i + j) % NODES) && IsNeighbor(a, i, (i + NODES - j) % NODES));
+	ReleaseTopology(a);
+
+	a = GenerateWattsStrogatzTopology(NODES, 3, 0.1, SEED);
+	struct topology *b = GenerateWattsStrogatzTopology(NODES, 3, 0.1, SEED);
+	uint64_t links = check_generated(a, true);
+	test_assert(links <= 2 * 3 * NODES && links > 0.99 * 2 * 3 * NODES);
+	test_assert(same_links(a, b));
+	unsigned rewired = 0;
+	for(lp_id_t i = 0; i < NODES; i++)
+		for(lp_id_t j = 1; j <= 3; j++)
+			rewired += !IsNeighbor(a, i, (i + j) % NODES);
+	test_assert(rewired > 0.08 * 3 * NODES && rewired < 0.12 * 3 * NODES);
+	ReleaseTopology(a);
+	ReleaseTopology(b);
+	return 0;
+}
+
+static int test_rmat(_unused void *_)
+{
+	struct topology *a = GenerateRmatTopology(12, 8 * 4096, 0.57, 0.19, 0.19, SEED);
+	struct topology *b = GenerateRmatTopology(12, 8 * 4096, 0.57, 0.19, 0.19, SEED);
+
+	test_assert(CountRegions(a) == 4096);
+	uint64_t links = check_generated(a, false);
+	test_assert(links <= 8 * 4096 && links > 0.7 * 8 * 4096);
+	test_assert(same_links(a, b));
+	test_assert(max_degree(a) > 10 * 8);
+	ReleaseTopology(a);
+	ReleaseTopology(b);
+
+	// Uniform quadrants give an Erdős-Rényi-like graph
+	a = GenerateRmatTopology(12, 8 * 4096, 0.25, 0.25, 0.25, SEED);
+	test_assert(max_degree(a) < 4 * 8);
+	ReleaseTopology(a);
+	return 0;
+}
+
+/**
+ * @brief Check that a random geometric graph links exactly the nodes closer than the radius
+ * @param topology the generated topology
+ * @param radius the distance below which nodes are linked
+ * @param torus whether the unit square wraps around
+ */
+static void check_geometric(struct topology *topology, double radius, bool torus)
+{
+	static double x[NODES], y[NODES];
+	lp_id_t regions = CountRegions(topology);
+	uint64_t close = 0;
+
+	for(lp_id_t i = 0; i < regions; i++) {
+		test_assert(GetRegionPosition(topology, i, &x[i], &y[i]));
+		test_assert(x[i] >= 0 && x[i] < 1 && y[i] >= 0 && y[i] < 1);
+	}
+	for(lp_id_t i = 0; i < regions; i++) {
+		for(lp_id_t j = 0; j < regions; j++) {
+			double dx = fabs(x[i] - x[j]), dy = fabs(y[i] - y[j]);
+			if(torus) {
+				dx = fmin(dx, 1 - dx);
+				dy = fmin(dy, 1 - dy);
+			}
+			if(i != j && sqrt(dx * dx + dy * dy) < radius) {
+				test_assert(IsNeighbor(topology, i, j));
+				close++;
+			}
+		}
+	}
+	test_assert(check_generated(topology, true) == close);
+}
+
+static int test_geometric(_unused void *_)
+{
+	struct topology *a = GenerateGeometricTopology(NODES, RADIUS, false, SEED);
+	struct topology *b = GenerateGeometricTopology(NODES, RADIUS, false, SEED);
+
+	check_geometric(a, RADIUS, false);
+	test_assert(same_links(a, b));
+	ReleaseTopology(b);
+
+	// The torus has no boundary, so it links more nodes than the square
+	b = GenerateGeometricTopology(NODES, RADIUS, true, SEED);
+	check_geometric(b, RADIUS, true);
+	test_assert(check_generated(b, true) > check_generated(a, false));
+	ReleaseTopology(b);
+
+	// Positions follow the nodes when the graph is reordered
+	static lp_id_t old_to_new[NODES];
+	static double x[NODES], y[NODES];
+	for(lp_id_t i = 0; i < NODES; i++)
+		test_assert(GetRegionPosition(a, i, &x[i], &y[i]));
+	test_assert(ReorderTopology(a, ORDER_RCM, old_to_new, NULL));
+	for(lp_id_t i = 0; i < NODES; i++) {
+		double new_x, new_y;
+		test_assert(GetRegionPosition(a, old_to_new[i], &new_x, &new_y));
+		test_assert(new_x == x[i] && new_y == y[i]);
+	}
+	check_geometric(a, RADIUS, false);
+	ReleaseTopology(a);
+
+	// A torus with fewer than three cells along a side, whose adjacent cells coincide
+	a = GenerateGeometricTopology(50, 0.4, true, SEED);
+	check_geometric(a, 0.4, true);
+	ReleaseTopology(a);
+	return 0;
+}
+
+static int test_block_model(_unused void *_)
+{
+	static unsigned block[NODES], other[NODES];
+	lp_id_t sizes[] = {1250, 1250, 1250, 1250};
+	double probabilities[4 * 4];
+
+	for(unsigned i = 0; i < 4; i++)
+		for(unsigned j = 0; j < 4; j++)
+			probabilities[i * 4 + j] = i == j ? 0.01 : 0.0002;
+
+	struct topology *a = GenerateStochasticBlockTopology(4, sizes, probabilities, SEED, block);
+	struct topology *b = GenerateStochasticBlockTopology(4, sizes, probabilities, SEED, other);
+	test_assert(CountRegions(a) == NODES);
+	test_assert(same_links(a, b));
+
+	unsigned counts[4] = {0};
+	bool contiguous = true;
+	for(lp_id_t i = 0; i < NODES; i++) {
+		test_assert(block[i] < 4 && block[i] == other[i]);
+		counts[block[i]]++;
+		contiguous = contiguous && (i == 0 || block[i] >= block[i - 1]);
+	}
+	for(unsigned i = 0; i < 4; i++)
+		test_assert(counts[i] == sizes[i]);
+	test_assert(!contiguous);
+
+	// Count the links within and across blocks against their expected number
+	double expected_inside = 0, expected_across = 0;
+	uint64_t inside = 0, links = check_generated(a, true);
+	for(unsigned i = 0; i < 4; i++) {
+		expected_inside += 0.01 * sizes[i] * (sizes[i] - 1);
+		expected_across += 0.0002 * sizes[i] * (NODES - sizes[i]);
+	}
+	for(lp_id_t i = 0; i < NODES; i++) {
+		GetAllReceivers(a, i, receivers);
+		for(lp_id_t j = 0; j < CountDirections(a, i); j++)
+			inside += block[receivers[j]] == block[i];
+	}
+	test_assert(inside > 0.95 * expected_inside && inside < 1.05 * expected_inside);
+	test_assert(links - inside > 0.9 * expected_across && links - inside < 1.1 * expected_across);
+
+	// The partitioner recovers the planted communities, which are equally sized
+	struct topology_partition_stats stats;
+	static unsigned part[NODES];
+	test_assert(PartitionTopology(a, 4, 1.05, part, &stats));
+	test_assert(stats.remote_share < 1.2 * (links - inside) / links);
+	ReleaseTopology(a);
+	ReleaseTopology(b);
+
+	// Disconnected cliques
+	for(unsigned i = 0; i < 4; i++)
+		for(unsigned j = 0; j < 4; j++)
+			probabilities[i * 4 + j] = i == j;
+	lp_id_t small[] = {10, 20, 30, 40};
+	a = GenerateStochasticBlockTopology(4, small, probabilities, SEED, block);
+	test_assert(check_generated(a, true) == 10 * 9 + 20 * 19 + 30 * 29 + 40 * 39);
+	for(lp_id_t i = 0; i < 100; i++) {
+		test_assert(CountDirections(a, i) == small[block[i]] - 1);
+		GetAllReceivers(a, i, receivers);
+		for(lp_id_t j = 0; j < CountDirections(a, i); j++)
+			test_assert(block[receivers[j]] == block[i]);
+	}
+	ReleaseTopology(a);
+	return 0;
+}
+
+static int test_errors(_unused void *_)
+{
+	test_assert(GenerateErdosRenyiTopology(0, 0.5, SEED) == NULL);
+	test_assert(GenerateErdosRenyiTopology(10, 1.5, SEED) == NULL);
+	test_assert(GenerateBarabasiAlbertTopology(10, 0, SEED) == NULL);
+	test_assert(GenerateBarabasiAlbertTopology(10, 10, SEED) == NULL);
+	test_assert(GenerateWattsStrogatzTopology(10, 5, 0.5, SEED) == NULL);
+	test_assert(GenerateWattsStrogatzTopology(10, 2, -0.5, SEED) == NULL);
+	test_assert(GenerateRmatTopology(0, 10, 0.25, 0.25, 0.25, SEED) == NULL);
+	test_assert(GenerateRmatTopology(32, 10, 0.25, 0.25, 0.25, SEED) == NULL);
+	test_assert(GenerateRmatTopology(40, 10, 0.25, 0.25, 0.25, SEED) == NULL);
+	test_assert(GenerateRmatTopology(4, 10, 0.5, 0.5, 0.5, SEED) == NULL);
+	test_assert(GenerateGeometricTopology(10, 0.0, false, SEED) == NULL);
+	test_assert(GenerateGeometricTopology(10, NAN, false, SEED) == NULL);
+
+	lp_id_t sizes[] = {5, 0};
+	double asymmetric[] = {0.5, 0.1, 0.2, 0.5}, invalid[] = {1.5};
+	test_assert(GenerateStochasticBlockTopology(0, sizes, invalid, SEED, NULL) == NULL);
+	test_assert(GenerateStochasticBlockTopology(1, sizes, invalid, SEED, NULL) == NULL);
+	test_assert(GenerateStochasticBlockTopology(2, sizes, asymmetric, SEED, NULL) == NULL);
+	sizes[1] = 5;
+	test_assert(GenerateStochasticBlockTopology(2, sizes, asymmetric, SEED, NULL) == NULL);
+
+	double x, y;
+	struct topology *topology = GenerateErdosRenyiTopology(10, 0.5, SEED);
+	test_assert(!GetRegionPosition(topology, 0, &x, &y));
+	ReleaseTopology(topology);
+	topology = GenerateGeometricTopology(10, 0.5, false, SEED);
+	test_assert(!GetRegionPosition(topology, 10, &x, &y));
+	ReleaseTopology(topology);
+	return 0;
+}
+
+int main(void)
+{
+	test("Erdős-Rényi generator", test_erdos_renyi, NULL);
+	test("Barabási-Albert generator", test_barabasi_albert, NULL);
+	test("Watts-Strogatz generator", test_watts_strogatz, NULL);
+	test("R-MAT generator", test_rmat, NULL);
+	test("Random geometric generator", test_geometric, NULL);
+	test("Stochastic block model generator", test_block_model, NULL);
+	test("Generator errors", test_errors, NULL);
+}
@@ -6,6 +6,9 @@
  * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
  * SPDX-License-Identifier: GPL-3.0-only
  */
+#include <math.h>
+#include <string.h>
+
 #include <test.h>
 #include <ROOT-Sim/topology.h>
 
@@ -17,6 +20,12 @@ const enum topology_direction LAST_DIRECTION_VALID_VALUE = DIRECTION_SE;
 extern struct {
 	uint64_t state[4];
 } ctx;
+struct random_lanes {
+	uint64_t state[4][8];
+};
+extern void random_lanes_init(struct random_lanes *lanes, uint64_t seed, uint64_t index);
+extern void random_lanes_u64(struct random_lanes *lanes, uint64_t *values, size_t n);
+extern void random_lanes_scalar(struct random_lanes *lanes, uint64_t *values, size_t rounds);
 
 
 static int test_init_fini(_unused void *_)
@@ -72,8 +81,350 @@ int test_rng_is_initialized(_unused void *_)
 	return 0;
 }
 
+static int test_rng_lanes(_unused void *_)
+{
+	static uint64_t vector[1003], scalar[1008];
+	struct random_lanes a, b;
+
+	// The vector implementation picked at runtime matches the scalar one, also across partial rounds
+	random_lanes_init(&a, 42, 3);
+	random_lanes_init(&b, 42, 3);
+	for(unsigned i = 0; i < 3; i++) {
+		random_lanes_u64(&a, vector, 1003);
+		random_lanes_scalar(&b, scalar, 1008 / 8);
+		for(unsigned j = 0; j < 1003; j++)
+			test_assert(vector[j] == scalar[j]);
+	}
+	for(unsigned k = 0; k < 4; k++)
+		for(unsigned l = 0; l < 8; l++)
+			test_assert(a.state[k][l] == b.state[k][l]);
+	return 0;
+}
+
+static int test_reentrant_receivers(_unused void *_)
+{
+	struct topology *topologies[] = {
+		InitializeTopology(TOPOLOGY_HEXAGON, 10, 10),
+		InitializeTopology(TOPOLOGY_SQUARE, 10, 10),
+		InitializeTopology(TOPOLOGY_TORUS, 10, 10),
+		InitializeTopology(TOPOLOGY_BIDRING, 100),
+		InitializeTopology(TOPOLOGY_STAR, 100),
+		InitializeTopology(TOPOLOGY_FCMESH, 100),
+		GenerateErdosRenyiTopology(100, 0.2, 1)
+	};
+	unsigned n = sizeof(topologies) / sizeof(*topologies);
+
+	for(unsigned t = 0; t < n; t++) {
+		struct topology_rng a, b, c;
+		unsigned differ = 0;
+
+		// States initialized the same way give the same receivers, other states give others
+		InitializeTopologyRng(&a, 42, t);
+		InitializeTopologyRng(&b, 42, t);
+		InitializeTopologyRng(&c, 42, t + 1);
+		for(lp_id_t i = 0; i < 1000; i++) {
+			lp_id_t from = i % 100, to = GetReceiverWithRng(topologies[t], from, DIRECTION_RANDOM, &a);
+			test_assert(to == GetReceiverWithRng(topologies[t], from, DIRECTION_RANDOM, &b));
+			test_assert(IsNeighbor(topologies[t], from, to));
+			differ += to != GetReceiverWithRng(topologies[t], from, DIRECTION_RANDOM, &c);
+		}
+		test_assert(differ > 0);
+		test_assert(GetReceiverWithRng(topologies[t], 0, DIRECTION_RANDOM, &a) < 100);
+	}
+
+	// Every neighbor is equally likely
+	struct topology_rng rng;
+	unsigned hits[100] = {0};
+	InitializeTopologyRng(&rng, 42, 0);
+	for(unsigned i = 0; i < 99000; i++)
+		hits[GetReceiverWithRng(topologies[5], 7, DIRECTION_RANDOM, &rng)]++;
+	for(lp_id_t i = 0; i < 100; i++)
+		test_assert(i == 7 ? hits[i] == 0 : hits[i] > 800 && hits[i] < 1200);
+
+	for(unsigned t = 0; t < n; t++)
+		ReleaseTopology(topologies[t]);
+	return 0;
+}
+
+static int test_event_receivers(_unused void *_)
+{
+	struct topology *topology = GenerateErdosRenyiTopology(100, 0.2, 1);
+	struct topology *mesh = InitializeTopology(TOPOLOGY_FCMESH, 100);
+	static lp_id_t first[100][100];
+	unsigned hits[100] = {0}, differ = 0;
+
+	// The receiver only depends on the seed, the sender and the event, whatever was drawn in between
+	for(lp_id_t from = 0; from < 100; from++)
+		for(uint64_t event = 0; event < 100; event++)
+			first[from][event] = GetReceiverForEvent(topology, from, DIRECTION_RANDOM, 42, event);
+	for(lp_id_t from = 100; from-- > 0;) {
+		for(uint64_t event = 100; event-- > 0;) {
+			lp_id_t to = GetReceiverForEvent(topology, from, DIRECTION_RANDOM, 42, event);
+			test_assert(to == first[from][event]);
+			test_assert(IsNeighbor(topology, from, to));
+			GetReceiver(topology, from, DIRECTION_RANDOM);
+			differ += to != GetReceiverForEvent(topology, from, DIRECTION_RANDOM, 43, event);
+		}
+	}
+	test_assert(differ > 0);
+
+	// Consecutive events draw independent, uniformly distributed receivers
+	for(uint64_t event = 0; event < 99000; event++)
+		hits[GetReceiverForEvent(mesh, 7, DIRECTION_RANDOM, 42, event)]++;
+	for(lp_id_t i = 0; i < 100; i++)
+		test_assert(i == 7 ? hits[i] == 0 : hits[i] > 800 && hits[i] < 1200);
+
+	ReleaseTopology(topology);
+	ReleaseTopology(mesh);
+	return 0;
+}
+
+static int test_batch_receivers(_unused void *_)
+{
+	struct topology *topologies[] = {
+		InitializeTopology(TOPOLOGY_HEXAGON, 10, 10),
+		InitializeTopology(TOPOLOGY_SQUARE, 10, 10),
+		InitializeTopology(TOPOLOGY_TORUS, 10, 10),
+		InitializeTopology(TOPOLOGY_RING, 100),
+		InitializeTopology(TOPOLOGY_BIDRING, 100),
+		InitializeTopology(TOPOLOGY_STAR, 100),
+		InitializeTopology(TOPOLOGY_FCMESH, 100),
+		GenerateErdosRenyiTopology(100, 0.2, 1)
+	};
+	unsigned n = sizeof(topologies) / sizeof(*topologies);
+	static lp_id_t from[1000], first[1000], second[1000];
+	static enum topology_direction directions[1000];
+
+	for(unsigned i = 0; i < 1000; i++) {
+		from[i] = test_random_range(100);
+		directions[i] = test_random_range(DIRECTION_SE + 1);
+	}
+
+	for(unsigned t = 0; t < n; t++) {
+		struct topology_rng a, b, c;
+		unsigned differ = 0;
+
+		// Random batches are valid, and reproducible given the random state
+		InitializeTopologyRng(&a, 42, t);
+		InitializeTopologyRng(&b, 42, t);
+		InitializeTopologyRng(&c, 42, t + 1);
+		GetReceiversBatch(topologies[t], 1000, from, NULL, first, &a);
+		GetReceiversBatch(topologies[t], 1000, from, NULL, second, &b);
+		for(unsigned i = 0; i < 1000; i++) {
+			test_assert(first[i] == second[i]);
+			test_assert(IsNeighbor(topologies[t], from[i], first[i]));
+		}
+		GetReceiversBatch(topologies[t], 1000, from, NULL, second, &c);
+		for(unsigned i = 0; i < 1000; i++)
+			differ += first[i] != second[i];
+		test_assert(differ > 0 || t == 3);
+
+		// Explicit directions give the same receivers as single queries
+		if(t >= 5)
+			continue;
+		GetReceiversBatch(topologies[t], 1000, from, directions, first, NULL);
+		for(unsigned i = 0; i < 1000; i++)
+			test_assert(first[i] == GetReceiver(topologies[t], from[i], directions[i]));
+	}
+
+	// Degenerate grids, where some cells have no neighbor at all
+	struct topology *grids[] = {
+		InitializeTopology(TOPOLOGY_HEXAGON, 1, 1),
+		InitializeTopology(TOPOLOGY_SQUARE, 1, 1),
+		InitializeTopology(TOPOLOGY_SQUARE, 1, 7),
+		InitializeTopology(TOPOLOGY_HEXAGON, 1, 7),
+		InitializeTopology(TOPOLOGY_TORUS, 1, 7)
+	};
+	for(unsigned t = 0; t < sizeof(grids) / sizeof(*grids); t++) {
+		lp_id_t regions = CountRegions(grids[t]);
+		for(unsigned i = 0; i < 1000; i++)
+			from[i] = i % regions;
+		GetReceiversBatch(grids[t], 1000, from, NULL, first, NULL);
+		for(unsigned i = 0; i < 1000; i++)
+			test_assert(CountDirections(grids[t], from[i]) == 0 ? first[i] == INVALID_DIRECTION :
+			                                                       IsNeighbor(grids[t], from[i], first[i]));
+		GetReceiversBatch(grids[t], 1000, from, directions, first, NULL);
+		for(unsigned i = 0; i < 1000; i++)
+			test_assert(first[i] == GetReceiver(grids[t], from[i], directions[i]));
+		ReleaseTopology(grids[t]);
+	}
+
+	// Every neighbor is equally likely, also across chunks
+	unsigned hits[100] = {0};
+	for(unsigned i = 0; i < 1000; i++)
+		from[i] = 7;
+	for(unsigned r = 0; r < 99; r++) {
+		GetReceiversBatch(topologies[6], 1000, from, NULL, first, NULL);
+		for(unsigned i = 0; i < 1000; i++)
+			hits[first[i]]++;
+	}
+	for(lp_id_t i = 0; i < 100; i++)
+		test_assert(i == 7 ? hits[i] == 0 : hits[i] > 800 && hits[i] < 1200);
+
+	// Queries from outside the topology give INVALID_DIRECTION, without spoiling the others
+	from[1] = 100;
+	GetReceiversBatch(topologies[7], 3, from, NULL, first, NULL);
+	test_assert(first[1] == INVALID_DIRECTION);
+	test_assert(IsNeighbor(topologies[7], 7, first[0]) && IsNeighbor(topologies[7], 7, first[2]));
+	GetReceiversBatch(topologies[7], 0, NULL, NULL, NULL, NULL);
+
+	for(unsigned t = 0; t < n; t++)
+		ReleaseTopology(topologies[t]);
+	return 0;
+}
+
+/**
+ * @brief Check that a sample of receivers is made of distinct neighbors, as many as possible
+ * @param topology the topology the receivers were drawn from
+ * @param from the source of the receivers
+ * @param receivers the receivers
+ * @param count the number of receivers drawn
+ * @param expected the number of receivers which should have been drawn
+ */
+static void check_distinct(struct topology *topology, lp_id_t from, const lp_id_t *receivers, lp_id_t count,
+    lp_id_t expected)
+{
+	test_assert(count == expected);
+	for(lp_id_t i = 0; i < count; i++) {
+		test_assert(IsNeighbor(topology, from, receivers[i]));
+		for(lp_id_t j = 0; j < i; j++)
+			test_assert(receivers[i] != receivers[j]);
+	}
+}
+
+static int test_distinct_receivers(_unused void *_)
+{
+	struct topology *topologies[] = {
+		InitializeTopology(TOPOLOGY_HEXAGON, 10, 10),
+		InitializeTopology(TOPOLOGY_SQUARE, 10, 10),
+		InitializeTopology(TOPOLOGY_TORUS, 10, 10),
+		InitializeTopology(TOPOLOGY_TORUS, 2, 1),
+		InitializeTopology(TOPOLOGY_RING, 100),
+		InitializeTopology(TOPOLOGY_BIDRING, 100),
+		InitializeTopology(TOPOLOGY_BIDRING, 2),
+		InitializeTopology(TOPOLOGY_STAR, 100),
+		InitializeTopology(TOPOLOGY_FCMESH, 100),
+		GenerateErdosRenyiTopology(100, 0.2, 1)
+	};
+	unsigned n = sizeof(topologies) / sizeof(*topologies);
+	lp_id_t receivers[100], neighbors[6];
+
+	for(unsigned t = 0; t < n; t++) {
+		lp_id_t regions = CountRegions(topologies[t]);
+		for(lp_id_t from = 0; from < regions; from++) {
+			lp_id_t degree = CountDirections(topologies[t], from);
+
+			// Degenerate grids and rings reach the same neighbor through more than one direction
+			if(t < 7) {
+				GetAllReceivers(topologies[t], from, neighbors);
+				for(lp_id_t i = 0, all = degree; i < all; i++)
+					for(lp_id_t j = 0; j < i; j++)
+						if(neighbors[j] == neighbors[i]) {
+							degree--;
+							break;
+						}
+			}
+			for(lp_id_t k = 0; k <= degree + 1 && k < 100; k++) {
+				lp_id_t count = GetRandomReceivers(topologies[t], from, k, receivers);
+				check_distinct(topologies[t], from, receivers, count, k < degree ? k : degree);
+			}
+		}
+	}
+	test_assert(GetRandomReceivers(topologies[0], 100, 1, receivers) == 0);
+
+	// States initialized the same way draw the same receivers, whatever the calling thread drew in between
+	for(unsigned t = 0; t < n; t++) {
+		struct topology_rng a, b, c;
+		lp_id_t other[100];
+		unsigned differ = 0;
+
+		InitializeTopologyRng(&a, 42, t);
+		InitializeTopologyRng(&b, 42, t);
+		InitializeTopologyRng(&c, 43, t);
+		for(lp_id_t from = 0; from < CountRegions(topologies[t]); from++) {
+			lp_id_t count = GetRandomReceiversWithRng(topologies[t], from, 3, receivers, &a);
+			GetRandomReceivers(topologies[t], from, 3, other);
+			test_assert(GetRandomReceiversWithRng(topologies[t], from, 3, other, &b) == count);
+			test_assert(memcmp(receivers, other, count * sizeof(*receivers)) == 0);
+			check_distinct(topologies[t], from, receivers, count, count);
+			GetRandomReceiversWithRng(topologies[t], from, 3, other, &c);
+			differ += memcmp(receivers, other, count * sizeof(*receivers)) != 0;
+		}
+		// Rings, the two-region torus and the two-region bidirectional ring have a single neighbor per region
+		test_assert(differ > 0 || t == 3 || t == 4 || t == 6);
+	}
+
+	// Every subset of neighbors of a mesh is equally likely
+	unsigned hits[100] = {0};
+	for(unsigned i = 0; i < 9900; i++) {
+		lp_id_t count = GetRandomReceivers(topologies[8], 7, 10, receivers);
+		for(lp_id_t j = 0; j < count; j++)
+			hits[receivers[j]]++;
+	}
+	for(lp_id_t i = 0; i < 100; i++)
+		test_assert(i == 7 ? hits[i] == 0 : hits[i] > 800 && hits[i] < 1200);
+
+	for(unsigned t = 0; t < n; t++)
+		ReleaseTopology(topologies[t]);
+	return 0;
+}
+
+static int test_weighted_receivers(_unused void *_)
+{
+	double weights[] = {0.1, 0.2, 0.3, 0.4, 0.0}, total = 1.0;
+	lp_id_t receivers[1000];
+
+	for(unsigned finalized = 0; finalized < 2; finalized++) {
+		struct topology *topology = InitializeTopology(TOPOLOGY_GRAPH, 1001);
+		unsigned hits[5] = {0};
+
+		for(lp_id_t i = 0; i < 5; i++)
+			test_assert(AddTopologyLink(topology, 0, i + 1, weights[i]));
+		for(lp_id_t i = 1; i <= 1000; i++)
+			test_assert(AddTopologyLink(topology, 1, i == 1 ? 0 : i, (1.0 + i % 3) / 4));
+		for(lp_id_t i = 0; i < 10; i++)
+			test_assert(AddTopologyLink(topology, 2, i + 3, 0.0));
+		if(finalized)
+			test_assert(FinalizeTopology(topology));
+
+		// Two draws without replacement include a link with probability p_i + sum_j p_j * p_i / (1 - p_j)
+		for(unsigned i = 0; i < 20000; i++) {
+			test_assert(GetRandomReceivers(topology, 0, 2, receivers) == 2);
+			test_assert(receivers[0] != receivers[1]);
+			hits[receivers[0] - 1]++;
+			hits[receivers[1] - 1]++;
+		}
+		for(unsigned i = 0; i < 5; i++) {
+			double expected = weights[i] / total;
+			for(unsigned j = 0; j < 5; j++)
+				if(j != i)
+					expected += weights[j] / total * weights[i] / (total - weights[j]);
+			test_assert(fabs(hits[i] / 20000.0 - expected) < 0.02);
+		}
+
+		// Links without weight are never drawn, unless no link has weight
+		check_distinct(topology, 0, receivers, GetRandomReceivers(topology, 0, 5, receivers), 4);
+		for(lp_id_t i = 0; i < 4; i++)
+			test_assert(receivers[i] != 5);
+		check_distinct(topology, 2, receivers, GetRandomReceivers(topology, 2, 20, receivers), 10);
+		check_distinct(topology, 3, receivers, GetRandomReceivers(topology, 3, 20, receivers), 0);
+
+		// Drawing most neighbors of a large node
+		check_distinct(topology, 1, receivers, GetRandomReceivers(topology, 1, 900, receivers), 900);
+		check_distinct(topology, 1, receivers, GetRandomReceivers(topology, 1, 1000, receivers), 1000);
+		ReleaseTopology(topology);
+	}
+	return 0;
+}
+
 int main(void)
 {
 	test("RNG is initialized", test_rng_is_initialized, NULL);
+	test("Vector RNG lanes", test_rng_lanes, NULL);
+	test("Reentrant random receivers", test_reentrant_receivers, NULL);
+	test("Counter-based random receivers", test_event_receivers, NULL);
+	test("Batches of random receivers", test_batch_receivers, NULL);
+	test("Distinct random receivers", test_distinct_receivers, NULL);
+	test("Weighted distinct random receivers", test_weighted_receivers, NULL);
 	test("Topology initialization and release", test_init_fini, NULL);
 }
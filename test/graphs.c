@@ -7,10 +7,12 @@
  * SPDX-License-Identifier: GPL-3.0-only
  */
 #include <limits.h>
+#include <stdio.h>
 
 #include <test.h>
 #include <ROOT-Sim/topology.h>
 #include <string.h>
+#include <time.h>
 
 const enum topology_geometry LAST_TOPOLOGY_WITH_TWO_PARAMETERS = TOPOLOGY_TORUS;
 const enum topology_geometry LAST_TOPOLOGY_VALID_VALUE = TOPOLOGY_GRAPH;
@@ -18,9 +20,39 @@ const enum topology_direction LAST_DIRECTION_VALID_VALUE = DIRECTION_SE;
 
 #define MAX_NODES_TEST 100
 #define NUM_QUERIES 500
+#define SAMPLING_TRIALS 100000
+#define HUB_DEGREE 1000
+#define BULK_NODES 200
+#define BULK_EDGES 4000
+#define BUILDER_THREADS 4
+#define TOPOLOGY_FILE "test_graphs.topology"
+#define DYNAMIC_NODES 60
+#define DYNAMIC_OPERATIONS 3000
+#define REORDER_NODES 500
+#define REORDER_EDGES 3000
+#define SCALE_NODES 200000
+#define SCALE_DEGREE 8
+#define SCALE_OPERATIONS 20000
 
 #define unique_ptr(num1, num2) (void *)(((unsigned long long)num1 << 32) | (unsigned long long)num2)
 
+/**
+ * @brief Check that node 0 picks nodes 1, 2, 3 and 4 with probability 0.1, 0.2, 0 and 0.7
+ * @param topology the topology to sample
+ */
+static void check_distribution(struct topology *topology)
+{
+	unsigned hits[5] = {0};
+
+	for(int i = 0; i < SAMPLING_TRIALS; i++)
+		hits[GetReceiver(topology, 0, DIRECTION_RANDOM)]++;
+	test_assert(hits[0] == 0);
+	test_assert(hits[3] == 0);
+	test_assert(hits[1] > SAMPLING_TRIALS * 0.09 && hits[1] < SAMPLING_TRIALS * 0.11);
+	test_assert(hits[2] > SAMPLING_TRIALS * 0.19 && hits[2] < SAMPLING_TRIALS * 0.21);
+	test_assert(hits[4] > SAMPLING_TRIALS * 0.69 && hits[4] < SAMPLING_TRIALS * 0.71);
+}
+
 static int test_graph(_unused void *_)
 {
 	struct topology *topology;
@@ -40,6 +72,10 @@ static int test_graph(_unused void *_)
 			test_assert(SetTopologyLinkData(topology, from, to, unique_ptr(from, to)) == true);
 		}
 
+		// Half of the graphs are queried in their compressed representation
+		if(nodes % 2)
+			test_assert(FinalizeTopology(topology));
+
 		for(unsigned i = 0; i < NUM_QUERIES; i++) {
 			from = test_random_range(nodes);
 			to = GetReceiver(topology, from, DIRECTION_RANDOM);
@@ -71,6 +107,28 @@ static int test_graph(_unused void *_)
 	test_assert(sources[1] == 1);
 	ReleaseTopology(topology);
 
+	// Sources are reported in increasing order, both before and after finalization
+	topology = InitializeTopology(TOPOLOGY_GRAPH, 5);
+	AddTopologyLink(topology, 3, 0, 0.5);
+	AddTopologyLink(topology, 1, 0, 0.5);
+	AddTopologyLink(topology, 4, 0, 0.5);
+	AddTopologyLink(topology, 1, 0, 0.7);
+	AddTopologyLink(topology, 0, 2, 0.5);
+	for(int finalized = 0; finalized < 2; finalized++) {
+		lp_id_t all_sources[3] = {0};
+		test_assert(CountSources(topology, 0) == 3);
+		test_assert(CountSources(topology, 1) == 0);
+		test_assert(CountSources(topology, 2) == 1);
+		GetAllSources(topology, 0, all_sources);
+		test_assert(all_sources[0] == 1);
+		test_assert(all_sources[1] == 3);
+		test_assert(all_sources[2] == 4);
+		GetAllSources(topology, 2, all_sources);
+		test_assert(all_sources[0] == 0);
+		test_assert(FinalizeTopology(topology));
+	}
+	ReleaseTopology(topology);
+
 	// Test GetAllReceivers
 	topology = InitializeTopology(TOPOLOGY_GRAPH, 6);
 	AddTopologyLink(topology, 0, 1, 1);
@@ -110,6 +168,322 @@ static int test_graph(_unused void *_)
 	test_assert(dest[1]);
 	ReleaseTopology(topology);
 
+	// Test updates to a finalized graph
+	topology = InitializeTopology(TOPOLOGY_GRAPH, 4);
+	AddTopologyLink(topology, 0, 1, 1);
+	AddTopologyLink(topology, 2, 3, 1);
+	test_assert(FinalizeTopology(topology));
+	test_assert(FinalizeTopology(topology));
+	test_assert(CountDirections(topology, 0) == 1);
+	test_assert(CountDirections(topology, 1) == 0);
+	test_assert(AddTopologyLink(topology, 0, 1, 0.5));
+	test_assert(AddTopologyLink(topology, 0, 2, 0.5) == false);
+	test_assert(IsNeighbor(topology, 0, 2) == false);
+	test_assert(GetTopologyLinkData(topology, 2, 3) == NULL);
+	test_assert(SetTopologyLinkData(topology, 2, 3, unique_ptr(2, 3)));
+	test_assert(GetTopologyLinkData(topology, 2, 3) == unique_ptr(2, 3));
+	test_assert(GetTopologyLinkData(topology, 0, 1) == NULL);
+	test_assert(GetReceiver(topology, 1, DIRECTION_RANDOM) == INVALID_DIRECTION);
+	test_assert(GetReceiver(topology, 2, DIRECTION_RANDOM) == 3);
+	ReleaseTopology(topology);
+
+	// Test that all sampling algorithms and probability precisions follow the link probabilities
+	for(enum topology_precision precision = PRECISION_DOUBLE; precision <= PRECISION_FIXED16; precision++) {
+		topology = InitializeTopology(TOPOLOGY_GRAPH, 5);
+		AddTopologyLink(topology, 0, 1, 0.1);
+		AddTopologyLink(topology, 0, 2, 0.2);
+		AddTopologyLink(topology, 0, 3, 0.0);
+		AddTopologyLink(topology, 0, 4, 0.7);
+		test_assert(SetTopologySampling(topology, 42) == false);
+		test_assert(SetTopologyPrecision(topology, 42) == false);
+		test_assert(SetTopologyPrecision(topology, precision));
+		test_assert(FinalizeTopology(topology));
+		for(enum topology_sampling sampling = SAMPLING_ALIAS; sampling <= SAMPLING_CUMULATIVE; sampling++) {
+			test_assert(SetTopologySampling(topology, sampling));
+			check_distribution(topology);
+			// Updating a probability keeps the sampling structures consistent
+			test_assert(AddTopologyLink(topology, 0, 4, 0.0));
+			for(int i = 0; i < 1000; i++)
+				test_assert(GetReceiver(topology, 0, DIRECTION_RANDOM) != 4);
+			test_assert(AddTopologyLink(topology, 0, 4, 0.7));
+			check_distribution(topology);
+		}
+		// Converting a finalized graph to another precision keeps the probabilities
+		test_assert(SetTopologyPrecision(topology, (precision + 1) % (PRECISION_FIXED16 + 1)));
+		check_distribution(topology);
+		ReleaseTopology(topology);
+	}
+
+	// Test that weights are accepted in weight mode, and normalized proportionally
+	for(enum topology_sampling sampling = SAMPLING_ALIAS; sampling <= SAMPLING_CUMULATIVE; sampling++) {
+		topology = InitializeTopology(TOPOLOGY_GRAPH, 6);
+		test_assert(AddTopologyLink(topology, 0, 1, 10.0) == false);
+		test_assert(SetTopologyWeights(topology, true));
+		test_assert(AddTopologyLink(topology, 0, 1, 10.0));
+		test_assert(AddTopologyLink(topology, 0, 2, 20.0));
+		test_assert(AddTopologyLink(topology, 0, 3, 0.0));
+		test_assert(AddTopologyLink(topology, 0, 4, 70.0));
+		test_assert(AddTopologyLink(topology, 0, 4, 1.0 / 0.0) == false);
+		test_assert(AddTopologyLink(topology, 0, 4, -1.0) == false);
+		test_assert(AddTopologyLink(topology, 1, 2, 0.0));
+		test_assert(AddTopologyLink(topology, 1, 3, 0.0));
+		test_assert(SetTopologySampling(topology, sampling));
+		test_assert(FinalizeTopology(topology));
+		check_distribution(topology);
+		test_assert(NormalizeLinkProbabilities(topology));
+		test_assert(SetTopologyWeights(topology, false));
+		check_distribution(topology);
+		// Links with no probability at all become equally likely, and nodes with no links are left alone
+		unsigned hits = 0;
+		for(int i = 0; i < 1000; i++)
+			hits += GetReceiver(topology, 1, DIRECTION_RANDOM) == 2;
+		test_assert(hits > 400 && hits < 600);
+		test_assert(GetReceiver(topology, 5, DIRECTION_RANDOM) == INVALID_DIRECTION);
+		// Normalized weights are valid probabilities
+		test_assert(AddTopologyLink(topology, 0, 4, 0.7));
+		check_distribution(topology);
+		ReleaseTopology(topology);
+	}
+	topology = InitializeTopology(TOPOLOGY_RING, 6);
+	test_assert(SetTopologyWeights(topology, true) == false);
+	ReleaseTopology(topology);
+
+	// Test link lookups on high-degree nodes, which are indexed by neighbor
+	topology = InitializeTopology(TOPOLOGY_GRAPH, HUB_DEGREE * 2);
+	for(int finalized = 0; finalized < 2; finalized++) {
+		for(lp_id_t i = 0; i < HUB_DEGREE; i++) {
+			lp_id_t dest = (i * 7919) % HUB_DEGREE * 2;
+			if(!finalized) {
+				test_assert(AddTopologyLink(topology, 0, dest, 0.5));
+				test_assert(SetTopologyLinkData(topology, 0, dest, unique_ptr(0, dest)));
+			}
+			test_assert(IsNeighbor(topology, 0, dest));
+			test_assert(GetTopologyLinkData(topology, 0, dest) == unique_ptr(0, dest));
+		}
+		test_assert(CountDirections(topology, 0) == HUB_DEGREE);
+		for(lp_id_t i = 0; i < HUB_DEGREE * 2; i++)
+			test_assert(IsNeighbor(topology, 0, i) == (i % 2 == 0));
+		test_assert(FinalizeTopology(topology));
+	}
+	ReleaseTopology(topology);
+
+	// Test that adding links in bulk builds the same graph as adding them one at a time
+	lp_id_t bulk_from[BULK_EDGES], bulk_to[BULK_EDGES];
+	double bulk_probabilities[BULK_EDGES];
+	void *bulk_data[BULK_EDGES];
+	struct topology *single = InitializeTopology(TOPOLOGY_GRAPH, BULK_NODES);
+	topology = InitializeTopology(TOPOLOGY_GRAPH, BULK_NODES);
+	for(unsigned i = 0; i < BULK_EDGES; i++) {
+		bulk_from[i] = test_random_range(BULK_NODES);
+		bulk_to[i] = i % 3 ? test_random_range(BULK_NODES) : 0; // node 0 becomes a hub
+		bulk_probabilities[i] = test_random_double();
+		bulk_data[i] = unique_ptr(i, 0);
+		test_assert(AddTopologyLink(single, bulk_from[i], bulk_to[i], bulk_probabilities[i]));
+		test_assert(SetTopologyLinkData(single, bulk_from[i], bulk_to[i], bulk_data[i]));
+	}
+	test_assert(AddTopologyLinks(topology, BULK_EDGES / 2, bulk_from, bulk_to, bulk_probabilities, bulk_data));
+	test_assert(AddTopologyLinks(topology, BULK_EDGES - BULK_EDGES / 2, bulk_from + BULK_EDGES / 2,
+	    bulk_to + BULK_EDGES / 2, bulk_probabilities + BULK_EDGES / 2, bulk_data + BULK_EDGES / 2));
+	for(lp_id_t i = 0; i < BULK_NODES; i++) {
+		test_assert(CountDirections(topology, i) == CountDirections(single, i));
+		test_assert(CountSources(topology, i) == CountSources(single, i));
+
+		// Staging rows keep their sources sorted, whether links are added one at a time or in bulk
+		lp_id_t a[BULK_EDGES], b[BULK_EDGES];
+		GetAllSources(topology, i, a);
+		GetAllSources(single, i, b);
+		test_assert(memcmp(a, b, CountSources(single, i) * sizeof(*a)) == 0);
+		for(lp_id_t j = 1; j < CountSources(single, i); j++)
+			test_assert(a[j - 1] < a[j]);
+		for(lp_id_t j = 0; j < BULK_NODES; j++) {
+			test_assert(IsNeighbor(topology, i, j) == IsNeighbor(single, i, j));
+			if(IsNeighbor(topology, i, j))
+				test_assert(GetTopologyLinkData(topology, i, j) == GetTopologyLinkData(single, i, j));
+		}
+	}
+	ReleaseTopology(single);
+
+	// Bulk updates of a finalized graph cannot add links
+	test_assert(FinalizeTopology(topology));
+	test_assert(AddTopologyLinks(topology, 1, bulk_from, bulk_to, bulk_probabilities, NULL));
+	bulk_to[0] = (bulk_to[0] + 1) % BULK_NODES;
+	if(!IsNeighbor(topology, bulk_from[0], bulk_to[0]))
+		test_assert(AddTopologyLinks(topology, 1, bulk_from, bulk_to, bulk_probabilities, NULL) == false);
+	bulk_probabilities[0] = 2.0;
+	test_assert(AddTopologyLinks(topology, 1, bulk_from, bulk_to, bulk_probabilities, NULL) == false);
+	ReleaseTopology(topology);
+
+	// Test that a multi-threaded builder yields the same graph as adding its buffers in thread order
+	unsigned bulk_size = 0;
+	struct topology *serial = InitializeTopology(TOPOLOGY_GRAPH, BULK_NODES);
+	topology = InitializeTopology(TOPOLOGY_GRAPH, BULK_NODES);
+	struct topology_builder *builder = InitializeTopologyBuilder(topology, BUILDER_THREADS);
+	test_assert(builder != NULL);
+	for(unsigned t = 0; t < BUILDER_THREADS; t++) {
+		for(unsigned i = 0; i < BULK_EDGES / BUILDER_THREADS; i++) {
+			lp_id_t f = test_random_range(BULK_NODES), d = i % 5 ? test_random_range(BULK_NODES) : 1;
+			double p = test_random_double();
+			test_assert(AddTopologyBuilderLink(builder, t, f, d, p));
+			bulk_from[bulk_size] = f;
+			bulk_to[bulk_size] = d;
+			bulk_probabilities[bulk_size++] = p;
+		}
+	}
+	test_assert(AddTopologyLinks(serial, bulk_size, bulk_from, bulk_to, bulk_probabilities, NULL));
+	test_assert(AddTopologyBuilderLink(builder, BUILDER_THREADS, 0, 0, 0.5) == false);
+	test_assert(AddTopologyBuilderLink(builder, 0, BULK_NODES, 0, 0.5) == false);
+	test_assert(AddTopologyBuilderLink(builder, 0, 0, 0, 1.5) == false);
+	test_assert(CommitTopologyBuilder(builder));
+	test_assert(FinalizeTopology(serial));
+	for(lp_id_t i = 0; i < BULK_NODES; i++) {
+		lp_id_t a[BULK_NODES], b[BULK_NODES];
+		test_assert(CountDirections(topology, i) == CountDirections(serial, i));
+		GetAllReceivers(topology, i, a);
+		GetAllReceivers(serial, i, b);
+		test_assert(memcmp(a, b, CountDirections(serial, i) * sizeof(*a)) == 0);
+		test_assert(CountSources(topology, i) == CountSources(serial, i));
+		GetAllSources(topology, i, a);
+		GetAllSources(serial, i, b);
+		test_assert(memcmp(a, b, CountSources(serial, i) * sizeof(*a)) == 0);
+	}
+	for(unsigned i = 0; i < NUM_QUERIES; i++) {
+		lp_id_t f = test_random_range(BULK_NODES);
+		if(CountDirections(serial, f) != 0)
+			test_assert(IsNeighbor(topology, f, GetReceiver(topology, f, DIRECTION_RANDOM)));
+	}
+
+	ReleaseTopology(serial);
+	ReleaseTopology(topology);
+
+	// Committing a builder to a topology which already has links merges them
+	topology = InitializeTopology(TOPOLOGY_GRAPH, BULK_NODES);
+	test_assert(AddTopologyLink(topology, 0, 1, 0.5));
+	builder = InitializeTopologyBuilder(topology, 2);
+	test_assert(builder != NULL);
+	test_assert(AddTopologyBuilderLink(builder, 1, 0, 2, 0.5));
+	test_assert(AddTopologyBuilderLink(builder, 0, 0, 2, 0.25));
+	test_assert(AddTopologyBuilderLink(builder, 0, 1, 0, 1.0));
+	test_assert(CommitTopologyBuilder(builder));
+	test_assert(CountDirections(topology, 0) == 2);
+	test_assert(IsNeighbor(topology, 0, 1) && IsNeighbor(topology, 0, 2) && IsNeighbor(topology, 1, 0));
+	test_assert(CountSources(topology, 0) == 1);
+	test_assert(AddTopologyLink(topology, 1, 2, 0.5) == false);
+	ReleaseTopology(topology);
+
+	// Test that a saved graph maps back to the same graph, and cannot be modified
+	topology = InitializeTopology(TOPOLOGY_GRAPH, BULK_NODES);
+	for(unsigned i = 0; i < BULK_EDGES; i++)
+		test_assert(AddTopologyLink(topology, test_random_range(BULK_NODES),
+		    i % 3 ? test_random_range(BULK_NODES) : 0, test_random_double()));
+	test_assert(SaveTopology(topology, TOPOLOGY_FILE));
+	struct topology *mapped = MapTopology(TOPOLOGY_FILE);
+	test_assert(mapped != NULL);
+	test_assert(CountRegions(mapped) == BULK_NODES);
+	for(lp_id_t i = 0; i < BULK_NODES; i++) {
+		lp_id_t a[BULK_NODES], b[BULK_NODES];
+		test_assert(CountDirections(mapped, i) == CountDirections(topology, i));
+		GetAllReceivers(mapped, i, a);
+		GetAllReceivers(topology, i, b);
+		test_assert(memcmp(a, b, CountDirections(topology, i) * sizeof(*a)) == 0);
+		test_assert(CountSources(mapped, i) == CountSources(topology, i));
+		GetAllSources(mapped, i, a);
+		GetAllSources(topology, i, b);
+		test_assert(memcmp(a, b, CountSources(topology, i) * sizeof(*a)) == 0);
+		for(lp_id_t j = 0; j < BULK_NODES; j++)
+			test_assert(IsNeighbor(mapped, i, j) == IsNeighbor(topology, i, j));
+		if(CountDirections(mapped, i) != 0)
+			test_assert(IsNeighbor(mapped, i, GetReceiver(mapped, i, DIRECTION_RANDOM)));
+	}
+	test_assert(AddTopologyLink(mapped, 0, 0, 0.5) == false);
+	test_assert(NormalizeLinkProbabilities(mapped) == false);
+	test_assert(SetTopologySampling(mapped, SAMPLING_LINEAR) == false);
+	test_assert(SetTopologyPrecision(mapped, PRECISION_FLOAT) == false);
+	ReleaseTopology(mapped);
+
+	// Compact probabilities and cumulative distributions are saved as they are
+	test_assert(SetTopologySampling(topology, SAMPLING_CUMULATIVE));
+	for(enum topology_precision precision = PRECISION_FLOAT; precision <= PRECISION_FIXED16; precision++) {
+		test_assert(SetTopologyPrecision(topology, precision));
+		test_assert(SaveTopology(topology, TOPOLOGY_FILE));
+		mapped = MapTopology(TOPOLOGY_FILE);
+		test_assert(mapped != NULL);
+		for(lp_id_t i = 0; i < BULK_NODES; i++) {
+			test_assert(CountDirections(mapped, i) == CountDirections(topology, i));
+			if(CountDirections(mapped, i) != 0)
+				test_assert(IsNeighbor(mapped, i, GetReceiver(mapped, i, DIRECTION_RANDOM)));
+		}
+		ReleaseTopology(mapped);
+	}
+	ReleaseTopology(topology);
+
+	// Test that grids are saved too, and that corrupted files are rejected
+	topology = InitializeTopology(TOPOLOGY_TORUS, 7, 5);
+	test_assert(SaveTopology(topology, TOPOLOGY_FILE));
+	ReleaseTopology(topology);
+	mapped = MapTopology(TOPOLOGY_FILE);
+	test_assert(mapped != NULL);
+	test_assert(CountRegions(mapped) == 35);
+	test_assert(GetReceiver(mapped, 0, DIRECTION_W) == 4);
+	ReleaseTopology(mapped);
+	FILE *file = fopen(TOPOLOGY_FILE, "r+b");
+	test_assert(file != NULL);
+	test_assert(fseek(file, 24, SEEK_SET) == 0);
+	test_assert(fputc(0xff, file) != EOF);
+	test_assert(fclose(file) == 0);
+	test_assert(MapTopology(TOPOLOGY_FILE) == NULL);
+	test_assert(remove(TOPOLOGY_FILE) == 0);
+	test_assert(MapTopology(TOPOLOGY_FILE) == NULL);
+
+	// Test link attributes, added before and after finalizing the topology
+	topology = InitializeTopology(TOPOLOGY_GRAPH, 4);
+	unsigned latency = AddTopologyAttribute(topology, sizeof(double));
+	test_assert(latency != INVALID_ATTRIBUTE);
+	test_assert(AddTopologyAttribute(topology, 0) == INVALID_ATTRIBUTE);
+	AddTopologyLink(topology, 0, 1, 0.5);
+	AddTopologyLink(topology, 0, 2, 0.5);
+	AddTopologyLink(topology, 1, 3, 1.0);
+	*(double *)GetTopologyLinkAttribute(topology, latency, 0, 2) = 2.5;
+	test_assert(*(double *)GetTopologyLinkAttribute(topology, latency, 0, 1) == 0.0);
+	test_assert(GetTopologyLinkAttribute(topology, latency, 0, 3) == NULL);
+	test_assert(GetTopologyLinkAttribute(topology, latency + 1, 0, 1) == NULL);
+	AddTopologyLink(topology, 0, 3, 1.0);
+	test_assert(*(double *)GetTopologyLinkAttribute(topology, latency, 0, 2) == 2.5);
+	test_assert(*(double *)GetTopologyLinkAttribute(topology, latency, 0, 3) == 0.0);
+	test_assert(FinalizeTopology(topology));
+	test_assert(*(double *)GetTopologyLinkAttribute(topology, latency, 0, 2) == 2.5);
+	unsigned hops = AddTopologyAttribute(topology, sizeof(uint16_t));
+	test_assert(hops != INVALID_ATTRIBUTE);
+	lp_id_t links[3];
+	uint16_t hop_values[3], read_hops[3];
+	double latencies[3];
+	GetAllReceivers(topology, 0, links);
+	for(unsigned i = 0; i < 3; i++)
+		hop_values[i] = (uint16_t)(links[i] * 10);
+	test_assert(SetTopologyLinkAttributes(topology, hops, 0, hop_values));
+	test_assert(GetTopologyLinkAttributes(topology, hops, 0, read_hops));
+	test_assert(memcmp(hop_values, read_hops, sizeof(hop_values)) == 0);
+	test_assert(*(uint16_t *)GetTopologyLinkAttribute(topology, hops, 0, 3) == 30);
+	test_assert(*(uint16_t *)GetTopologyLinkAttribute(topology, hops, 1, 3) == 0);
+	test_assert(GetTopologyLinkAttributes(topology, latency, 0, latencies));
+	for(unsigned i = 0; i < 3; i++)
+		test_assert(latencies[i] == (links[i] == 2 ? 2.5 : 0.0));
+	test_assert(GetTopologyLinkAttributes(topology, latency, 2, latencies));
+	test_assert(!GetTopologyLinkAttributes(topology, latency, 4, latencies));
+	test_assert(!SetTopologyLinkAttributes(topology, hops + 1, 0, hop_values));
+	ReleaseTopology(topology);
+
+	// Attribute columns of non-finalized nodes grow with their links
+	topology = InitializeTopology(TOPOLOGY_GRAPH, 1000);
+	latency = AddTopologyAttribute(topology, sizeof(double));
+	for(lp_id_t i = 0; i < 1000; i++) {
+		AddTopologyLink(topology, 0, i, 1.0);
+		*(double *)GetTopologyLinkAttribute(topology, latency, 0, i) = (double)i;
+	}
+	test_assert(FinalizeTopology(topology));
+	for(lp_id_t i = 0; i < 1000; i++)
+		test_assert(*(double *)GetTopologyLinkAttribute(topology, latency, 0, i) == (double)i);
+	ReleaseTopology(topology);
+
 	// Test sanity checks on graphs
 	topology = InitializeTopology(TOPOLOGY_GRAPH, 1);
 	for(enum topology_direction i = 0; i <= LAST_DIRECTION_VALID_VALUE; i++)
@@ -119,8 +493,324 @@ static int test_graph(_unused void *_)
 	return 0;
 }
 
+/**
+ * @brief Check that a topology has exactly the links of a reference adjacency matrix
+ * @param topology the topology to check
+ * @param links the reference adjacency matrix
+ */
+static void check_links(struct topology *topology, bool links[DYNAMIC_NODES][DYNAMIC_NODES])
+{
+	lp_id_t ids[DYNAMIC_NODES];
+
+	for(lp_id_t i = 0; i < DYNAMIC_NODES; i++) {
+		lp_id_t out = 0, in = 0;
+		for(lp_id_t j = 0; j < DYNAMIC_NODES; j++) {
+			test_assert(IsNeighbor(topology, i, j) == links[i][j]);
+			out += links[i][j];
+			in += links[j][i];
+		}
+		test_assert(CountDirections(topology, i) == out);
+		GetAllReceivers(topology, i, ids);
+		for(lp_id_t j = 0; j < out; j++)
+			test_assert(links[i][ids[j]]);
+		if(out)
+			test_assert(links[i][GetReceiver(topology, i, DIRECTION_RANDOM)]);
+		else
+			test_assert(GetReceiver(topology, i, DIRECTION_RANDOM) == INVALID_DIRECTION);
+
+		test_assert(CountSources(topology, i) == in);
+		GetAllSources(topology, i, ids);
+		for(lp_id_t j = 0; j < in; j++) {
+			test_assert(links[ids[j]][i]);
+			test_assert(j == 0 || ids[j - 1] < ids[j]);
+		}
+	}
+}
+
+static int test_removal(_unused void *_)
+{
+	static bool links[DYNAMIC_NODES][DYNAMIC_NODES];
+	struct topology *topology;
+
+	for(enum topology_precision precision = PRECISION_DOUBLE; precision <= PRECISION_FIXED16; precision++) {
+		for(int finalized = 0; finalized < 2; finalized++) {
+			memset(links, 0, sizeof(links));
+			topology = InitializeTopology(TOPOLOGY_GRAPH, DYNAMIC_NODES);
+			test_assert(SetTopologyPrecision(topology, precision));
+			unsigned hops = AddTopologyAttribute(topology, sizeof(unsigned));
+
+			// Node 0 is linked to everyone, so that its links are indexed
+			for(lp_id_t i = 0; i < DYNAMIC_NODES; i++) {
+				test_assert(AddTopologyLink(topology, 0, i, 0.5));
+				links[0][i] = true;
+			}
+			for(unsigned i = 0; i < DYNAMIC_NODES * 5; i++) {
+				lp_id_t from = test_random_range(DYNAMIC_NODES), to = test_random_range(DYNAMIC_NODES);
+				test_assert(AddTopologyLink(topology, from, to, test_random_double()));
+				*(unsigned *)GetTopologyLinkAttribute(topology, hops, from, to) = (unsigned)to;
+				links[from][to] = true;
+			}
+			if(finalized)
+				test_assert(FinalizeTopology(topology));
+
+			for(unsigned op = 0; op < DYNAMIC_OPERATIONS; op++) {
+				lp_id_t from = test_random_range(DYNAMIC_NODES), to = test_random_range(DYNAMIC_NODES);
+				lp_id_t new_to = test_random_range(DYNAMIC_NODES);
+
+				if(!links[from][to]) {
+					test_assert(!RemoveTopologyLink(topology, from, to));
+					test_assert(!RewireTopologyLink(topology, from, to, new_to));
+				} else if(op % 2) {
+					test_assert(RemoveTopologyLink(topology, from, to));
+					links[from][to] = false;
+				} else if(new_to != to && links[from][new_to]) {
+					test_assert(!RewireTopologyLink(topology, from, to, new_to));
+				} else {
+					test_assert(RewireTopologyLink(topology, from, to, new_to));
+					*(unsigned *)GetTopologyLinkAttribute(topology, hops, from, new_to) += (unsigned)new_to -
+					    (unsigned)to;
+					links[from][to] = false;
+					links[from][new_to] = true;
+				}
+				if(op % 50 == 0)
+					check_links(topology, links);
+			}
+			check_links(topology, links);
+
+			// Rewired links carry their attributes along
+			for(lp_id_t i = 1; i < DYNAMIC_NODES; i++)
+				for(lp_id_t j = 0; j < DYNAMIC_NODES; j++)
+					if(links[i][j])
+						test_assert(*(unsigned *)GetTopologyLinkAttribute(topology, hops, i, j) == j);
+
+			test_assert(FinalizeTopology(topology));
+			check_links(topology, links);
+			test_assert(SaveTopology(topology, TOPOLOGY_FILE));
+			ReleaseTopology(topology);
+			topology = MapTopology(TOPOLOGY_FILE);
+			test_assert(remove(TOPOLOGY_FILE) == 0);
+			test_assert(topology != NULL);
+			check_links(topology, links);
+			test_assert(!RemoveTopologyLink(topology, 0, 1));
+			ReleaseTopology(topology);
+		}
+
+		// Rewiring alone moves sources across nodes which have no free slot
+		memset(links, 0, sizeof(links));
+		topology = InitializeTopology(TOPOLOGY_GRAPH, DYNAMIC_NODES);
+		test_assert(SetTopologyPrecision(topology, precision));
+		for(lp_id_t i = 0; i < DYNAMIC_NODES; i++) {
+			test_assert(AddTopologyLink(topology, i, (i + 1) % DYNAMIC_NODES, 0.5));
+			links[i][(i + 1) % DYNAMIC_NODES] = true;
+		}
+		test_assert(FinalizeTopology(topology));
+		for(unsigned op = 0; op < DYNAMIC_OPERATIONS / 10; op++) {
+			lp_id_t from = test_random_range(DYNAMIC_NODES), new_to = test_random_range(DYNAMIC_NODES), to = 0;
+			while(!links[from][to])
+				to++;
+			if(links[from][new_to])
+				continue;
+			test_assert(RewireTopologyLink(topology, from, to, new_to));
+			links[from][to] = false;
+			links[from][new_to] = true;
+			check_links(topology, links);
+		}
+		ReleaseTopology(topology);
+
+		// Sampling only considers the remaining links
+		topology = InitializeTopology(TOPOLOGY_GRAPH, 6);
+		test_assert(SetTopologyPrecision(topology, precision));
+		AddTopologyLink(topology, 0, 5, 0.9);
+		AddTopologyLink(topology, 0, 1, 0.1);
+		AddTopologyLink(topology, 0, 2, 0.2);
+		AddTopologyLink(topology, 0, 3, 0.0);
+		AddTopologyLink(topology, 0, 4, 0.7);
+		test_assert(FinalizeTopology(topology));
+		test_assert(RemoveTopologyLink(topology, 0, 5));
+		check_distribution(topology);
+		test_assert(RemoveTopologyLink(topology, 0, 4));
+		test_assert(RewireTopologyLink(topology, 0, 3, 4));
+		for(unsigned i = 0; i < NUM_QUERIES; i++)
+			test_assert(GetReceiver(topology, 0, DIRECTION_RANDOM) <= 2);
+		test_assert(RemoveTopologyLink(topology, 0, 1));
+		test_assert(RemoveTopologyLink(topology, 0, 2));
+		test_assert(RemoveTopologyLink(topology, 0, 4));
+		test_assert(GetReceiver(topology, 0, DIRECTION_RANDOM) == INVALID_DIRECTION);
+		ReleaseTopology(topology);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Check that the sources of every node of a topology match its links
+ * @param topology the topology to check
+ * @param sources a buffer large enough for the sources of any node
+ */
+static void check_sources(struct topology *topology, lp_id_t *sources)
+{
+	lp_id_t links = 0, in_links = 0;
+
+	for(lp_id_t i = 0; i < CountRegions(topology); i++) {
+		links += CountDirections(topology, i);
+		in_links += CountSources(topology, i);
+	}
+	test_assert(links == in_links);
+
+	for(unsigned i = 0; i < NUM_QUERIES; i++) {
+		lp_id_t to = test_random_range(CountRegions(topology)), count = CountSources(topology, to);
+		GetAllSources(topology, to, sources);
+		for(lp_id_t j = 0; j < count; j++) {
+			test_assert(j == 0 || sources[j - 1] < sources[j]);
+			test_assert(IsNeighbor(topology, sources[j], to));
+		}
+	}
+}
+
+static int test_scale(_unused void *_)
+{
+	static lp_id_t sources[SCALE_NODES];
+	struct topology *topology = GenerateErdosRenyiTopology(SCALE_NODES, (double)SCALE_DEGREE / SCALE_NODES, 1);
+	clock_t rewire = 0, removal = 0;
+
+	test_assert(topology != NULL);
+	test_assert(FinalizeTopology(topology));
+
+	// Rewiring a link costs about as much as removing one, however large the topology is
+	for(unsigned op = 0; op < SCALE_OPERATIONS; op++) {
+		lp_id_t from = test_random_range(SCALE_NODES), new_to = test_random_range(SCALE_NODES);
+		lp_id_t to = GetReceiver(topology, from, DIRECTION_RANDOM);
+		if(to == INVALID_DIRECTION || IsNeighbor(topology, from, new_to))
+			continue;
+		clock_t start = clock();
+		test_assert(RewireTopologyLink(topology, from, to, new_to));
+		rewire += clock() - start;
+	}
+	check_sources(topology, sources);
+
+	for(unsigned op = 0; op < SCALE_OPERATIONS; op++) {
+		lp_id_t from = test_random_range(SCALE_NODES), to = GetReceiver(topology, from, DIRECTION_RANDOM);
+		if(to == INVALID_DIRECTION)
+			continue;
+		clock_t start = clock();
+		test_assert(RemoveTopologyLink(topology, from, to));
+		removal += clock() - start;
+	}
+	check_sources(topology, sources);
+	test_assert(rewire < 20 * removal + CLOCKS_PER_SEC / 10);
+
+	test_assert(FinalizeTopology(topology));
+	check_sources(topology, sources);
+	ReleaseTopology(topology);
+	return 0;
+}
+
+/**
+ * @brief Measure the bandwidth of a topology, the largest distance between the IDs of linked nodes
+ * @param topology the topology to measure
+ * @return the bandwidth of @p topology
+ */
+static lp_id_t bandwidth(struct topology *topology)
+{
+	lp_id_t ret = 0, receivers[REORDER_NODES];
+
+	for(lp_id_t i = 0; i < CountRegions(topology); i++) {
+		GetAllReceivers(topology, i, receivers);
+		for(lp_id_t j = 0; j < CountDirections(topology, i); j++) {
+			lp_id_t distance = receivers[j] > i ? receivers[j] - i : i - receivers[j];
+			ret = distance > ret ? distance : ret;
+		}
+	}
+	return ret;
+}
+
+static int test_reorder(_unused void *_)
+{
+	static lp_id_t from[REORDER_EDGES], to[REORDER_EDGES];
+	static double probabilities[REORDER_EDGES];
+	lp_id_t old_to_new[REORDER_NODES], new_to_old[REORDER_NODES];
+	struct topology *topology;
+
+	for(enum topology_order order = ORDER_RCM; order <= ORDER_BFS; order++) {
+		topology = InitializeTopology(TOPOLOGY_GRAPH, REORDER_NODES);
+		unsigned latency = AddTopologyAttribute(topology, sizeof(lp_id_t));
+		for(unsigned i = 0; i < REORDER_EDGES; i++) {
+			from[i] = test_random_range(REORDER_NODES);
+			to[i] = test_random_range(REORDER_NODES);
+			probabilities[i] = test_random_double();
+		}
+		test_assert(AddTopologyLinks(topology, REORDER_EDGES, from, to, probabilities, NULL));
+		for(unsigned i = 0; i < REORDER_EDGES; i++) {
+			test_assert(SetTopologyLinkData(topology, from[i], to[i], unique_ptr(from[i], to[i])));
+			*(lp_id_t *)GetTopologyLinkAttribute(topology, latency, from[i], to[i]) = from[i] + to[i];
+		}
+		lp_id_t degrees[REORDER_NODES], sources[REORDER_NODES];
+		for(lp_id_t i = 0; i < REORDER_NODES; i++) {
+			degrees[i] = CountDirections(topology, i);
+			sources[i] = CountSources(topology, i);
+		}
+
+		test_assert(ReorderTopology(topology, order, old_to_new, new_to_old));
+		for(lp_id_t i = 0; i < REORDER_NODES; i++) {
+			test_assert(old_to_new[new_to_old[i]] == i);
+			test_assert(CountDirections(topology, old_to_new[i]) == degrees[i]);
+			test_assert(CountSources(topology, old_to_new[i]) == sources[i]);
+		}
+		for(unsigned i = 0; i < REORDER_EDGES; i++) {
+			lp_id_t f = old_to_new[from[i]], t = old_to_new[to[i]];
+			test_assert(IsNeighbor(topology, f, t));
+			test_assert(GetTopologyLinkData(topology, f, t) == unique_ptr(from[i], to[i]));
+			test_assert(*(lp_id_t *)GetTopologyLinkAttribute(topology, latency, f, t) == from[i] + to[i]);
+		}
+		for(lp_id_t i = 1; i < REORDER_NODES && order == ORDER_DEGREE; i++)
+			test_assert(CountDirections(topology, i - 1) + CountSources(topology, i - 1) >=
+			    CountDirections(topology, i) + CountSources(topology, i));
+		for(unsigned i = 0; i < NUM_QUERIES; i++) {
+			lp_id_t node = test_random_range(REORDER_NODES);
+			if(CountDirections(topology, node))
+				test_assert(IsNeighbor(topology, node, GetReceiver(topology, node, DIRECTION_RANDOM)));
+		}
+
+		// The maps are optional, and a reordered topology can be reordered again
+		test_assert(ReorderTopology(topology, order, NULL, NULL));
+		ReleaseTopology(topology);
+	}
+
+	// Reverse Cuthill-McKee and breadth-first visits recover the band of a shuffled path
+	for(enum topology_order order = ORDER_RCM; order <= ORDER_BFS; order += ORDER_BFS - ORDER_RCM) {
+		lp_id_t shuffle[REORDER_NODES];
+		for(lp_id_t i = 0; i < REORDER_NODES; i++)
+			shuffle[i] = i;
+		for(lp_id_t i = REORDER_NODES - 1; i > 0; i--) {
+			lp_id_t j = test_random_range(i + 1), swap = shuffle[i];
+			shuffle[i] = shuffle[j];
+			shuffle[j] = swap;
+		}
+		topology = InitializeTopology(TOPOLOGY_GRAPH, REORDER_NODES);
+		for(lp_id_t i = 0; i + 1 < REORDER_NODES; i++) {
+			test_assert(AddTopologyLink(topology, shuffle[i], shuffle[i + 1], 0.5));
+			test_assert(AddTopologyLink(topology, shuffle[i + 1], shuffle[i], 0.5));
+		}
+		test_assert(bandwidth(topology) > 1);
+		test_assert(ReorderTopology(topology, order, NULL, NULL));
+		test_assert(bandwidth(topology) <= 2);
+		ReleaseTopology(topology);
+	}
+
+	topology = InitializeTopology(TOPOLOGY_GRAPH, 3);
+	test_assert(ReorderTopology(topology, 42, NULL, NULL) == false);
+	ReleaseTopology(topology);
+	topology = InitializeTopology(TOPOLOGY_RING, 3);
+	test_assert(ReorderTopology(topology, ORDER_RCM, NULL, NULL) == false);
+	ReleaseTopology(topology);
+	return 0;
+}
+
 
 int main(void)
 {
 	test("Graph topology", test_graph, NULL);
+	test("Graph link removal", test_removal, NULL);
+	test("Graph reordering", test_reorder, NULL);
+	test("Graph updates at scale", test_scale, NULL);
 }
@@ -0,0 +1,191 @@
+/**
+ * @file test/loaders.c
+ *
+ * @brief Test: graph file loaders
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <test.h>
+#include <ROOT-Sim/topology.h>
+
+#define GRAPH_FILE "test_loaders.graph"
+#define SAMPLING_TRIALS 100000
+#define LARGE_NODES 5000
+#define LARGE_EDGES 200000
+
+/**
+ * @brief Write a string to the test graph file
+ * @param content the content of the file
+ */
+static void write_file(const char *content)
+{
+	FILE *file = fopen(GRAPH_FILE, "wb");
+	test_assert(file != NULL);
+	test_assert(fputs(content, file) >= 0);
+	test_assert(fclose(file) == 0);
+}
+
+/**
+ * @brief Load the test graph file
+ * @param content the content of the file
+ * @param format the format of the file
+ * @param weights whether to derive probabilities from weights
+ * @return the loaded topology, NULL on failure
+ */
+static struct topology *load(const char *content, enum topology_format format, bool weights)
+{
+	write_file(content);
+	struct topology *topology = LoadTopology(GRAPH_FILE, format, weights);
+	test_assert(remove(GRAPH_FILE) == 0);
+	return topology;
+}
+
+/**
+ * @brief Check that a loaded topology is the small test graph
+ *
+ * The graph has 4 nodes and the links 0 -> 1, 0 -> 2, 1 -> 2, 2 -> 0 and 3 -> 3.
+ *
+ * @param topology the topology to check
+ */
+static void check_small_graph(struct topology *topology)
+{
+	test_assert(topology != NULL);
+	test_assert(CountRegions(topology) == 4);
+	test_assert(CountDirections(topology, 0) == 2);
+	test_assert(CountDirections(topology, 1) == 1);
+	test_assert(CountDirections(topology, 2) == 1);
+	test_assert(CountDirections(topology, 3) == 1);
+	test_assert(IsNeighbor(topology, 0, 1) && IsNeighbor(topology, 0, 2));
+	test_assert(IsNeighbor(topology, 1, 2) && IsNeighbor(topology, 2, 0) && IsNeighbor(topology, 3, 3));
+	test_assert(CountSources(topology, 2) == 2);
+}
+
+/**
+ * @brief Measure how often node 0 sends to node 1 rather than to node 2
+ * @param topology the topology to sample
+ * @return the fraction of random receivers of node 0 which are node 1
+ */
+static double sample_ratio(struct topology *topology)
+{
+	unsigned hits = 0;
+
+	for(unsigned i = 0; i < SAMPLING_TRIALS; i++)
+		hits += GetReceiver(topology, 0, DIRECTION_RANDOM) == 1;
+	return (double)hits / SAMPLING_TRIALS;
+}
+
+static int test_formats(_unused void *_)
+{
+	struct topology *topology;
+
+	topology = load("# comment\n0 1 3\n0,2,1\r\n\n1\t2 0.5\n2 0 1e0\n% another\n3 3 2.5E-1", FORMAT_EDGE_LIST, true);
+	check_small_graph(topology);
+	test_assert(sample_ratio(topology) > 0.73 && sample_ratio(topology) < 0.77);
+	ReleaseTopology(topology);
+
+	topology = load("0 1 3\n0 2 1\n1 2\n2 0\n3 3\n", FORMAT_EDGE_LIST, false);
+	check_small_graph(topology);
+	test_assert(sample_ratio(topology) > 0.48 && sample_ratio(topology) < 0.52);
+	ReleaseTopology(topology);
+
+	topology = load("c DIMACS\np sp 4 5\na 1 2 3\na 1 3 1\nc middle\na 2 3 7\na 3 1 2\na 4 4 1\n", FORMAT_DIMACS,
+	    true);
+	check_small_graph(topology);
+	test_assert(sample_ratio(topology) > 0.73 && sample_ratio(topology) < 0.77);
+	ReleaseTopology(topology);
+
+	topology = load("%%MatrixMarket matrix coordinate real general\n% comment\n4 4 5\n1 2 3.0\n1 3 1.0\n2 3 .5\n"
+			"3 1 1\n4 4 1\n", FORMAT_MATRIX_MARKET, true);
+	check_small_graph(topology);
+	test_assert(sample_ratio(topology) > 0.73 && sample_ratio(topology) < 0.77);
+	ReleaseTopology(topology);
+
+	// Symmetric matrices only list the lower triangle
+	topology = load("%%MatrixMarket matrix coordinate pattern symmetric\n3 3 2\n2 1\n3 3\n", FORMAT_MATRIX_MARKET,
+	    false);
+	test_assert(topology != NULL);
+	test_assert(IsNeighbor(topology, 0, 1) && IsNeighbor(topology, 1, 0) && IsNeighbor(topology, 2, 2));
+	test_assert(CountDirections(topology, 2) == 1);
+	ReleaseTopology(topology);
+
+	// Only the weights of skew-symmetric matrices are taken in absolute value
+	topology = load("%%MatrixMarket matrix coordinate real skew-symmetric\n2 2 1\n2 1 -2.0\n", FORMAT_MATRIX_MARKET,
+	    true);
+	test_assert(topology != NULL);
+	test_assert(IsNeighbor(topology, 0, 1) && IsNeighbor(topology, 1, 0));
+	ReleaseTopology(topology);
+	test_assert(load("%%MatrixMarket matrix coordinate real symmetric\n2 2 1\n2 1 -2.0\n", FORMAT_MATRIX_MARKET,
+	    true) == NULL);
+
+	// METIS graphs list undirected edges from both sides, here with vertex weights and edge weights
+	topology = load("% comment\n3 2 011\n7 2 3 3 1\n1 1 3\n5\n\n", FORMAT_METIS, true);
+	test_assert(topology != NULL);
+	test_assert(CountRegions(topology) == 3);
+	test_assert(IsNeighbor(topology, 0, 1) && IsNeighbor(topology, 0, 2) && IsNeighbor(topology, 1, 0));
+	test_assert(CountDirections(topology, 2) == 0);
+	test_assert(sample_ratio(topology) > 0.73 && sample_ratio(topology) < 0.77);
+	ReleaseTopology(topology);
+
+	return 0;
+}
+
+static int test_errors(_unused void *_)
+{
+	test_assert(LoadTopology("this file does not exist", FORMAT_EDGE_LIST, false) == NULL);
+	test_assert(load("0 1\n", 42, false) == NULL);
+	test_assert(load("", FORMAT_EDGE_LIST, false) == NULL);
+	test_assert(load("0 1\n0 x\n", FORMAT_EDGE_LIST, false) == NULL);
+	test_assert(load("0 1 -1\n", FORMAT_EDGE_LIST, true) == NULL);
+	test_assert(load("0 1 2 3\n", FORMAT_EDGE_LIST, false) == NULL);
+	test_assert(load("a 1 2 1\n", FORMAT_DIMACS, false) == NULL);
+	test_assert(load("p sp 2 1\na 1 3 1\n", FORMAT_DIMACS, false) == NULL);
+	test_assert(load("p sp 2 1\na 0 1 1\n", FORMAT_DIMACS, false) == NULL);
+	test_assert(load("%%MatrixMarket matrix array real general\n2 2\n1\n", FORMAT_MATRIX_MARKET, false) == NULL);
+	test_assert(load("%%MatrixMarket matrix coordinate complex general\n2 2 1\n1 1 1 1\n", FORMAT_MATRIX_MARKET,
+	    false) == NULL);
+	test_assert(load("%%MatrixMarket matrix coordinate real general\n2 2 1\n1 1\n", FORMAT_MATRIX_MARKET, false) ==
+	    NULL);
+	test_assert(load("3 2\n2\n1\n", FORMAT_METIS, false) == NULL);
+	test_assert(load("2 1\n2\n3\n", FORMAT_METIS, false) == NULL);
+	return 0;
+}
+
+static int test_large(_unused void *_)
+{
+	static lp_id_t from[LARGE_EDGES], to[LARGE_EDGES];
+	FILE *file = fopen(GRAPH_FILE, "wb");
+	test_assert(file != NULL);
+
+	// Lines longer than the read chunks must be handled as well
+	fprintf(file, "#");
+	for(unsigned i = 0; i < 3 << 20; i++)
+		fputc('x', file);
+	fputc('\n', file);
+
+	for(unsigned i = 0; i < LARGE_EDGES; i++) {
+		from[i] = test_random_range(LARGE_NODES);
+		to[i] = test_random_range(LARGE_NODES);
+		fprintf(file, "%llu %llu %.17g\n", (unsigned long long)from[i], (unsigned long long)to[i],
+		    test_random_double());
+	}
+	test_assert(fclose(file) == 0);
+
+	struct topology *topology = LoadTopology(GRAPH_FILE, FORMAT_EDGE_LIST, true);
+	test_assert(remove(GRAPH_FILE) == 0);
+	test_assert(topology != NULL);
+	for(unsigned i = 0; i < LARGE_EDGES; i++)
+		test_assert(IsNeighbor(topology, from[i], to[i]));
+	ReleaseTopology(topology);
+	return 0;
+}
+
+int main(void)
+{
+	test("Graph file formats", test_formats, NULL);
+	test("Malformed graph files", test_errors, NULL);
+	test("Large graph files", test_large, NULL);
+}
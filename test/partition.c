@@ -0,0 +1,174 @@
+/**
+ * @file test/partition.c
+ *
+ * @brief Test: topology partitioning
+ *
+ * SPDX-FileCopyrightText: 2008-2026 HPCS Group <rootsim@googlegroups.com>
+ * SPDX-License-Identifier: GPL-3.0-only
+ */
+#include <math.h>
+#include <stdlib.h>
+
+#include <test.h>
+#include <ROOT-Sim/topology.h>
+
+#define BALANCE 1.05
+#define CLUSTERS 8
+#define CLUSTER_NODES 250
+#define CLUSTER_LINKS 8
+#define MESH_SIDE 100
+#define MAX_REGIONS (MESH_SIDE * MESH_SIDE)
+
+static unsigned part[MAX_REGIONS];
+
+/**
+ * @brief Check that a partition is valid and balanced, and that its statistics are right
+ * @param topology the partitioned topology
+ * @param parts the number of parts
+ * @param stats the statistics reported for the partition
+ */
+static void check_partition(struct topology *topology, unsigned parts, const struct topology_partition_stats *stats)
+{
+	static lp_id_t receivers[MAX_REGIONS], sizes[MAX_REGIONS];
+	lp_id_t regions = CountRegions(topology), largest = 0, even = (regions + parts - 1) / parts;
+	uint64_t cut = 0;
+
+	for(unsigned p = 0; p < parts; p++)
+		sizes[p] = 0;
+	for(lp_id_t i = 0; i < regions; i++) {
+		test_assert(part[i] < parts);
+		sizes[part[i]]++;
+	}
+	for(unsigned p = 0; p < parts; p++)
+		largest = sizes[p] > largest ? sizes[p] : largest;
+	test_assert(largest <= (lp_id_t)(BALANCE * regions / parts) || largest == even);
+	test_assert(fabs(stats->imbalance - (double)largest * parts / regions) < 1e-9);
+	test_assert(stats->remote_share >= 0 && stats->remote_share <= 1);
+	if(parts == 1)
+		test_assert(stats->cut_links == 0 && stats->remote_share == 0);
+
+	// Stars and meshes have closed-form statistics, checked separately
+	if(regions > 1 && CountDirections(topology, 0) == regions - 1)
+		return;
+	for(lp_id_t i = 0; i < regions; i++) {
+		GetAllReceivers(topology, i, receivers);
+		for(lp_id_t j = 0; j < CountDirections(topology, i); j++)
+			cut += part[receivers[j]] != part[i];
+	}
+	test_assert(stats->cut_links == cut);
+}
+
+static int test_geometries(_unused void *_)
+{
+	struct topology_partition_stats stats;
+	unsigned parts[] = {1, 4, 7, 12};
+
+	for(enum topology_geometry geometry = TOPOLOGY_HEXAGON; geometry < TOPOLOGY_GRAPH; geometry++) {
+		struct topology *topology = geometry <= TOPOLOGY_TORUS ? InitializeTopology(geometry, 30, 40) :
+		    InitializeTopology(geometry, 1200);
+		for(unsigned i = 0; i < sizeof(parts) / sizeof(*parts); i++) {
+			test_assert(PartitionTopology(topology, parts[i], BALANCE, part, &stats));
+			check_partition(topology, parts[i], &stats);
+		}
+		ReleaseTopology(topology);
+	}
+
+	// A 40x30 square grid is cut in 2x2 tiles, and every link on the boundary of two tiles is cut both ways
+	struct topology *topology = InitializeTopology(TOPOLOGY_SQUARE, 30, 40);
+	test_assert(PartitionTopology(topology, 4, BALANCE, part, &stats));
+	test_assert(stats.cut_links == 2 * (30 + 40));
+	test_assert(stats.imbalance == 1.0);
+	ReleaseTopology(topology);
+
+	// The star and the mesh have closed-form statistics
+	topology = InitializeTopology(TOPOLOGY_STAR, 100);
+	test_assert(PartitionTopology(topology, 4, 1.0, part, &stats));
+	test_assert(stats.cut_links == 150);
+	ReleaseTopology(topology);
+	topology = InitializeTopology(TOPOLOGY_FCMESH, 100);
+	test_assert(PartitionTopology(topology, 4, 1.0, part, &stats));
+	test_assert(stats.cut_links == 100 * 75);
+	test_assert(fabs(stats.remote_share - 75.0 / 99) < 1e-9);
+	ReleaseTopology(topology);
+	return 0;
+}
+
+static int test_graphs(_unused void *_)
+{
+	struct topology_partition_stats stats;
+	struct topology *topology;
+
+	// Clusters of densely linked nodes, with a few links across clusters
+	topology = InitializeTopology(TOPOLOGY_GRAPH, CLUSTERS * CLUSTER_NODES);
+	for(lp_id_t i = 0; i < CLUSTERS * CLUSTER_NODES; i++) {
+		lp_id_t cluster = i / CLUSTER_NODES;
+		for(unsigned j = 0; j < CLUSTER_LINKS; j++)
+			AddTopologyLink(topology, i, cluster * CLUSTER_NODES + test_random_range(CLUSTER_NODES), 1.0);
+		if(test_random_double() < 0.1)
+			AddTopologyLink(topology, i, test_random_range(CLUSTERS * CLUSTER_NODES), 0.5);
+	}
+	test_assert(PartitionTopology(topology, CLUSTERS, BALANCE, part, &stats));
+	check_partition(topology, CLUSTERS, &stats);
+	test_assert(stats.remote_share < 0.05);
+	ReleaseTopology(topology);
+
+	// A large mesh needs several levels of coarsening
+	topology = InitializeTopology(TOPOLOGY_GRAPH, MAX_REGIONS);
+	for(lp_id_t i = 0; i < MAX_REGIONS; i++) {
+		if(i % MESH_SIDE != MESH_SIDE - 1) {
+			test_assert(AddTopologyLink(topology, i, i + 1, 0.5));
+			test_assert(AddTopologyLink(topology, i + 1, i, 0.5));
+		}
+		if(i + MESH_SIDE < MAX_REGIONS) {
+			test_assert(AddTopologyLink(topology, i, i + MESH_SIDE, 0.5));
+			test_assert(AddTopologyLink(topology, i + MESH_SIDE, i, 0.5));
+		}
+	}
+	for(unsigned parts = 1; parts <= 64; parts *= 4) {
+		test_assert(PartitionTopology(topology, parts, BALANCE, part, &stats));
+		check_partition(topology, parts, &stats);
+		// Square tiles would cut 4 * MESH_SIDE * (sqrt(parts) - 1) links
+		test_assert(stats.cut_links <= 6 * MESH_SIDE * (unsigned)sqrt(parts));
+	}
+
+	// Heavy links are kept within a part: a ring of pairs linked by heavy links
+	ReleaseTopology(topology);
+	topology = InitializeTopology(TOPOLOGY_GRAPH, 1000);
+	for(lp_id_t i = 0; i < 1000; i++) {
+		test_assert(AddTopologyLink(topology, i, (i + 1) % 1000, i % 2 ? 0.01 : 1.0));
+		test_assert(AddTopologyLink(topology, (i + 1) % 1000, i, i % 2 ? 0.01 : 1.0));
+	}
+	test_assert(PartitionTopology(topology, 10, BALANCE, part, &stats));
+	check_partition(topology, 10, &stats);
+	for(lp_id_t i = 0; i < 1000; i += 2)
+		test_assert(part[i] == part[i + 1]);
+	ReleaseTopology(topology);
+	return 0;
+}
+
+static int test_errors(_unused void *_)
+{
+	struct topology *topology = InitializeTopology(TOPOLOGY_GRAPH, 10);
+	test_assert(!PartitionTopology(topology, 0, BALANCE, part, NULL));
+	test_assert(!PartitionTopology(topology, 11, BALANCE, part, NULL));
+	test_assert(!PartitionTopology(topology, 2, 0.5, part, NULL));
+	test_assert(!PartitionTopology(topology, 2, NAN, part, NULL));
+
+	// Isolated nodes are spread evenly
+	test_assert(PartitionTopology(topology, 10, 1.0, part, NULL));
+	for(unsigned p = 0; p < 10; p++) {
+		unsigned count = 0;
+		for(lp_id_t i = 0; i < 10; i++)
+			count += part[i] == p;
+		test_assert(count == 1);
+	}
+	ReleaseTopology(topology);
+	return 0;
+}
+
+int main(void)
+{
+	test("Partitioning of regular topologies", test_geometries, NULL);
+	test("Partitioning of graphs", test_graphs, NULL);
+	test("Partitioning errors", test_errors, NULL);
+}
@@ -222,8 +222,50 @@ int test_square(_unused void *_)
 }
 
 
+int test_random_neighbors(_unused void *_)
+{
+	unsigned sizes[][2] = {{1, 1}, {1, 5}, {5, 1}, {2, 2}, {2, 3}, {3, 2}, {6, 7}};
+
+	for(enum topology_geometry geometry = TOPOLOGY_HEXAGON; geometry <= TOPOLOGY_TORUS; geometry++) {
+		for(unsigned s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+			struct topology *topology = InitializeTopology(geometry, sizes[s][0], sizes[s][1]);
+			lp_id_t receivers[6];
+
+			for(lp_id_t from = 0; from < CountRegions(topology); from++) {
+				unsigned hits[6] = {0}, n = (unsigned)CountDirections(topology, from);
+				GetAllReceivers(topology, from, receivers);
+				if(n == 0) {
+					test_assert(GetReceiver(topology, from, DIRECTION_RANDOM) == INVALID_DIRECTION);
+					continue;
+				}
+
+				// Random receivers are exactly the neighbors, and the directions leading to them are equally likely
+				for(unsigned i = 0; i < 600 * n; i++) {
+					lp_id_t to = GetReceiver(topology, from, DIRECTION_RANDOM);
+					unsigned j = 0;
+					while(j < n && receivers[j] != to)
+						j++;
+					test_assert(j < n);
+					for(unsigned k = 0; k < n; k++)
+						hits[k] += receivers[k] == to;
+				}
+				for(unsigned j = 0; j < n; j++) {
+					unsigned copies = 0;
+					for(unsigned k = 0; k < n; k++)
+						copies += receivers[k] == receivers[j];
+					test_assert(hits[j] > 450 * copies && hits[j] < 750 * copies);
+				}
+			}
+			ReleaseTopology(topology);
+		}
+	}
+	return 0;
+}
+
+
 int main(void)
 {
 	test("Hexagon topology", test_hexagon, NULL);
 	test("Square topology", test_square, NULL);
+	test("Random neighbors of grids", test_random_neighbors, NULL);
 }